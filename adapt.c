@@ -0,0 +1,348 @@
+#include <string.h>
+
+#include "adapt.h"
+#include "block.h"
+#include "canon.h"
+#include "encode.h"
+#include "decode.h"
+#include "bitstream.h"
+#include "hist.h"
+
+/* What both sides know about the chars coded so far */
+struct adapt_model {
+	uint32_t freq[ASCII_SIZE];
+	uint32_t total;			/* sum of freq */
+	uint32_t period;		/* chars between two rebuilds */
+	uint32_t left;			/* chars before the next rebuild */
+	uint8_t lens[ASCII_SIZE];
+};
+
+/* The model and the decoder for its code */
+struct adapt_decoder {
+	struct adapt_model m;
+	struct huf_node huftree[2 * ASCII_SIZE - 1];
+	uint16_t huftree_size;
+	struct huf_decoder dec;
+};
+
+/* Every char starts with a count of one, so all of them have a code */
+static enum huf_result model_init(struct adapt_model *m)
+{
+	int i;
+
+	for (i = 0; i < ASCII_SIZE; i++)
+		m->freq[i] = 1;
+	m->total = ASCII_SIZE;
+	m->period = ADAPT_MIN_PERIOD;
+	m->left = m->period;
+
+	return canon_lengths(m->freq, ADAPT_CODE_LEN, m->lens);
+}
+
+/* Counts the n chars at src, n being at most m->left */
+static void model_count(struct adapt_model *m, const uint8_t *src, size_t n)
+{
+	uint32_t freq[ASCII_SIZE];
+	int i;
+
+	hist_count(src, n, freq);
+	for (i = 0; i < ASCII_SIZE; i++)
+		m->freq[i] += freq[i];
+	m->total += n;
+	m->left -= n;
+}
+
+/* Computes the code lengths from the counts and schedules the next rebuild */
+static enum huf_result model_rebuild(struct adapt_model *m)
+{
+	int i;
+
+	/* Halving keeps every count above zero */
+	if (m->total > ADAPT_MAX_TOTAL) {
+		m->total = 0;
+		for (i = 0; i < ASCII_SIZE; i++) {
+			m->freq[i] = (m->freq[i] + 1) / 2;
+			m->total += m->freq[i];
+		}
+	}
+
+	if (m->period < ADAPT_MAX_PERIOD)
+		m->period *= 2;
+	m->left = m->period;
+
+	return canon_lengths(m->freq, ADAPT_CODE_LEN, m->lens);
+}
+
+/* Records the block in stats, with the code it started with */
+static void model_stats(struct adapt_model *m, struct huf_stats *stats)
+{
+	uint32_t max_len = 0;
+	int i;
+
+	if (stats == NULL)
+		return;
+
+	for (i = 0; i < ASCII_SIZE; i++)
+		if (m->lens[i] > max_len)
+			max_len = m->lens[i];
+	stats_tree(stats, 2 * ASCII_SIZE - 1, max_len);
+}
+
+/*
+ * Codes the n chars at src into a whole block at dst, header included, with
+ * the codes of the model, rebuilt on the way. dst holds block_bound(n) bytes.
+ */
+static enum huf_result encode_block(struct adapt_model *m,
+		struct huf_code codes[ASCII_SIZE], const uint8_t *src,
+		uint32_t n, uint8_t *dst, size_t *dst_size,
+		struct huf_stats *stats)
+{
+	struct block_header bh;
+	struct bit_writer bw;
+	struct stats_clock clock;
+	enum huf_result r;
+	uint32_t left, k;
+
+	model_stats(m, stats);
+	bw_init_mem(&bw, &dst[BLOCK_HEADER_SIZE],
+			block_bound(n) - BLOCK_HEADER_SIZE);
+	for (left = n; left > 0; left -= k) {
+		k = left < m->left ? left : m->left;
+
+		stats_start(stats, &clock);
+		huf_encode(&bw, codes, src, k);
+		model_count(m, src, k);
+		stats_stop(stats, STATS_ENCODE, &clock);
+		src += k;
+
+		if (m->left == 0) {
+			stats_start(stats, &clock);
+			r = model_rebuild(m);
+			if (r != HUF_SUCCESS)
+				return r;
+			canon_codes(m->lens, codes);
+			stats_stop(stats, STATS_TREE, &clock);
+		}
+	}
+	bw_finish(&bw);
+
+	bh.type = BLOCK_ADAPTIVE;
+	bh.flags = 0;
+	bh.raw_size = n;
+	bh.comp_size = bw.pos - bw.buf;
+	frame_put_block(dst, &bh);
+	*dst_size = BLOCK_HEADER_SIZE + bh.comp_size;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Compresses the input in a single pass, writing every block as soon as it
+ * is coded. Streams are coded a read at a time.
+ */
+enum huf_result adapt_compress(struct huf_input *in, struct huf_output *out,
+		struct huf_stats *stats)
+{
+	uint8_t head[FRAME_HEADER_SIZE];
+	struct huf_code codes[ASCII_SIZE];
+	struct adapt_model m;
+	struct frame_header fh;
+	struct block_header bh;
+	enum huf_result r;
+	uint8_t *text, *comp;
+	const uint8_t *data;
+	size_t got, size;
+
+	text = (uint8_t *) huf_malloc(ADAPT_BLOCK_SIZE * sizeof(uint8_t));
+	comp = (uint8_t *) huf_malloc(block_bound(ADAPT_BLOCK_SIZE) *
+			sizeof(uint8_t));
+	if (text == NULL || comp == NULL) {
+		r = HUF_ERROR_MEMORY_ALLOC;
+		goto out_free;
+	}
+
+	r = model_init(&m);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+	canon_codes(m.lens, codes);
+
+	/* The size of a mapped input is known before it is read */
+	fh.version = FRAME_VERSION;
+	fh.flags = FRAME_ADAPTIVE;
+	fh.block_size = ADAPT_BLOCK_SIZE;
+	fh.content_size = io_in_size(in);
+	if (in->map != NULL)
+		fh.flags |= FRAME_CONTENT_SIZE;
+	frame_put_header(head, &fh);
+	r = io_write(out, head, FRAME_HEADER_SIZE);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	while (1) {
+		r = io_next_avail(in, text, ADAPT_BLOCK_SIZE, &data, &got);
+		if (r != HUF_SUCCESS || got == 0)
+			break;
+
+		r = encode_block(&m, codes, data, got, comp, &size, stats);
+		if (r != HUF_SUCCESS)
+			break;
+		r = io_write(out, comp, size);
+		if (r != HUF_SUCCESS)
+			break;
+
+		/* A stream may not send more before it gets an answer */
+		if (in->map == NULL) {
+			r = io_flush(out);
+			if (r != HUF_SUCCESS)
+				break;
+		}
+	}
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	bh.type = BLOCK_END;
+	size = frame_put_block(head, &bh);
+	r = io_write(out, head, size);
+
+out_free:
+	free(text);
+	free(comp);
+
+	return r;
+}
+
+/* Decodes the n chars of the block in br into dst, rebuilding on the way */
+static enum huf_result decode_block(struct adapt_decoder *ad,
+		struct bit_reader *br, uint8_t *dst, uint32_t n,
+		struct huf_stats *stats)
+{
+	struct stats_clock clock;
+	enum huf_result r;
+	uint32_t left, k;
+
+	model_stats(&ad->m, stats);
+	for (left = n; left > 0; left -= k) {
+		k = left < ad->m.left ? left : ad->m.left;
+
+		stats_start(stats, &clock);
+		r = huf_decode(&ad->dec, br, dst, k);
+		if (r != HUF_SUCCESS)
+			return r;
+		model_count(&ad->m, dst, k);
+		stats_stop(stats, STATS_DECODE, &clock);
+		dst += k;
+
+		if (ad->m.left == 0) {
+			stats_start(stats, &clock);
+			r = model_rebuild(&ad->m);
+			if (r == HUF_SUCCESS)
+				r = canon_tree(ad->m.lens, ad->huftree,
+						&ad->huftree_size);
+			if (r == HUF_SUCCESS)
+				r = huf_decoder_init(&ad->dec, ad->huftree,
+						ad->huftree_size);
+			if (r != HUF_SUCCESS)
+				return r;
+			stats_stop(stats, STATS_TABLE, &clock);
+		}
+	}
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Decompresses the blocks following the adaptive frame header fh, writing
+ * only the chars from start up to end
+ */
+enum huf_result adapt_decompress(struct huf_input *in, struct huf_output *out,
+		struct frame_header *fh, uint64_t start, uint64_t end,
+		struct huf_stats *stats)
+{
+	uint8_t bhead[BLOCK_HEADER_SIZE];
+	struct adapt_decoder *ad;
+	struct block_header bh;
+	struct bit_reader br;
+	enum huf_result r;
+	uint8_t *text = NULL, *comp = NULL;
+	const uint8_t *payload;
+	uint64_t raw_pos;
+	size_t n, skip, keep;
+
+	if (fh->block_size > ADAPT_BLOCK_SIZE)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	ad = (struct adapt_decoder *) huf_malloc(sizeof(struct adapt_decoder));
+	text = (uint8_t *) huf_malloc(fh->block_size * sizeof(uint8_t));
+	comp = (uint8_t *) huf_malloc(block_bound(fh->block_size) *
+			sizeof(uint8_t));
+	if (ad == NULL || text == NULL || comp == NULL) {
+		r = HUF_ERROR_MEMORY_ALLOC;
+		goto out_free;
+	}
+
+	r = model_init(&ad->m);
+	if (r == HUF_SUCCESS)
+		r = canon_tree(ad->m.lens, ad->huftree, &ad->huftree_size);
+	if (r == HUF_SUCCESS)
+		r = huf_decoder_init(&ad->dec, ad->huftree, ad->huftree_size);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	/* Every block is decoded, the model needs all the chars */
+	raw_pos = 0;
+	while (raw_pos < end) {
+		r = io_read(in, bhead, 1);
+		if (r != HUF_SUCCESS)
+			goto out_free;
+		if (bhead[0] == BLOCK_END)
+			break;
+
+		r = io_read(in, &bhead[1], BLOCK_HEADER_SIZE - 1);
+		if (r != HUF_SUCCESS)
+			goto out_free;
+		r = frame_get_block(bhead, &bh);
+		if (r == HUF_SUCCESS)
+			r = block_check(fh, &bh);
+		if (r != HUF_SUCCESS)
+			goto out_free;
+
+		r = io_next(in, comp, bh.comp_size, &payload, &n);
+		if (r != HUF_SUCCESS)
+			goto out_free;
+		if (n != bh.comp_size) {
+			r = HUF_ERROR_END_OF_FILE;
+			goto out_free;
+		}
+
+		br_init_mem(&br, payload, bh.comp_size);
+		r = decode_block(ad, &br, text, bh.raw_size, stats);
+		if (r != HUF_SUCCESS)
+			goto out_free;
+
+		/* Writing the part of the block inside the range */
+		skip = start > raw_pos ? start - raw_pos : 0;
+		raw_pos += bh.raw_size;
+		if (skip >= bh.raw_size)
+			continue;
+		keep = bh.raw_size - skip;
+		if (raw_pos > end)
+			keep -= raw_pos - end;
+		r = io_write(out, &text[skip], keep);
+		if (r == HUF_SUCCESS && in->map == NULL)
+			r = io_flush(out);
+		if (r != HUF_SUCCESS)
+			goto out_free;
+	}
+
+	if (start == 0 && end == UINT64_MAX &&
+			(fh->flags & FRAME_CONTENT_SIZE) &&
+			raw_pos != fh->content_size)
+		r = HUF_ERROR_INVALID_RESOURCE;
+
+out_free:
+	free(ad);
+	free(text);
+	free(comp);
+
+	return r;
+}
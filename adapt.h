@@ -0,0 +1,44 @@
+/*
+ * Adaptive single pass mode. Nothing is counted upfront: both sides start
+ * with every char equally likely, count the chars as they are coded and
+ * rebuild the same canonical code from the counts after a fixed number of
+ * chars, first often and then every ADAPT_MAX_PERIOD chars. The counts are
+ * halved once they grow large, so the code follows the text as it changes.
+ *
+ * The frame carries FRAME_ADAPTIVE and BLOCK_ADAPTIVE blocks, which hold
+ * only the bits of their chars, no code lengths. A block ends wherever the
+ * input paused, so its bits are written as soon as they are known, and the
+ * end block closes the stream. The blocks depend on the ones before them,
+ * so they are decoded in order and the frame has no index.
+ */
+
+#ifndef ADAPT_H
+#define ADAPT_H
+
+#include "common.h"
+#include "io.h"
+#include "frame.h"
+#include "stats.h"
+
+#define ADAPT_BLOCK_SIZE	(1 << 16)	/* largest block */
+#define ADAPT_CODE_LEN		(11)		/* resolved by the decoder table */
+#define ADAPT_MIN_PERIOD	(1 << 10)	/* chars before the first rebuild */
+#define ADAPT_MAX_PERIOD	(1 << 15)
+#define ADAPT_MAX_TOTAL		(1 << 18)	/* counts are halved past it */
+
+/*
+ * Compresses the input in a single pass, writing every block as soon as it
+ * is coded. Streams are coded a read at a time.
+ */
+enum huf_result adapt_compress(struct huf_input *in, struct huf_output *out,
+		struct huf_stats *stats);
+
+/*
+ * Decompresses the blocks following the adaptive frame header fh, writing
+ * only the chars from start up to end
+ */
+enum huf_result adapt_decompress(struct huf_input *in, struct huf_output *out,
+		struct frame_header *fh, uint64_t start, uint64_t end,
+		struct huf_stats *stats);
+
+#endif	/* #ifndef ADAPT_H */
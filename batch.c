@@ -0,0 +1,947 @@
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "frame.h"
+#include "stream.h"
+#include "pool.h"
+#include "split.h"
+
+/* Members in flight per worker, one being processed and one waiting */
+#define MEMBERS_PER_THREAD	(2)
+
+/* Where a member is in the archive */
+struct archive_entry {
+	uint64_t offset;		/* of the frame, from the archive start */
+	uint64_t comp_size;		/* of the frame */
+	uint64_t raw_size;
+	const char *name;		/* not terminated */
+	uint16_t name_len;
+};
+
+/* A member on its way through the worker pool */
+struct member_slot {
+	struct pool_job job;
+	const char *path;		/* input, NULL for an archive member */
+	struct huf_input view;		/* the frame of an archive member */
+	char out_path[PATH_MAX];	/* empty if the frame stays in comp */
+	uint8_t *comp;			/* the compressed frame, kept */
+	size_t comp_mem;
+	size_t comp_size;
+	struct block_decoder *dec;	/* kept, decompression only */
+	uint8_t *text;			/* a decoded block, likewise */
+	size_t text_mem;
+	uint64_t in_bytes;
+	uint64_t out_bytes;
+	const struct batch *b;
+	enum huf_result r;
+};
+
+/* What a mode hands to run_members */
+struct batch_run {
+	struct batch *b;
+	char **paths;			/* the members, unless extracting */
+	const char *dir;		/* where the outputs go, if anywhere */
+	struct archive_entry *entries;
+	const uint8_t *archive;		/* the archive being extracted */
+	struct huf_output *out;		/* the archive being written */
+	uint64_t start;			/* of the archive in out */
+	enum huf_result (*prepare)(struct batch_run *run,
+			struct member_slot *s, int i);
+	enum huf_result (*finish)(struct batch_run *run,
+			struct member_slot *s, int i);
+};
+
+static int compare_paths(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Last part of a path, the name a member goes by */
+static const char *base_name(const char *path)
+{
+	const char *slash;
+
+	slash = strrchr(path, '/');
+
+	return slash != NULL ? slash + 1 : path;
+}
+
+/* Only plain names are written outside the output directory */
+static int valid_name(const char *name, size_t n)
+{
+	if (n == 0 || memchr(name, '/', n) != NULL ||
+			memchr(name, '\0', n) != NULL)
+		return 0;
+	if ((n == 1 && name[0] == '.') ||
+			(n == 2 && name[0] == '.' && name[1] == '.'))
+		return 0;
+
+	return 1;
+}
+
+/* Appends dir/name, or only the n chars of name if dir is NULL */
+static enum huf_result list_add(char ***paths, int *count, int *mem,
+		const char *dir, const char *name, size_t n)
+{
+	char **tmp;
+	char *path;
+	size_t k;
+
+	if (*count == *mem) {
+		if (*mem >= INT_MAX / 2)
+			return HUF_ERROR_INVALID_RESOURCE;
+		*mem = *mem > 0 ? 2 * *mem : 64;
+		tmp = (char **) huf_realloc(*paths, *mem * sizeof(char *));
+		if (tmp == NULL)
+			return HUF_ERROR_MEMORY_ALLOC;
+		*paths = tmp;
+	}
+
+	k = dir != NULL ? strlen(dir) + 1 : 0;
+	path = (char *) huf_malloc((k + n + 1) * sizeof(char));
+	if (path == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+	if (dir != NULL) {
+		memcpy(path, dir, k - 1);
+		path[k - 1] = '/';
+	}
+	memcpy(&path[k], name, n);
+	path[k + n] = '\0';
+	(*paths)[(*count)++] = path;
+
+	return HUF_SUCCESS;
+}
+
+/* The regular files of the directory, sorted by name */
+static enum huf_result list_dir(const char *src, char ***paths, int *count,
+		int *mem)
+{
+	struct dirent *de;
+	struct stat st;
+	enum huf_result r = HUF_SUCCESS;
+	DIR *dir;
+
+	dir = opendir(src);
+	if (dir == NULL)
+		return HUF_ERROR_FILE_ACCESS;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (!valid_name(de->d_name, strlen(de->d_name)))
+			continue;
+		r = list_add(paths, count, mem, src, de->d_name,
+				strlen(de->d_name));
+		if (r != HUF_SUCCESS)
+			break;
+
+		/* Subdirectories and the like are left out */
+		if (stat((*paths)[*count - 1], &st) != 0 ||
+				!S_ISREG(st.st_mode))
+			free((*paths)[--*count]);
+	}
+	closedir(dir);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	if (*count > 1)
+		qsort(*paths, *count, sizeof(char *), compare_paths);
+
+	return HUF_SUCCESS;
+}
+
+/* The non-empty lines of the list file */
+static enum huf_result list_file(const char *src, char ***paths, int *count,
+		int *mem)
+{
+	struct huf_input in = {.fd = -1};
+	enum huf_result r;
+	const uint8_t *data;
+	const char *line, *end, *eol;
+	uint8_t *buf = NULL;
+	uint64_t size;
+	size_t n;
+
+	r = io_open_in(&in, src);
+	if (r != HUF_SUCCESS)
+		return r;
+	r = io_read_all(&in, &data, &size, &buf);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	line = (const char *) data;
+	end = line + size;
+	while (line < end) {
+		eol = memchr(line, '\n', end - line);
+		if (eol == NULL)
+			eol = end;
+		n = eol - line;
+		if (n > 0 && line[n - 1] == '\r')
+			n--;
+		if (n > 0) {
+			r = list_add(paths, count, mem, NULL, line, n);
+			if (r != HUF_SUCCESS)
+				goto out_free;
+		}
+		line = eol + 1;
+	}
+
+out_free:
+	free(buf);
+	io_close_in(&in);
+
+	return r;
+}
+
+/*
+ * Lists the members: the regular files of the directory src, sorted by
+ * name, or the paths on the lines of the file src, "-" being the standard
+ * input. The list is freed with batch_list_free.
+ */
+enum huf_result batch_list(const char *src, char ***paths, int *count)
+{
+	struct stat st;
+	enum huf_result r;
+	int mem = 0;
+
+	*paths = NULL;
+	*count = 0;
+	if (strcmp(src, "-") != 0 && stat(src, &st) == 0 &&
+			S_ISDIR(st.st_mode))
+		r = list_dir(src, paths, count, &mem);
+	else
+		r = list_file(src, paths, count, &mem);
+
+	if (r != HUF_SUCCESS) {
+		batch_list_free(*paths, *count);
+		*paths = NULL;
+		*count = 0;
+	}
+
+	return r;
+}
+
+/* Frees a list of members */
+void batch_list_free(char **paths, int count)
+{
+	int i;
+
+	if (paths == NULL)
+		return;
+
+	for (i = 0; i < count; i++)
+		free(paths[i]);
+	free(paths);
+}
+
+/* Creates the output directory, if it isn't there already */
+static enum huf_result make_dir(const char *dir)
+{
+	if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+		return HUF_ERROR_FILE_ACCESS;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Sets the output of the slot to dir/name followed by suffix, only naming
+ * the member when tested
+ */
+static enum huf_result set_out_path(struct member_slot *s, const char *dir,
+		const char *name, size_t n, const char *suffix)
+{
+	int k;
+
+	if (s->b->test)
+		k = snprintf(s->out_path, PATH_MAX, "%.*s", (int) n, name);
+	else
+		k = snprintf(s->out_path, PATH_MAX, "%s/%.*s%s", dir, (int) n,
+				name, suffix);
+	if (k < 0 || k >= PATH_MAX)
+		return HUF_ERROR_INVALID_PARAMETER;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Compresses the n chars at src into a whole frame in the comp buffer of
+ * the slot, which only grows
+ */
+static enum huf_result compress_member(struct member_slot *s,
+		const uint8_t *src, uint64_t n)
+{
+	const struct batch *b = s->b;
+	struct block_chain chain;
+	struct frame_header fh;
+	struct block_header bh;
+	enum huf_result r;
+	uint8_t *tmp;
+	uint64_t bound, seq;
+	size_t pos, size;
+	uint32_t k;
+
+	bound = FRAME_HEADER_SIZE + 1;
+	if (b->bp->split)
+		bound += n / b->block_size * split_bound(b->block_size) +
+			split_bound(n % b->block_size);
+	else
+		bound += n / b->block_size * block_bound(b->block_size) +
+			block_bound(n % b->block_size);
+	if (bound > SIZE_MAX)
+		return HUF_ERROR_MEMORY_ALLOC;
+	if (bound > s->comp_mem) {
+		tmp = (uint8_t *) huf_realloc(s->comp, bound * sizeof(uint8_t));
+		if (tmp == NULL)
+			return HUF_ERROR_MEMORY_ALLOC;
+		s->comp = tmp;
+		s->comp_mem = bound;
+	}
+
+	fh.version = FRAME_VERSION;
+	fh.flags = FRAME_CONTENT_SIZE;
+	fh.block_size = b->block_size;
+	fh.content_size = n;
+	frame_put_header(s->comp, &fh);
+	pos = FRAME_HEADER_SIZE;
+
+	block_chain_init(&chain);
+	r = HUF_SUCCESS;
+	for (seq = 0; n > 0; seq++) {
+		k = n < b->block_size ? n : b->block_size;
+		r = block_compress(src, k, b->bp, &chain, seq, &s->comp[pos],
+				&size);
+		if (r != HUF_SUCCESS)
+			break;
+		pos += size;
+		src += k;
+		n -= k;
+	}
+	block_chain_destroy(&chain);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	bh.type = BLOCK_END;
+	pos += frame_put_block(&s->comp[pos], &bh);
+	s->comp_size = pos;
+
+	return HUF_SUCCESS;
+}
+
+/* Compresses a member, writing it out unless it goes to the archive */
+static void compress_job(void *arg)
+{
+	struct member_slot *s = (struct member_slot *) arg;
+	struct huf_stats *stats = s->b->bp->stats;
+	struct huf_input in = {.fd = -1};
+	struct huf_output out = {.fd = -1};
+	enum huf_result r;
+	const uint8_t *text;
+	uint8_t *buf = NULL;
+	uint64_t size;
+
+	r = io_open_in(&in, s->path);
+	if (r != HUF_SUCCESS)
+		goto out;
+	in.stats = stats;
+	r = io_read_all(&in, &text, &size, &buf);
+	if (r == HUF_SUCCESS)
+		r = compress_member(s, text, size);
+	free(buf);
+	io_close_in(&in);
+	if (r != HUF_SUCCESS)
+		goto out;
+	s->in_bytes = size;
+	s->out_bytes = s->comp_size;
+	if (s->out_path[0] == '\0')
+		goto out;
+
+	r = io_open_out(&out, s->out_path);
+	if (r != HUF_SUCCESS)
+		goto out;
+	out.stats = stats;
+	r = io_write(&out, s->comp, s->comp_size);
+	if (r == HUF_SUCCESS)
+		r = io_close_out(&out);
+	else
+		io_close_out(&out);
+
+out:
+	s->r = r;
+}
+
+/*
+ * Decompresses the frame in the n bytes at src to out, a block at a time
+ * with the decoder of the slot and its text buffer, which only grows
+ */
+static enum huf_result decompress_member(struct member_slot *s,
+		const uint8_t *src, uint64_t n, struct frame_header *fh,
+		struct huf_output *out)
+{
+	struct huf_stats *stats = s->b->bp->stats;
+	struct block_table table;
+	struct block_header bh;
+	struct index_footer ft;
+	enum huf_result r;
+	uint8_t *dst;
+	uint64_t pos, total;
+
+	if (fh->block_size > MAX_BLOCK_SIZE)
+		return HUF_ERROR_INVALID_RESOURCE;
+	if (s->dec == NULL) {
+		s->dec = (struct block_decoder *) huf_malloc(
+				sizeof(struct block_decoder));
+		if (s->dec == NULL)
+			return HUF_ERROR_MEMORY_ALLOC;
+	}
+	if (fh->flags & FRAME_CONTENT_SIZE) {
+		r = io_reserve(out, fh->content_size);
+		if (r != HUF_SUCCESS)
+			return r;
+	}
+	if (out->map == NULL && fh->block_size > s->text_mem) {
+		free(s->text);
+		s->text_mem = 0;
+		s->text = (uint8_t *) huf_malloc(fh->block_size *
+				sizeof(uint8_t));
+		if (s->text == NULL)
+			return HUF_ERROR_MEMORY_ALLOC;
+		s->text_mem = fh->block_size;
+	}
+
+	/* The table ids start again with every frame */
+	s->dec->id = 0;
+	table.id = 0;
+	pos = FRAME_HEADER_SIZE;
+	total = 0;
+	while (1) {
+		if (pos == n)
+			return HUF_ERROR_END_OF_FILE;
+		if (src[pos] == BLOCK_END) {
+			pos++;
+			break;
+		}
+
+		if (n - pos < BLOCK_HEADER_SIZE)
+			return HUF_ERROR_END_OF_FILE;
+		r = frame_get_block(&src[pos], &bh);
+		if (r == HUF_SUCCESS)
+			r = block_check(fh, &bh);
+		if (r != HUF_SUCCESS)
+			return r;
+		pos += BLOCK_HEADER_SIZE;
+		if (n - pos < bh.comp_size)
+			return HUF_ERROR_END_OF_FILE;
+
+		/* The blocks can't go past the reserved output */
+		dst = s->text;
+		if (out->map != NULL) {
+			dst = io_reserved(out, bh.raw_size);
+			if (dst == NULL)
+				return HUF_ERROR_INVALID_RESOURCE;
+		}
+		r = block_table_update(&table, &bh, &src[pos]);
+		if (r == HUF_SUCCESS)
+			r = block_decompress(&bh, &src[pos], dst, s->dec,
+					&table, stats);
+		if (r == HUF_SUCCESS && dst == s->text)
+			r = io_write(out, s->text, bh.raw_size);
+		if (r != HUF_SUCCESS)
+			return r;
+		pos += bh.comp_size;
+		total += bh.raw_size;
+	}
+
+	/* The index holds an entry per block */
+	if (fh->flags & FRAME_INDEX) {
+		if (n - pos < INDEX_FOOTER_SIZE ||
+				frame_get_footer(&src[n - INDEX_FOOTER_SIZE],
+					&ft) != HUF_SUCCESS ||
+				ft.raw_size != total || ft.blocks !=
+				(n - pos - INDEX_FOOTER_SIZE) / INDEX_ENTRY_SIZE)
+			return HUF_ERROR_INVALID_RESOURCE;
+		pos += ft.blocks * INDEX_ENTRY_SIZE + INDEX_FOOTER_SIZE;
+	}
+
+	if (pos != n || ((fh->flags & FRAME_CONTENT_SIZE) &&
+				total != fh->content_size))
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	return HUF_SUCCESS;
+}
+
+/* Decompresses a file, or the frame of an archive member */
+static void decompress_job(void *arg)
+{
+	struct member_slot *s = (struct member_slot *) arg;
+	struct huf_stats *stats = s->b->bp->stats;
+	struct huf_input in = {.fd = -1}, *ip = &s->view;
+	struct huf_output out = {.fd = -1};
+	struct huf_input mem;
+	struct frame_header fh;
+	enum huf_result r, rc;
+	const uint8_t *data;
+	uint8_t *buf = NULL;
+	uint64_t size;
+
+	if (s->path != NULL) {
+		r = io_open_in(&in, s->path);
+		if (r != HUF_SUCCESS)
+			goto out;
+		ip = &in;
+	}
+	ip->stats = stats;
+
+	/* Members being tested have no output */
+	if (s->b->test) {
+		io_open_null(&out);
+	} else {
+		r = io_open_out(&out, s->out_path);
+		if (r != HUF_SUCCESS)
+			goto out_close;
+	}
+	out.stats = stats;
+	r = io_read_all(ip, &data, &size, &buf);
+	if (r != HUF_SUCCESS) {
+		io_close_out(&out);
+		goto out_close;
+	}
+
+	/* Adaptive frames and the original format are left to stream.c */
+	if (size >= FRAME_HEADER_SIZE &&
+			frame_get_header(data, &fh) == HUF_SUCCESS &&
+			!(fh.flags & FRAME_ADAPTIVE)) {
+		r = decompress_member(s, data, size, &fh, &out);
+	} else {
+		io_open_mem(&mem, data, size);
+		mem.stats = stats;
+		r = decompress_file(&mem, &out, NULL, 1, stats);
+	}
+	free(buf);
+	s->in_bytes = size;
+	s->out_bytes = out.pos;
+	rc = io_close_out(&out);
+	if (r == HUF_SUCCESS)
+		r = rc;
+
+out_close:
+	if (s->path != NULL)
+		io_close_in(&in);
+out:
+	s->r = r;
+}
+
+/*
+ * Runs the count members through the pool, run->prepare setting up the
+ * slot of a member before its job is queued, and run->finish, if any,
+ * taking the results in order
+ */
+static enum huf_result run_members(struct batch_run *run, int count,
+		void (*fn)(void *))
+{
+	struct batch *b = run->b;
+	struct member_slot *slots, *s;
+	struct pool *pool = NULL;
+	enum huf_result r;
+	int nslots, next_read, next_write, i;
+
+	b->in_bytes = 0;
+	b->out_bytes = 0;
+
+	nslots = b->nthreads > 1 ? MEMBERS_PER_THREAD * b->nthreads : 1;
+	slots = (struct member_slot *) huf_calloc(nslots,
+			sizeof(struct member_slot));
+	if (slots == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+	for (i = 0; i < nslots; i++) {
+		slots[i].job.fn = fn;
+		slots[i].job.arg = &slots[i];
+		slots[i].b = b;
+	}
+
+	r = pool_init(&pool, b->nthreads);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	next_read = 0;
+	next_write = 0;
+	while (next_write < count) {
+		/* Handing members to the workers while there are free slots */
+		while (next_read < count && next_read - next_write < nslots) {
+			s = &slots[next_read % nslots];
+			r = run->prepare(run, s, next_read);
+			if (r != HUF_SUCCESS)
+				goto out_free;
+			pool_submit(pool, &s->job);
+			next_read++;
+		}
+
+		/* Taking the oldest one, so the archive keeps the list order */
+		s = &slots[next_write % nslots];
+		pool_wait(pool, &s->job);
+		r = s->r;
+		if (r == HUF_SUCCESS && run->finish != NULL)
+			r = run->finish(run, s, next_write);
+		if (r != HUF_SUCCESS) {
+			fprintf(stderr, "[ ERROR ] In %s:\n", s->path != NULL ?
+					s->path : s->out_path);
+			goto out_free;
+		}
+		b->in_bytes += s->in_bytes;
+		b->out_bytes += s->out_bytes;
+		next_write++;
+	}
+
+out_free:
+	/* The queued members are done once the pool is gone */
+	if (pool_destroy(&pool) != HUF_SUCCESS && r == HUF_SUCCESS)
+		r = HUF_ERROR_UNKNOWN_ERROR;
+	for (i = 0; i < nslots; i++) {
+		free(slots[i].comp);
+		free(slots[i].dec);
+		free(slots[i].text);
+	}
+	free(slots);
+
+	return r;
+}
+
+static enum huf_result prepare_compress(struct batch_run *run,
+		struct member_slot *s, int i)
+{
+	const char *name = base_name(run->paths[i]);
+
+	s->path = run->paths[i];
+	return set_out_path(s, run->dir, name, strlen(name), BATCH_SUFFIX);
+}
+
+static enum huf_result prepare_decompress(struct batch_run *run,
+		struct member_slot *s, int i)
+{
+	const char *name = base_name(run->paths[i]);
+	size_t n = strlen(name), k = strlen(BATCH_SUFFIX);
+
+	/* Names without the suffix are kept whole, the output needs one */
+	s->path = run->paths[i];
+	if (n > k && strcmp(&name[n - k], BATCH_SUFFIX) == 0)
+		return set_out_path(s, run->dir, name, n - k, "");
+	return set_out_path(s, run->dir, name, n, ".out");
+}
+
+/* Compresses every member to dir, adding BATCH_SUFFIX to its name */
+enum huf_result batch_compress(char **paths, int count, const char *dir,
+		struct batch *b)
+{
+	struct batch_run run = {.b = b, .paths = paths, .dir = dir};
+	enum huf_result r;
+
+	r = make_dir(dir);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	run.prepare = prepare_compress;
+	return run_members(&run, count, compress_job);
+}
+
+/* Decompresses every member to dir, dropping BATCH_SUFFIX from its name */
+enum huf_result batch_decompress(char **paths, int count, const char *dir,
+		struct batch *b)
+{
+	struct batch_run run = {.b = b, .paths = paths, .dir = dir};
+	enum huf_result r;
+
+	r = b->test ? HUF_SUCCESS : make_dir(dir);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	run.prepare = prepare_decompress;
+	return run_members(&run, count, decompress_job);
+}
+
+static enum huf_result prepare_member(struct batch_run *run,
+		struct member_slot *s, int i)
+{
+	s->path = run->paths[i];
+	s->out_path[0] = '\0';
+
+	return HUF_SUCCESS;
+}
+
+/* Appends the frame of the member to the archive */
+static enum huf_result finish_member(struct batch_run *run,
+		struct member_slot *s, int i)
+{
+	struct archive_entry *e = &run->entries[i];
+
+	e->offset = run->out->pos - run->start;
+	e->comp_size = s->comp_size;
+	e->raw_size = s->in_bytes;
+
+	return io_write(run->out, s->comp, s->comp_size);
+}
+
+/* Writes the index and the footer after the last frame */
+static enum huf_result write_index(struct batch_run *run, int count)
+{
+	uint8_t buf[ARCHIVE_ENTRY_SIZE];
+	struct archive_entry *e;
+	enum huf_result r;
+	uint64_t index_offset;
+	int i;
+
+	index_offset = run->out->pos - run->start;
+	for (i = 0; i < count; i++) {
+		e = &run->entries[i];
+		put_le64(&buf[0], e->offset);
+		put_le64(&buf[8], e->comp_size);
+		put_le64(&buf[16], e->raw_size);
+		put_le16(&buf[24], e->name_len);
+		r = io_write(run->out, buf, ARCHIVE_ENTRY_SIZE);
+		if (r == HUF_SUCCESS)
+			r = io_write(run->out, e->name, e->name_len);
+		if (r != HUF_SUCCESS)
+			return r;
+	}
+
+	put_le64(&buf[0], index_offset);
+	put_le64(&buf[8], count);
+	r = io_write(run->out, buf, 16);
+	if (r == HUF_SUCCESS)
+		r = io_write(run->out, HUF_ARCHIVE_INDEX_MAGIC,
+				HUF_ARCHIVE_MAGIC_SIZE);
+
+	return r;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+	const struct archive_entry *ea = *(const struct archive_entry * const *) a;
+	const struct archive_entry *eb = *(const struct archive_entry * const *) b;
+	int c;
+
+	c = memcmp(ea->name, eb->name, ea->name_len < eb->name_len ?
+			ea->name_len : eb->name_len);
+
+	return c != 0 ? c : (int) ea->name_len - (int) eb->name_len;
+}
+
+/* Names the entries after the members, refusing the same name twice */
+static enum huf_result name_entries(struct archive_entry *entries,
+		char **paths, int count)
+{
+	struct archive_entry **sorted;
+	enum huf_result r = HUF_SUCCESS;
+	size_t n;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		entries[i].name = base_name(paths[i]);
+		n = strlen(entries[i].name);
+		if (!valid_name(entries[i].name, n) || n > UINT16_MAX)
+			return HUF_ERROR_INVALID_PARAMETER;
+		entries[i].name_len = n;
+	}
+
+	sorted = (struct archive_entry **) huf_malloc(count *
+			sizeof(struct archive_entry *));
+	if (sorted == NULL && count > 0)
+		return HUF_ERROR_MEMORY_ALLOC;
+	for (i = 0; i < count; i++)
+		sorted[i] = &entries[i];
+	if (count > 1)
+		qsort(sorted, count, sizeof(struct archive_entry *),
+				compare_entries);
+	for (i = 1; i < count; i++)
+		if (compare_entries(&sorted[i - 1], &sorted[i]) == 0)
+			r = HUF_ERROR_INVALID_PARAMETER;
+	free(sorted);
+
+	return r;
+}
+
+/* Writes the archive of the members */
+enum huf_result archive_create(char **paths, int count,
+		struct huf_output *out, struct batch *b)
+{
+	struct batch_run run = {.b = b, .paths = paths, .out = out};
+	enum huf_result r;
+
+	run.entries = (struct archive_entry *) huf_malloc(count *
+			sizeof(struct archive_entry));
+	if (run.entries == NULL && count > 0)
+		return HUF_ERROR_MEMORY_ALLOC;
+	r = name_entries(run.entries, paths, count);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	run.start = out->pos;
+	r = io_write(out, HUF_ARCHIVE_MAGIC, HUF_ARCHIVE_MAGIC_SIZE);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	run.prepare = prepare_member;
+	run.finish = finish_member;
+	r = run_members(&run, count, compress_job);
+	if (r == HUF_SUCCESS)
+		r = write_index(&run, count);
+	b->out_bytes = out->pos - run.start;
+
+out_free:
+	free(run.entries);
+
+	return r;
+}
+
+/* Reads the index of the archive in the size bytes at data */
+static enum huf_result read_index(const uint8_t *data, uint64_t size,
+		struct archive_entry **entries, int *count)
+{
+	struct archive_entry *e;
+	const uint8_t *footer;
+	uint64_t index_offset, members, pos, end;
+	int i;
+
+	*entries = NULL;
+	*count = 0;
+	if (size < HUF_ARCHIVE_MAGIC_SIZE + ARCHIVE_FOOTER_SIZE ||
+			memcmp(data, HUF_ARCHIVE_MAGIC,
+				HUF_ARCHIVE_MAGIC_SIZE) != 0)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	footer = &data[size - ARCHIVE_FOOTER_SIZE];
+	if (memcmp(&footer[16], HUF_ARCHIVE_INDEX_MAGIC,
+				HUF_ARCHIVE_MAGIC_SIZE) != 0)
+		return HUF_ERROR_INVALID_RESOURCE;
+	index_offset = get_le64(&footer[0]);
+	members = get_le64(&footer[8]);
+	end = size - ARCHIVE_FOOTER_SIZE;
+	if (index_offset < HUF_ARCHIVE_MAGIC_SIZE || index_offset > end ||
+			members > (end - index_offset) / ARCHIVE_ENTRY_SIZE ||
+			members > INT_MAX)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	*entries = (struct archive_entry *) huf_malloc(members *
+			sizeof(struct archive_entry));
+	if (*entries == NULL && members > 0)
+		return HUF_ERROR_MEMORY_ALLOC;
+
+	pos = index_offset;
+	for (i = 0; i < (int) members; i++) {
+		e = &(*entries)[i];
+		if (end - pos < ARCHIVE_ENTRY_SIZE)
+			goto out_invalid;
+		e->offset = get_le64(&data[pos]);
+		e->comp_size = get_le64(&data[pos + 8]);
+		e->raw_size = get_le64(&data[pos + 16]);
+		e->name_len = get_le16(&data[pos + 24]);
+		pos += ARCHIVE_ENTRY_SIZE;
+		if (e->name_len > end - pos)
+			goto out_invalid;
+		e->name = (const char *) &data[pos];
+		pos += e->name_len;
+
+		/* The frames lie between the magic and the index */
+		if (!valid_name(e->name, e->name_len) ||
+				e->offset < HUF_ARCHIVE_MAGIC_SIZE ||
+				e->offset > index_offset ||
+				e->comp_size > index_offset - e->offset)
+			goto out_invalid;
+	}
+	*count = members;
+
+	return HUF_SUCCESS;
+
+out_invalid:
+	free(*entries);
+	*entries = NULL;
+
+	return HUF_ERROR_INVALID_RESOURCE;
+}
+
+static enum huf_result prepare_extract(struct batch_run *run,
+		struct member_slot *s, int i)
+{
+	struct archive_entry *e = &run->entries[i];
+
+	s->path = NULL;
+	io_open_mem(&s->view, &run->archive[e->offset], e->comp_size);
+
+	return set_out_path(s, run->dir, e->name, e->name_len, "");
+}
+
+/* Extracts every member of the archive to dir */
+enum huf_result archive_extract(struct huf_input *in, const char *dir,
+		struct batch *b)
+{
+	struct batch_run run = {.b = b, .dir = dir};
+	enum huf_result r;
+	uint8_t *buf = NULL;
+	uint64_t size;
+	int count;
+
+	/* The index is at the end, streams are read whole */
+	r = io_read_all(in, &run.archive, &size, &buf);
+	if (r != HUF_SUCCESS)
+		return r;
+	r = read_index(run.archive, size, &run.entries, &count);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+	r = b->test ? HUF_SUCCESS : make_dir(dir);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	run.prepare = prepare_extract;
+	r = run_members(&run, count, decompress_job);
+
+out_free:
+	free(run.entries);
+	free(buf);
+
+	return r;
+}
+
+/* Extracts the member called name to out */
+enum huf_result archive_extract_member(struct huf_input *in,
+		struct huf_output *out, const char *name, struct batch *b)
+{
+	struct archive_entry *entries = NULL, *e = NULL;
+	struct huf_input view;
+	enum huf_result r;
+	const uint8_t *data;
+	uint8_t *buf = NULL;
+	uint64_t size, start;
+	size_t n;
+	int count, i;
+
+	r = io_read_all(in, &data, &size, &buf);
+	if (r != HUF_SUCCESS)
+		return r;
+	r = read_index(data, size, &entries, &count);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	n = strlen(name);
+	for (i = 0; i < count && e == NULL; i++)
+		if (entries[i].name_len == n &&
+				memcmp(entries[i].name, name, n) == 0)
+			e = &entries[i];
+	if (e == NULL) {
+		r = HUF_ERROR_INVALID_RESOURCE;
+		goto out_free;
+	}
+
+	/* A single member gets all the threads */
+	io_open_mem(&view, &data[e->offset], e->comp_size);
+	view.stats = b->bp->stats;
+	start = out->pos;
+	r = decompress_file(&view, out, NULL, b->nthreads, b->bp->stats);
+	b->in_bytes = view.pos;
+	b->out_bytes = out->pos - start;
+
+out_free:
+	free(entries);
+	free(buf);
+
+	return r;
+}
@@ -0,0 +1,76 @@
+/*
+ * Many files per run. The members, the files of a directory or those named
+ * by a list, are processed by a pool of worker threads, a few at a time per
+ * worker, either to an output file each or into a single archive. Every slot
+ * keeps its buffers from one member to the next, so small files cost no
+ * allocations once the slots have grown.
+ *
+ * An archive holds the members as frames, each written as compress_frame
+ * would, followed by an index naming them, so one can be extracted without
+ * going through the others.
+ *
+ *	magic		HUF_ARCHIVE_MAGIC
+ *	frames		one per member, in the order of the index
+ *	index		an entry per member
+ *	footer		index offset, members, HUF_ARCHIVE_INDEX_MAGIC
+ *
+ * An entry holds the archive offset of the frame, its size, the size of the
+ * member, then the length of its name on 16 bits and the name, which is the
+ * last part of the path it was read from. Two members can't have the same
+ * name. The integers are stored little endian.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "common.h"
+#include "io.h"
+#include "block.h"
+
+#define HUF_ARCHIVE_MAGIC	"\x89HUFARC\n"
+#define HUF_ARCHIVE_INDEX_MAGIC	"\x89HUFAIX\n"
+#define HUF_ARCHIVE_MAGIC_SIZE	(8)
+#define ARCHIVE_ENTRY_SIZE	(26)	/* without the name */
+#define ARCHIVE_FOOTER_SIZE	(24)
+#define BATCH_SUFFIX		".huf"
+
+struct batch {
+	uint32_t block_size;
+	const struct block_params *bp;	/* the stats come with it */
+	int nthreads;			/* members processed at once */
+	int test;			/* decoded and checked, not written */
+	uint64_t in_bytes;		/* of all the members, once done */
+	uint64_t out_bytes;
+};
+
+/*
+ * Lists the members: the regular files of the directory src, sorted by
+ * name, or the paths on the lines of the file src, "-" being the standard
+ * input. The list is freed with batch_list_free.
+ */
+enum huf_result batch_list(const char *src, char ***paths, int *count);
+
+/* Frees a list of members */
+void batch_list_free(char **paths, int count);
+
+/* Compresses every member to dir, adding BATCH_SUFFIX to its name */
+enum huf_result batch_compress(char **paths, int count, const char *dir,
+		struct batch *b);
+
+/* Decompresses every member to dir, dropping BATCH_SUFFIX from its name */
+enum huf_result batch_decompress(char **paths, int count, const char *dir,
+		struct batch *b);
+
+/* Writes the archive of the members */
+enum huf_result archive_create(char **paths, int count,
+		struct huf_output *out, struct batch *b);
+
+/* Extracts every member of the archive to dir */
+enum huf_result archive_extract(struct huf_input *in, const char *dir,
+		struct batch *b);
+
+/* Extracts the member called name to out */
+enum huf_result archive_extract_member(struct huf_input *in,
+		struct huf_output *out, const char *name, struct batch *b);
+
+#endif	/* #ifndef BATCH_H */
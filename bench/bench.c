@@ -0,0 +1,621 @@
+/*
+ * Throughput of every compression stage on the synthetic texts. The text is
+ * generated and processed one block at a time, as the program does, so texts
+ * of several GiB need no more memory than a block. Every stage runs over at
+ * least BENCH_MIN_BYTES chars at a time and the fastest of the repetitions is
+ * kept.
+ *
+ * The results are written as JSON, one line per text, and can be compared
+ * against a previous run: the stages that got slower by more than the
+ * tolerance, or texts that compress worse, are reported and make the exit
+ * status non zero.
+ */
+
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "block.h"
+#include "canon.h"
+#include "encode.h"
+#include "hist.h"
+#include "corpus.h"
+
+#define BENCH_MIN_BYTES		(1 << 20)	/* chars per timed run */
+#define BENCH_REPS		(5)
+#define BENCH_TOLERANCE		(10)		/* slowdown percent still accepted */
+#define BENCH_SIZES		"1K,64K,1M,16M"
+#define BENCH_OUTPUT		"bench/results.json"
+#define MAX_SIZES		(16)
+#define LINE_SIZE		(1024)
+
+#define CHECK_RESULT(r)						\
+	do { 							\
+		if ((r) != HUF_SUCCESS) {			\
+			huf_print_result((r));			\
+			exit((r));				\
+		}						\
+	} while (0)
+
+enum bench_stage {
+	STAGE_HIST,			/* char counts */
+	STAGE_TREE,			/* code lengths */
+	STAGE_CODES,			/* canonical codes, serialized lengths */
+	STAGE_ENCODE,			/* bit streams */
+	STAGE_DECODE,			/* decoder table, bit streams */
+	STAGE_COMPRESS,			/* block_compress, all of the above */
+	STAGE_DECOMPRESS,		/* block_decompress */
+	STAGES,
+};
+
+static const char *const stage_names[STAGES] = {
+	"hist", "tree", "codes", "encode", "decode", "compress", "decompress",
+};
+
+/* Everything a stage works on, the output of the stage before */
+struct bench_block {
+	const struct block_params *bp;
+	const uint8_t *src;
+	uint32_t n;
+	uint32_t freq[ASCII_SIZE];
+	uint8_t lens[ASCII_SIZE];
+	struct huf_code codes[ASCII_SIZE];
+	uint8_t table[CANON_TABLE_MAX];
+	struct huf_node tree[2 * ASCII_SIZE - 1];
+	uint16_t tree_size;
+	struct bit_reader br[MAX_STREAMS];
+	const uint8_t *stream[MAX_STREAMS];
+	size_t stream_size[MAX_STREAMS];
+	uint8_t *comp;			/* bit streams, then the whole block */
+	size_t comp_size;
+	uint8_t *dst;
+	struct block_decoder *dec;
+};
+
+struct bench_result {
+	enum corpus_kind kind;
+	uint64_t size;
+	uint64_t comp_size;
+	double ns[STAGES];		/* over the whole text */
+};
+
+/* Parses a size in bytes, with an optional K, M or G suffix */
+static enum huf_result parse_size(const char *str, uint64_t *size)
+{
+	unsigned long long v;
+	char *end;
+
+	v = strtoull(str, &end, 10);
+	if (end == str || v == 0)
+		return HUF_ERROR_INVALID_ARGUMENTS;
+
+	if (*end == 'k' || *end == 'K')
+		v <<= 10;
+	else if (*end == 'm' || *end == 'M')
+		v <<= 20;
+	else if (*end == 'g' || *end == 'G')
+		v <<= 30;
+	else if (*end != '\0')
+		return HUF_ERROR_INVALID_ARGUMENTS;
+	if (*end != '\0' && end[1] != '\0')
+		return HUF_ERROR_INVALID_ARGUMENTS;
+	*size = v;
+
+	return HUF_SUCCESS;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Codes the segments of the text into consecutive streams, as block_compress */
+static void encode_streams(struct bench_block *b)
+{
+	struct bit_writer bw;
+	uint8_t *pos = b->comp;
+	size_t seg, first, len;
+	int i;
+
+	seg = (b->n + b->bp->streams - 1) / b->bp->streams;
+	for (i = 0; i < b->bp->streams; i++) {
+		first = (size_t) i * seg < b->n ? (size_t) i * seg : b->n;
+		len = b->n - first < seg ? b->n - first : seg;
+
+		bw_init_mem(&bw, pos, block_bound(b->n));
+		huf_encode(&bw, b->codes, &b->src[first], len);
+		bw_finish(&bw);
+		b->stream[i] = pos;
+		b->stream_size[i] = bw.pos - pos;
+		pos = bw.pos;
+	}
+}
+
+/* Runs the stage once over the block */
+static enum huf_result run_stage(struct bench_block *b, enum bench_stage stage)
+{
+	struct block_header bh;
+	enum huf_result r;
+	int i;
+
+	switch (stage) {
+	case STAGE_HIST:
+		hist_count(b->src, b->n, b->freq);
+		return HUF_SUCCESS;
+
+	case STAGE_TREE:
+		return canon_lengths(b->freq, b->bp->max_len, b->lens);
+
+	case STAGE_CODES:
+		canon_codes(b->lens, b->codes);
+		canon_write(b->lens, b->table);
+		return HUF_SUCCESS;
+
+	case STAGE_ENCODE:
+		encode_streams(b);
+		return HUF_SUCCESS;
+
+	case STAGE_DECODE:
+		r = huf_decoder_init(b->dec->dec, b->tree, b->tree_size);
+		if (r != HUF_SUCCESS)
+			return r;
+		for (i = 0; i < b->bp->streams; i++)
+			br_init_mem(&b->br[i], b->stream[i], b->stream_size[i]);
+		return huf_decode_streams(b->dec->dec, b->br, b->bp->streams,
+				b->dst, b->n);
+
+	case STAGE_COMPRESS:
+		return block_compress(b->src, b->n, b->bp, NULL, 0, b->comp,
+				&b->comp_size);
+
+	case STAGE_DECOMPRESS:
+		r = frame_get_block(b->comp, &bh);
+		if (r != HUF_SUCCESS)
+			return r;
+		return block_decompress(&bh, &b->comp[BLOCK_HEADER_SIZE],
+				b->dst, b->dec, NULL, NULL);
+
+	default:
+		return HUF_ERROR_INVALID_PARAMETER;
+	}
+}
+
+/*
+ * Times every stage on the block, in order, adding the fastest of reps runs
+ * to res. The decoded text is checked against the original.
+ */
+static enum huf_result bench_block(struct bench_block *b, int reps,
+		struct bench_result *res)
+{
+	enum huf_result r;
+	uint64_t start, t, best;
+	uint32_t iters, k;
+	int stage, i;
+
+	iters = BENCH_MIN_BYTES / b->n > 0 ? BENCH_MIN_BYTES / b->n : 1;
+
+	for (stage = 0; stage < STAGES; stage++) {
+		best = UINT64_MAX;
+		for (i = 0; i < reps; i++) {
+			start = now_ns();
+			for (k = 0; k < iters; k++) {
+				r = run_stage(b, (enum bench_stage) stage);
+				if (r != HUF_SUCCESS)
+					return r;
+			}
+			t = now_ns() - start;
+			if (t < best)
+				best = t;
+		}
+		res->ns[stage] += (double) best / iters;
+
+		/* The tree for the decoder, between the two stages using it */
+		if (stage == STAGE_CODES) {
+			r = canon_tree(b->lens, b->tree, &b->tree_size);
+			if (r != HUF_SUCCESS)
+				return r;
+		}
+		if ((stage == STAGE_DECODE || stage == STAGE_DECOMPRESS) &&
+				memcmp(b->dst, b->src, b->n) != 0)
+			return HUF_ERROR_UNKNOWN_ERROR;
+	}
+	res->comp_size += b->comp_size;
+
+	return HUF_SUCCESS;
+}
+
+/* Generates the text of the kind and size and times it a block at a time */
+static enum huf_result bench_text(enum corpus_kind kind, uint64_t size,
+		const struct block_params *bp, int reps, struct bench_result *res)
+{
+	struct bench_block b;
+	struct corpus *c;
+	uint8_t *text = NULL;
+	enum huf_result r = HUF_ERROR_MEMORY_ALLOC;
+	uint64_t left;
+	uint32_t n;
+
+	memset(res, 0, sizeof(struct bench_result));
+	res->kind = kind;
+	res->size = size;
+
+	memset(&b, 0, sizeof(struct bench_block));
+	b.bp = bp;
+	n = size < DEFAULT_BLOCK_SIZE ? size : DEFAULT_BLOCK_SIZE;
+	c = (struct corpus *) malloc(sizeof(struct corpus));
+	text = (uint8_t *) malloc(n * sizeof(uint8_t));
+	b.comp = (uint8_t *) malloc(block_bound(n) * sizeof(uint8_t));
+	b.dst = (uint8_t *) malloc(n * sizeof(uint8_t));
+	b.dec = (struct block_decoder *) malloc(sizeof(struct block_decoder));
+	if (c == NULL || text == NULL || b.comp == NULL || b.dst == NULL ||
+			b.dec == NULL)
+		goto out_free;
+	b.src = text;
+
+	corpus_init(c, kind, 1);
+	for (left = size; left > 0; left -= b.n) {
+		b.n = left < n ? left : n;
+		corpus_fill(c, text, b.n);
+		r = bench_block(&b, reps, res);
+		if (r != HUF_SUCCESS)
+			goto out_free;
+	}
+	r = HUF_SUCCESS;
+
+out_free:
+	free(c);
+	free(text);
+	free(b.comp);
+	free(b.dst);
+	free(b.dec);
+
+	return r;
+}
+
+static inline double mb_per_s(const struct bench_result *res, int stage)
+{
+	return res->ns[stage] > 0 ? res->size * 1000.0 / res->ns[stage] : 0;
+}
+
+/* Writes the results as JSON, one line per text */
+static enum huf_result write_results(const char *path,
+		const struct block_params *bp, struct bench_result *res,
+		int nres)
+{
+	FILE *f;
+	int i, stage;
+
+	f = fopen(path, "w");
+	if (f == NULL)
+		return HUF_ERROR_FILE_ACCESS;
+
+	fprintf(f, "{\n\"block_size\": %d, \"max_len\": %d, \"streams\": %d, "
+			"\"tables\": %d,\n\"results\": [\n",
+			DEFAULT_BLOCK_SIZE, bp->max_len, bp->streams,
+			bp->tables);
+	for (i = 0; i < nres; i++) {
+		fprintf(f, "{\"corpus\": \"%s\", \"size\": %" PRIu64
+				", \"ratio\": %.6f, \"ns_per_byte\": {",
+				corpus_name(res[i].kind), res[i].size,
+				(double) res[i].comp_size / res[i].size);
+		for (stage = 0; stage < STAGES; stage++)
+			fprintf(f, "%s\"%s\": %.4f", stage ? ", " : "",
+					stage_names[stage],
+					res[i].ns[stage] / res[i].size);
+		fprintf(f, "}, \"mb_per_s\": {");
+		for (stage = 0; stage < STAGES; stage++)
+			fprintf(f, "%s\"%s\": %.1f", stage ? ", " : "",
+					stage_names[stage],
+					mb_per_s(&res[i], stage));
+		fprintf(f, "}}%s\n", i < nres - 1 ? "," : "");
+	}
+	fprintf(f, "]\n}\n");
+
+	if (fclose(f) != 0)
+		return HUF_ERROR_FILE_ACCESS;
+
+	return HUF_SUCCESS;
+}
+
+/* Reads the number following "key": in line, after the first mark if any */
+static int find_value(const char *line, const char *mark, const char *key,
+		double *v)
+{
+	char pattern[64];
+	const char *p = line;
+
+	if (mark != NULL && (p = strstr(line, mark)) == NULL)
+		return 0;
+	snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+	p = strstr(p, pattern);
+	if (p == NULL)
+		return 0;
+	*v = strtod(p + strlen(pattern), NULL);
+
+	return 1;
+}
+
+/*
+ * Finds the result for the same text in the baseline file written by
+ * write_results, returns 0 if there is none
+ */
+static int find_baseline(FILE *f, const struct bench_result *res,
+		struct bench_result *base)
+{
+	char line[LINE_SIZE], name[32];
+	uint64_t size;
+	double v;
+	int stage;
+
+	rewind(f);
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "{\"corpus\": \"%31[^\"]\", \"size\": %" SCNu64,
+					name, &size) != 2)
+			continue;
+		if (strcmp(name, corpus_name(res->kind)) != 0 ||
+				size != res->size)
+			continue;
+
+		memset(base, 0, sizeof(struct bench_result));
+		base->kind = res->kind;
+		base->size = size;
+		if (!find_value(line, NULL, "ratio", &v))
+			return 0;
+		base->comp_size = v * size + 0.5;
+		for (stage = 0; stage < STAGES; stage++) {
+			if (!find_value(line, "\"ns_per_byte\"",
+						stage_names[stage], &v))
+				return 0;
+			base->ns[stage] = v * size;
+		}
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Prints the throughput of every stage of the texts, in MB/s */
+static void print_results(struct bench_result *res, int nres)
+{
+	int i, stage;
+
+	printf("%-8s %10s %7s", "corpus", "size", "ratio");
+	for (stage = 0; stage < STAGES; stage++)
+		printf(" %10s", stage_names[stage]);
+	printf("\n");
+
+	for (i = 0; i < nres; i++) {
+		printf("%-8s %10" PRIu64 " %7.4f", corpus_name(res[i].kind),
+				res[i].size, (double) res[i].comp_size /
+				res[i].size);
+		for (stage = 0; stage < STAGES; stage++)
+			printf(" %10.1f", mb_per_s(&res[i], stage));
+		printf("\n");
+	}
+	printf("(MB/s)\n");
+}
+
+/*
+ * Prints the change of every stage against the baseline, returns the number
+ * of regressions
+ */
+static int compare_results(const char *path, struct bench_result *res,
+		int nres, int tolerance)
+{
+	struct bench_result base;
+	double change;
+	FILE *f;
+	int regressions = 0, i, stage;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		CHECK_RESULT(HUF_ERROR_FILE_ACCESS);
+
+	printf("\nChange against %s, slower by more than %d%% is flagged:\n",
+			path, tolerance);
+	for (i = 0; i < nres; i++) {
+		if (!find_baseline(f, &res[i], &base)) {
+			printf("%-8s %10" PRIu64 "   not in the baseline\n",
+					corpus_name(res[i].kind), res[i].size);
+			continue;
+		}
+
+		printf("%-8s %10" PRIu64, corpus_name(res[i].kind),
+				res[i].size);
+		if (res[i].comp_size > base.comp_size &&
+				res[i].comp_size - base.comp_size >
+				res[i].size / 10000) {
+			printf("  ratio %.4f -> %.4f (!)",
+					(double) base.comp_size / base.size,
+					(double) res[i].comp_size / res[i].size);
+			regressions++;
+		}
+		for (stage = 0; stage < STAGES; stage++) {
+			/* Positive when the stage got slower */
+			change = (res[i].ns[stage] / base.ns[stage] - 1) * 100;
+			printf("  %s %+.1f%%", stage_names[stage], change);
+			if (change > tolerance) {
+				printf(" (!)");
+				regressions++;
+			}
+		}
+		printf("\n");
+	}
+	fclose(f);
+
+	if (regressions > 0)
+		printf("%d regressions\n", regressions);
+	else
+		printf("No regressions\n");
+
+	return regressions;
+}
+
+/* Writes size chars of the text to the standard output */
+static enum huf_result generate(enum corpus_kind kind, uint64_t size,
+		uint64_t seed)
+{
+	struct corpus *c;
+	uint8_t *buf;
+	enum huf_result r = HUF_SUCCESS;
+	size_t n;
+
+	c = (struct corpus *) malloc(sizeof(struct corpus));
+	buf = (uint8_t *) malloc(DEFAULT_BLOCK_SIZE * sizeof(uint8_t));
+	if (c == NULL || buf == NULL) {
+		r = HUF_ERROR_MEMORY_ALLOC;
+		goto out_free;
+	}
+
+	corpus_init(c, kind, seed);
+	for (; size > 0; size -= n) {
+		n = size < DEFAULT_BLOCK_SIZE ? size : DEFAULT_BLOCK_SIZE;
+		corpus_fill(c, buf, n);
+		if (fwrite(buf, sizeof(uint8_t), n, stdout) != n) {
+			r = HUF_ERROR_FILE_ACCESS;
+			goto out_free;
+		}
+	}
+	if (fflush(stdout) != 0)
+		r = HUF_ERROR_FILE_ACCESS;
+
+out_free:
+	free(c);
+	free(buf);
+
+	return r;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{"sizes",	required_argument,	NULL, 's'},
+		{"kinds",	required_argument,	NULL, 'k'},
+		{"reps",	required_argument,	NULL, 'r'},
+		{"output",	required_argument,	NULL, 'o'},
+		{"compare",	required_argument,	NULL, 'c'},
+		{"tolerance",	required_argument,	NULL, 't'},
+		{"streams",	required_argument,	NULL, 'S'},
+		{"max-len",	required_argument,	NULL, 'L'},
+		{"contexts",	required_argument,	NULL, 'X'},
+		{"generate",	required_argument,	NULL, 'g'},
+		{"seed",	required_argument,	NULL, 'x'},
+		{NULL,		0,			NULL, 0},
+	};
+
+	struct bench_result *res;
+	struct block_params bp;
+	enum corpus_kind kinds[CORPUS_KINDS], gen_kind = CORPUS_UNIFORM;
+	enum huf_result r;
+	uint64_t sizes[MAX_SIZES], seed = 1;
+	char default_sizes[] = BENCH_SIZES;
+	char *list = default_sizes, *kind_list = NULL, *tok;
+	char *output = BENCH_OUTPUT, *baseline = NULL;
+	int nsizes = 0, nkinds = 0, nres = 0, generating = 0;
+	int reps = BENCH_REPS, tolerance = BENCH_TOLERANCE;
+	int c, i, j;
+
+	block_params_init(&bp);
+	while ((c = getopt_long(argc, argv, "s:k:r:o:c:t:S:L:X:g:x:",
+					long_options, NULL)) != -1) {
+		if (c == 's') {
+			list = optarg;
+		} else if (c == 'k') {
+			kind_list = optarg;
+		} else if (c == 'r') {
+			reps = atoi(optarg);
+			if (reps < 1)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+		} else if (c == 'o') {
+			output = optarg;
+		} else if (c == 'c') {
+			baseline = optarg;
+		} else if (c == 't') {
+			tolerance = atoi(optarg);
+			if (tolerance < 0)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+		} else if (c == 'S') {
+			bp.streams = atoi(optarg);
+			if (bp.streams < 1 || bp.streams > MAX_STREAMS ||
+					(bp.streams & (bp.streams - 1)) != 0)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+		} else if (c == 'L') {
+			bp.max_len = atoi(optarg);
+			if (bp.max_len < MIN_CODE_LEN ||
+					bp.max_len > MAX_CODE_LEN)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+		} else if (c == 'X') {
+			bp.tables = atoi(optarg);
+			if (bp.tables < 1 || bp.tables > CTX_MAX_TABLES)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+		} else if (c == 'g') {
+			r = corpus_parse(optarg, &gen_kind);
+			CHECK_RESULT(r);
+			generating = 1;
+		} else if (c == 'x') {
+			seed = strtoull(optarg, NULL, 10);
+		} else {
+			CHECK_RESULT(HUF_ERROR_UNKNOWN_OPTION);
+		}
+	}
+
+	for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		if (nsizes == MAX_SIZES)
+			CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+		r = parse_size(tok, &sizes[nsizes++]);
+		CHECK_RESULT(r);
+	}
+
+	/* Only the first size is generated */
+	if (generating) {
+		r = generate(gen_kind, sizes[0], seed);
+		CHECK_RESULT(r);
+		return EXIT_SUCCESS;
+	}
+
+	if (kind_list == NULL) {
+		for (nkinds = 0; nkinds < CORPUS_KINDS; nkinds++)
+			kinds[nkinds] = (enum corpus_kind) nkinds;
+	} else {
+		for (tok = strtok(kind_list, ","); tok != NULL;
+				tok = strtok(NULL, ",")) {
+			if (nkinds == CORPUS_KINDS)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+			r = corpus_parse(tok, &kinds[nkinds++]);
+			CHECK_RESULT(r);
+		}
+	}
+
+	res = (struct bench_result *) malloc(nkinds * nsizes *
+			sizeof(struct bench_result));
+	if (res == NULL)
+		CHECK_RESULT(HUF_ERROR_MEMORY_ALLOC);
+
+	for (i = 0; i < nkinds; i++) {
+		for (j = 0; j < nsizes; j++) {
+			r = bench_text(kinds[i], sizes[j], &bp, reps,
+					&res[nres++]);
+			CHECK_RESULT(r);
+		}
+	}
+
+	print_results(res, nres);
+	r = write_results(output, &bp, res, nres);
+	CHECK_RESULT(r);
+
+	if (baseline != NULL && compare_results(baseline, res, nres,
+				tolerance) > 0) {
+		free(res);
+		return EXIT_FAILURE;
+	}
+	free(res);
+
+	return EXIT_SUCCESS;
+}
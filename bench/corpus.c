@@ -0,0 +1,193 @@
+#include <string.h>
+#include <ctype.h>
+
+#include "corpus.h"
+
+#define UNIFORM_CHARS	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"
+#define LINE_WIDTH	(72)
+#define SENTENCE_WORDS	(12)	/* a sentence ends every this many words on average */
+
+static const char *const corpus_names[CORPUS_KINDS] = {
+	"uniform", "zipf", "english", "single", "random",
+};
+
+/* The most common english words, most frequent first */
+static const char *const words[] = {
+	"the", "of", "and", "to", "a", "in", "is", "you", "that", "it",
+	"he", "was", "for", "on", "are", "as", "with", "his", "they", "I",
+	"at", "be", "this", "have", "from", "or", "one", "had", "by", "word",
+	"but", "not", "what", "all", "were", "we", "when", "your", "can",
+	"said", "there", "use", "an", "each", "which", "she", "do", "how",
+	"their", "if", "will", "up", "other", "about", "out", "many", "then",
+	"them", "these", "so", "some", "her", "would", "make", "like", "him",
+	"into", "time", "has", "look", "two", "more", "write", "go", "see",
+	"number", "no", "way", "could", "people", "my", "than", "first",
+	"water", "been", "call", "who", "oil", "its", "now", "find", "long",
+	"down", "day", "did", "get", "come", "made", "may", "part",
+	"compression", "information", "frequency", "alphabet", "probability",
+};
+
+#define WORDS		(sizeof(words) / sizeof(words[0]))
+
+/* Name of the kind, as given on the command line */
+const char *corpus_name(enum corpus_kind kind)
+{
+	return corpus_names[kind];
+}
+
+/* Finds the kind called name */
+enum huf_result corpus_parse(const char *name, enum corpus_kind *kind)
+{
+	int i;
+
+	for (i = 0; i < CORPUS_KINDS; i++) {
+		if (strcmp(name, corpus_names[i]) == 0) {
+			*kind = (enum corpus_kind) i;
+			return HUF_SUCCESS;
+		}
+	}
+
+	return HUF_ERROR_INVALID_ARGUMENTS;
+}
+
+/* splitmix64, a full period 64-bit sequence */
+static inline uint64_t next_rand(struct corpus *c)
+{
+	uint64_t z;
+
+	c->state += 0x9e3779b97f4a7c15ULL;
+	z = c->state;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+/* Weights 1 / (k + 1) for the first n ranks, summed up to 2^32 */
+static void zipf_init(struct corpus *c, int n)
+{
+	double total = 0, sum = 0;
+	int k;
+
+	for (k = 0; k < n; k++)
+		total += 1.0 / (k + 1);
+	for (k = 0; k < n; k++) {
+		sum += 1.0 / (k + 1);
+		c->cdf[k] = sum / total * 4294967295.0;
+	}
+	c->cdf[n - 1] = UINT32_MAX;
+}
+
+/* Draws a rank out of the first n, the first one with cdf above a */
+static inline int zipf_next(struct corpus *c, int n)
+{
+	uint32_t a = next_rand(c) >> 32;
+	int lo = 0, hi = n - 1, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (c->cdf[mid] < a)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Starts the text of the kind for the seed */
+void corpus_init(struct corpus *c, enum corpus_kind kind, uint64_t seed)
+{
+	memset(c, 0, sizeof(struct corpus));
+	c->kind = kind;
+	c->state = seed;
+
+	if (kind == CORPUS_ZIPF)
+		zipf_init(c, CORPUS_ZIPF_SYMS);
+	else if (kind == CORPUS_ENGLISH)
+		zipf_init(c, WORDS);
+}
+
+/* Queues the next word, with the punctuation and space after it */
+static void next_word(struct corpus *c)
+{
+	const char *w = words[zipf_next(c, WORDS)];
+	int len = strlen(w);
+
+	memcpy(c->word, w, len);
+	if (c->sentence_len == 0)
+		c->word[0] = toupper((unsigned char) c->word[0]);
+	c->sentence_len++;
+
+	if (next_rand(c) % SENTENCE_WORDS == 0) {
+		c->word[len++] = '.';
+		c->sentence_len = 0;
+	} else if (next_rand(c) % SENTENCE_WORDS == 0) {
+		c->word[len++] = ',';
+	}
+
+	/* Lines are wrapped before they get too long */
+	if (c->line_len + len + 1 > LINE_WIDTH) {
+		c->word[len++] = '\n';
+		c->line_len = 0;
+	} else {
+		c->word[len++] = ' ';
+		c->line_len += len;
+	}
+
+	c->word_len = len;
+	c->word_pos = 0;
+}
+
+/* Generates the next n chars of the text into buf */
+void corpus_fill(struct corpus *c, uint8_t *buf, size_t n)
+{
+	uint64_t r;
+	size_t i, k;
+
+	switch (c->kind) {
+	case CORPUS_UNIFORM:
+		for (i = 0; i < n; i++)
+			buf[i] = UNIFORM_CHARS[next_rand(c) >> 58];
+		break;
+
+	case CORPUS_ZIPF:
+		/* The ranks are spread over the chars, 167 being odd */
+		for (i = 0; i < n; i++)
+			buf[i] = zipf_next(c, CORPUS_ZIPF_SYMS) * 167 + 13;
+		break;
+
+	case CORPUS_ENGLISH:
+		for (i = 0; i < n; i += k) {
+			if (c->word_pos == c->word_len)
+				next_word(c);
+			k = c->word_len - c->word_pos;
+			if (k > n - i)
+				k = n - i;
+			memcpy(&buf[i], &c->word[c->word_pos], k);
+			c->word_pos += k;
+		}
+		break;
+
+	case CORPUS_SINGLE:
+		memset(buf, 'a', n);
+		break;
+
+	case CORPUS_RANDOM:
+		/* Eight chars out of every number, low byte first */
+		for (i = 0; i < n; i++) {
+			if (c->word_pos == c->word_len) {
+				r = next_rand(c);
+				for (k = 0; k < sizeof(uint64_t); k++)
+					c->word[k] = r >> (8 * k);
+				c->word_len = sizeof(uint64_t);
+				c->word_pos = 0;
+			}
+			buf[i] = c->word[c->word_pos++];
+		}
+		break;
+
+	default:
+		break;
+	}
+}
@@ -0,0 +1,47 @@
+/*
+ * Synthetic texts for the benchmark. Every kind is generated from a seeded
+ * pseudo-random sequence, a chunk at a time, so the same kind, size and seed
+ * always give the same bytes however large the text is.
+ */
+
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include "common.h"
+
+#define CORPUS_ZIPF_SYMS	(ASCII_SIZE)	/* chars drawn by zipf */
+#define CORPUS_WORD_MAX		(32)		/* longest english word, spaces included */
+
+enum corpus_kind {
+	CORPUS_UNIFORM,			/* 64 chars, equally likely */
+	CORPUS_ZIPF,			/* all the chars, zipf distributed */
+	CORPUS_ENGLISH,			/* zipf distributed words, sentences */
+	CORPUS_SINGLE,			/* one char repeated */
+	CORPUS_RANDOM,			/* random bytes */
+	CORPUS_KINDS,
+};
+
+struct corpus {
+	enum corpus_kind kind;
+	uint64_t state;			/* generator state */
+	uint32_t cdf[CORPUS_ZIPF_SYMS];	/* zipf cumulative weights, out of 2^32 */
+	char word[CORPUS_WORD_MAX];	/* chars generated, not output yet */
+	int word_len;
+	int word_pos;
+	int line_len;
+	int sentence_len;		/* words in the current sentence */
+};
+
+/* Name of the kind, as given on the command line */
+const char *corpus_name(enum corpus_kind kind);
+
+/* Finds the kind called name */
+enum huf_result corpus_parse(const char *name, enum corpus_kind *kind);
+
+/* Starts the text of the kind for the seed */
+void corpus_init(struct corpus *c, enum corpus_kind kind, uint64_t seed);
+
+/* Generates the next n chars of the text into buf */
+void corpus_fill(struct corpus *c, uint8_t *buf, size_t n);
+
+#endif	/* #ifndef CORPUS_H */
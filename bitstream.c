@@ -0,0 +1,119 @@
+#include "bitstream.h"
+
+/* Reads the bits from the n bytes at src */
+void br_init_mem(struct bit_reader *br, const void *src, size_t n)
+{
+	br->bits = 0;
+	br->count = 0;
+	br->pos = (const uint8_t *) src;
+	br->end = br->pos + n;
+	br->in = NULL;
+}
+
+/*
+ * Reads the bits from the remainder of the input, a mapped input is handed
+ * out whole by the first refill
+ */
+void br_init_input(struct bit_reader *br, struct huf_input *in)
+{
+	br->bits = 0;
+	br->count = 0;
+	br->pos = NULL;
+	br->end = NULL;
+	br->in = in;
+}
+
+/* Loads the bytes left before end one at a time, refilling from the input */
+void br_refill_slow(struct bit_reader *br)
+{
+	const uint8_t *data;
+	size_t n;
+
+	while (br->count <= 56) {
+		if (br->pos == br->end) {
+			if (br->in == NULL)
+				return;
+
+			n = io_in_size(br->in);
+			if (n == 0)
+				n = IO_BUF_SIZE;
+			if (io_next(br->in, NULL, n, &data, &n) != HUF_SUCCESS ||
+					n == 0)
+				return;
+			br->pos = data;
+			br->end = data + n;
+		}
+		br->bits |= (uint64_t) *br->pos++ << (56 - br->count);
+		br->count += 8;
+	}
+}
+
+/* Writes the bits to the output, gathered in a ENC_BUF_SIZE buffer */
+enum huf_result bw_init_output(struct bit_writer *bw, struct huf_output *out)
+{
+	bw->buf = (uint8_t *) huf_malloc((ENC_BUF_SIZE + sizeof(uint64_t)) *
+			sizeof(uint8_t));
+	if (bw->buf == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+
+	bw->bits = 0;
+	bw->count = 0;
+	bw->pos = bw->buf;
+	bw->limit = bw->buf + ENC_BUF_SIZE;
+	bw->out = out;
+	bw->r = HUF_SUCCESS;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Writes the bits to the n bytes at dst, which must also fit the word stored
+ * past the last byte
+ */
+void bw_init_mem(struct bit_writer *bw, void *dst, size_t n)
+{
+	bw->bits = 0;
+	bw->count = 0;
+	bw->buf = (uint8_t *) dst;
+	bw->pos = bw->buf;
+	bw->limit = bw->buf + n;
+	bw->out = NULL;
+	bw->r = HUF_SUCCESS;
+}
+
+/* Writes the buffered bytes to the output, memory writers keep them */
+enum huf_result bw_drain(struct bit_writer *bw)
+{
+	enum huf_result r;
+
+	if (bw->out == NULL)
+		return HUF_SUCCESS;
+
+	/* The encoder doesn't check every drain, the first error is kept */
+	r = io_write(bw->out, bw->buf, bw->pos - bw->buf);
+	if (r != HUF_SUCCESS && bw->r == HUF_SUCCESS)
+		bw->r = r;
+	bw->pos = bw->buf;
+
+	return bw->r;
+}
+
+/* Pads the last byte with zeros and writes everything left */
+enum huf_result bw_finish(struct bit_writer *bw)
+{
+	bw_flush(bw);
+	if (bw->count > 0) {
+		bw->pos++;
+		bw->bits = 0;
+		bw->count = 0;
+	}
+
+	return bw_drain(bw);
+}
+
+/* Frees the buffer */
+void bw_close(struct bit_writer *bw)
+{
+	free(bw->buf);
+	bw->buf = NULL;
+}
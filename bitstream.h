@@ -0,0 +1,137 @@
+/*
+ * Bit level access to the compressed stream. Bits are stored most
+ * significant bit first, exactly as compress() has always written them.
+ */
+
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include <string.h>
+
+#include "common.h"
+#include "io.h"
+
+struct bit_reader {
+	uint64_t bits;			/* pending bits, MSB aligned */
+	int count;			/* valid bits, negative on overrun */
+	const uint8_t *pos;		/* next byte to load into bits */
+	const uint8_t *end;
+	struct huf_input *in;		/* refill source, NULL for memory */
+};
+
+struct bit_writer {
+	uint64_t bits;			/* pending bits, MSB aligned */
+	int count;			/* pending bits, below 8 after a flush */
+	uint8_t *pos;			/* where the pending bits go */
+	uint8_t *limit;			/* drain the buffer once pos gets here */
+	uint8_t *buf;			/* ENC_BUF_SIZE bytes, plus a word of slack */
+	struct huf_output *out;		/* drain target, NULL for memory */
+	enum huf_result r;		/* first failed drain */
+};
+
+/* Reads the bits from the n bytes at src */
+void br_init_mem(struct bit_reader *br, const void *src, size_t n);
+
+/* Reads the bits from the remainder of the input */
+void br_init_input(struct bit_reader *br, struct huf_input *in);
+
+/* Loads the bytes left before end one at a time, refilling from the input */
+void br_refill_slow(struct bit_reader *br);
+
+/* Writes the bits to the output, gathered in a ENC_BUF_SIZE buffer */
+enum huf_result bw_init_output(struct bit_writer *bw, struct huf_output *out);
+
+/*
+ * Writes the bits to the n bytes at dst, which must also fit the word stored
+ * past the last byte
+ */
+void bw_init_mem(struct bit_writer *bw, void *dst, size_t n);
+
+/* Writes the buffered bytes to the output, memory writers keep them */
+enum huf_result bw_drain(struct bit_writer *bw);
+
+/* Pads the last byte with zeros and writes everything left */
+enum huf_result bw_finish(struct bit_writer *bw);
+
+/* Frees the buffer */
+void bw_close(struct bit_writer *bw);
+
+/* The words of the stream are big endian, swapped with a single instruction */
+static inline uint64_t load_be64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline void store_be64(uint8_t *p, uint64_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	memcpy(p, &v, sizeof(uint64_t));
+}
+
+/*
+ * Same as br_refill, there must be at least 8 bytes left before end. No more
+ * than 7 of them are loaded.
+ */
+static inline void br_refill_fast(struct bit_reader *br)
+{
+	br->bits |= load_be64(br->pos) >> br->count;
+	br->pos += (63 - br->count) >> 3;
+	br->count |= 56;
+}
+
+/*
+ * Tops the bit buffer up to at least 56 bits. Bits past the last loaded byte
+ * may already hold the start of the next one, they are loaded again with the
+ * same value so or-ing them in twice is harmless.
+ */
+static inline void br_refill(struct bit_reader *br)
+{
+	if (br->end - br->pos >= 8)
+		br_refill_fast(br);
+	else
+		br_refill_slow(br);
+}
+
+/* Returns the next n bits (1 <= n <= 56) without consuming them */
+static inline uint32_t br_peek(const struct bit_reader *br, int n)
+{
+	return (uint32_t) (br->bits >> (64 - n));
+}
+
+static inline void br_consume(struct bit_reader *br, int n)
+{
+	br->bits <<= n;
+	br->count -= n;
+}
+
+/*
+ * Appends the len low bits of code. Nothing is written until bw_flush, the
+ * pending bits plus the new ones must fit in 64 bits.
+ */
+static inline void bw_put(struct bit_writer *bw, uint64_t code, int len)
+{
+	bw->bits |= code << (64 - bw->count - len);
+	bw->count += len;
+}
+
+/*
+ * Stores the whole pending word and advances past the complete bytes, the
+ * partial one is written again by the next flush
+ */
+static inline void bw_flush(struct bit_writer *bw)
+{
+	store_be64(bw->pos, bw->bits);
+	bw->pos += bw->count >> 3;
+	bw->bits <<= bw->count & ~7;
+	bw->count &= 7;
+}
+
+#endif	/* #ifndef BITSTREAM_H */
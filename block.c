@@ -0,0 +1,784 @@
+#include <string.h>
+
+#include "block.h"
+#include "bitstream.h"
+#include "encode.h"
+#include "canon.h"
+#include "tree.h"
+#include "hist.h"
+#include "ctx.h"
+#include "crc.h"
+#include "split.h"
+
+/* Largest context map and tables of a block */
+#define BLOCK_HEAD_MAX		(CTX_MAP_SIZE + CTX_MAX_TABLES * CANON_TABLE_MAX)
+
+/* A block between its counting and its coding */
+struct block_plan {
+	const uint8_t *src;		/* the chars of the block */
+	uint32_t n;
+	enum block_type type;
+	struct ctx_model *m;		/* pairs, NULL for order 0 */
+	uint32_t freq[ASCII_SIZE];
+	int tables;
+	uint8_t lens[CTX_MAX_TABLES][ASCII_SIZE];
+	uint8_t head[BLOCK_HEAD_MAX];	/* context map and code lengths */
+	size_t head_size;
+};
+
+/* Largest compressed block, header included, for n chars */
+size_t block_bound(uint32_t n)
+{
+	/*
+	 * Plus the context map and the tables, the jump table, a padding byte
+	 * per stream, the word the bit writer stores past the last byte and
+	 * the checksum
+	 */
+	return BLOCK_HEADER_SIZE + CTX_MAP_SIZE +
+		CTX_MAX_TABLES * CANON_TABLE_MAX +
+		((uint64_t) n * MAX_CODE_LEN + WRITE_SIZE - 1) / WRITE_SIZE +
+		(MAX_STREAMS - 1) * sizeof(uint32_t) + MAX_STREAMS +
+		sizeof(uint64_t) + CHECKSUM_SIZE;
+}
+
+/* Sets the default parameters */
+void block_params_init(struct block_params *bp)
+{
+	bp->max_len = DEFAULT_CODE_LEN;
+	bp->streams = DEFAULT_STREAMS;
+	bp->tables = 1;
+	bp->checksum = 0;
+	bp->fast = 0;
+	bp->split = 0;
+	bp->stats = NULL;
+}
+
+/* Starts a chain with no table, for the blocks of a new frame */
+void block_chain_init(struct block_chain *c)
+{
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->cond, NULL);
+	block_chain_reset(c);
+}
+
+/* Gets the chain ready for the next frame */
+void block_chain_reset(struct block_chain *c)
+{
+	c->next = 0;
+	c->table.id = 0;
+}
+
+void block_chain_destroy(struct block_chain *c)
+{
+	pthread_cond_destroy(&c->cond);
+	pthread_mutex_destroy(&c->lock);
+}
+
+/* Records the largest tree of the code lengths of the tables in stats */
+static void lens_stats(struct huf_stats *stats,
+		const uint8_t lens[][ASCII_SIZE], int tables)
+{
+	uint32_t syms, max_syms = 0, max_len = 0;
+	int i, t;
+
+	if (stats == NULL)
+		return;
+
+	for (t = 0; t < tables; t++) {
+		syms = 0;
+		for (i = 0; i < ASCII_SIZE; i++) {
+			if (lens[t][i] > 0)
+				syms++;
+			if (lens[t][i] > max_len)
+				max_len = lens[t][i];
+		}
+		if (syms > max_syms)
+			max_syms = syms;
+	}
+	stats_tree(stats, max_syms > 0 ? 2 * max_syms - 1 : 0, max_len);
+}
+
+/* Chars in every segment but the last, which gets whatever is left */
+static inline size_t segment_size(size_t n, int streams)
+{
+	return (n + streams - 1) / streams;
+}
+
+/* log2 of the number of streams, stored in the block flags */
+static inline int streams_flag(int streams)
+{
+	int flag;
+
+	for (flag = 0; (1 << flag) < streams; flag++)
+		;
+
+	return flag;
+}
+
+/*
+ * Counts the chars of the block into freq, and the pairs too when tables
+ * are picked by the preceding char. Every segment starts over from a 0, as
+ * its stream does.
+ */
+static enum huf_result count_block(const uint8_t *src, uint32_t n,
+		const struct block_params *bp, uint32_t freq[ASCII_SIZE],
+		struct ctx_model **m)
+{
+	size_t seg, first, len;
+	int i, c;
+
+	*m = NULL;
+	if (bp->tables == 1 && bp->fast) {
+		hist_sample(src, n, freq);
+		return HUF_SUCCESS;
+	}
+	if (bp->tables == 1) {
+		hist_count(src, n, freq);
+		return HUF_SUCCESS;
+	}
+
+	*m = (struct ctx_model *) huf_malloc(sizeof(struct ctx_model));
+	if (*m == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+	memset((*m)->freq, 0, sizeof((*m)->freq));
+
+	seg = segment_size(n, bp->streams);
+	for (i = 0; i < bp->streams; i++) {
+		first = (size_t) i * seg < n ? (size_t) i * seg : n;
+		len = n - first < seg ? n - first : seg;
+		hist_count_pairs(&src[first], len, 0, (*m)->freq);
+	}
+
+	memset(freq, 0, ASCII_SIZE * sizeof(uint32_t));
+	for (i = 0; i < ASCII_SIZE; i++)
+		for (c = 0; c < ASCII_SIZE; c++)
+			freq[c] += (*m)->freq[i][c];
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Picks the type of the block from its counts, and from the pairs counted
+ * in m unless it is NULL
+ */
+static enum block_type probe_block(const uint32_t freq[ASCII_SIZE],
+		const struct ctx_model *m, uint32_t n)
+{
+	uint64_t bits;
+	int syms, i;
+
+	syms = 0;
+	for (i = 0; i < ASCII_SIZE; i++)
+		if (freq[i] > 0)
+			syms++;
+	if (syms == 1)
+		return BLOCK_RLE;
+
+	/* Less than BLOCK_MIN_GAIN is not worth coding, nor decoding */
+	if (m == NULL) {
+		bits = hist_entropy(freq);
+	} else {
+		bits = 0;
+		for (i = 0; i < ASCII_SIZE; i++)
+			bits += hist_entropy(m->freq[i]);
+	}
+	if (bits / WRITE_SIZE >= n - n / BLOCK_MIN_GAIN)
+		return BLOCK_RAW;
+
+	return BLOCK_HUF;
+}
+
+/*
+ * Writes the checksum of the n chars at src to dst if the blocks end with
+ * one, returns the bytes written
+ */
+static size_t put_checksum(const struct block_params *bp, const uint8_t *src,
+		uint32_t n, uint8_t *dst)
+{
+	struct stats_clock clock;
+
+	if (!bp->checksum)
+		return 0;
+
+	stats_start(bp->stats, &clock);
+	put_le32(dst, crc32c(0, src, n));
+	stats_stop(bp->stats, STATS_CHECK, &clock);
+
+	return CHECKSUM_SIZE;
+}
+
+/* Writes the whole BLOCK_RAW or BLOCK_RLE block of the n chars at src */
+static void store_block(const uint8_t *src, uint32_t n, enum block_type type,
+		const struct block_params *bp, uint8_t *dst, size_t *dst_size)
+{
+	struct block_header bh;
+	struct stats_clock clock;
+	uint32_t k;
+
+	stats_start(bp->stats, &clock);
+	k = type == BLOCK_RLE ? 1 : n;
+	memcpy(&dst[BLOCK_HEADER_SIZE], src, k);
+	stats_stop(bp->stats, STATS_ENCODE, &clock);
+
+	bh.type = type;
+	bh.flags = bp->checksum ? BLOCK_CHECKSUM : 0;
+	bh.raw_size = n;
+	bh.comp_size = k;
+	bh.comp_size += put_checksum(bp, src, n, &dst[BLOCK_HEADER_SIZE + k]);
+	frame_put_block(dst, &bh);
+	*dst_size = BLOCK_HEADER_SIZE + bh.comp_size;
+	stats_store(bp->stats);
+}
+
+/*
+ * Bits of the chars counted in freq coded with lens, UINT64_MAX if one of
+ * them has no code
+ */
+static uint64_t coded_bits(const uint32_t freq[ASCII_SIZE],
+		const uint8_t lens[ASCII_SIZE])
+{
+	uint64_t bits = 0;
+	int i;
+
+	for (i = 0; i < ASCII_SIZE; i++) {
+		if (freq[i] > 0 && lens[i] == 0)
+			return UINT64_MAX;
+		bits += (uint64_t) freq[i] * lens[i];
+	}
+
+	return bits;
+}
+
+/*
+ * Counts the chars of the block at p, unless freq holds them already and
+ * the block has a single table, picks its type and builds its code lengths,
+ * serializing them with the context map in its head
+ */
+static enum huf_result plan_block(const struct block_params *bp,
+		const uint32_t *freq, struct block_plan *p)
+{
+	struct stats_clock clock;
+	uint32_t (*tfreq)[ASCII_SIZE];
+	enum huf_result r;
+	uint8_t *pos;
+	uint64_t bits;
+	int i;
+
+	stats_start(bp->stats, &clock);
+	r = HUF_SUCCESS;
+	if (freq != NULL && bp->tables == 1)
+		memcpy(p->freq, freq, sizeof(p->freq));
+	else
+		r = count_block(p->src, p->n, bp, p->freq, &p->m);
+	if (r != HUF_SUCCESS)
+		return r;
+	p->type = probe_block(p->freq, p->m, p->n);
+	stats_stop(bp->stats, STATS_HIST, &clock);
+	if (p->type != BLOCK_HUF)
+		return HUF_SUCCESS;
+
+	stats_start(bp->stats, &clock);
+	p->tables = 1;
+	tfreq = &p->freq;
+	pos = p->head;
+	if (p->m != NULL) {
+		ctx_cluster(p->m, bp->tables);
+		p->tables = p->m->tables;
+		tfreq = p->m->tfreq;
+	}
+	if (p->tables > 1) {
+		ctx_write_map(p->m, pos);
+		pos += CTX_MAP_SIZE;
+		p->type = BLOCK_CTX;
+	}
+	for (i = 0; i < p->tables; i++) {
+		r = canon_lengths(tfreq[i], bp->max_len, p->lens[i]);
+		if (r != HUF_SUCCESS)
+			return r;
+		pos += canon_write(p->lens[i], pos);
+	}
+	p->head_size = pos - p->head;
+	stats_stop(bp->stats, STATS_TREE, &clock);
+
+	/* The codes and their lengths don't shrink the block */
+	if (p->type == BLOCK_HUF) {
+		bits = coded_bits(p->freq, p->lens[0]);
+		if (p->head_size + (bp->streams - 1) * sizeof(uint32_t) +
+				bits / WRITE_SIZE + bp->streams >= p->n)
+			p->type = BLOCK_RAW;
+	}
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Waits for the turn of the count blocks at p in the chain, they take it
+ * together. Every BLOCK_HUF block then takes the table of the chain if its
+ * chars cost no more bits with it than with their own codes and code
+ * lengths, otherwise its own table becomes the one of the chain.
+ */
+static void pick_table(struct block_chain *c, uint64_t seq,
+		struct block_plan *p, int count)
+{
+	uint64_t own, old;
+	int i;
+
+	pthread_mutex_lock(&c->lock);
+	while (c->next != seq)
+		pthread_cond_wait(&c->cond, &c->lock);
+
+	for (i = 0; i < count; i++, p++) {
+		if (p->type != BLOCK_HUF)
+			continue;
+		own = coded_bits(p->freq, p->lens[0]) +
+			(uint64_t) p->head_size * WRITE_SIZE;
+		old = UINT64_MAX;
+		if (c->table.id > 0)
+			old = coded_bits(p->freq, c->table.lens);
+		if (old <= own) {
+			p->type = BLOCK_REPEAT;
+			memcpy(p->lens[0], c->table.lens, ASCII_SIZE);
+		} else {
+			memcpy(c->table.lens, p->lens[0], ASCII_SIZE);
+			c->table.id++;
+		}
+	}
+
+	c->next++;
+	pthread_cond_broadcast(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+}
+
+/*
+ * Codes the planned block. A block whose table the chain took has to be
+ * written with it, even if the codes failed to shrink it.
+ */
+static void write_block(const uint8_t *src, uint32_t n,
+		const struct block_params *bp, struct block_plan *p,
+		int chained, uint8_t *dst, size_t *dst_size)
+{
+	struct huf_code codes[CTX_MAX_TABLES][ASCII_SIZE];
+	struct block_header bh;
+	struct bit_writer bw;
+	struct stats_clock clock;
+	uint8_t *jump, *pos, *end;
+	size_t seg, first, len;
+	int i;
+
+	if (p->type == BLOCK_RAW || p->type == BLOCK_RLE) {
+		store_block(src, n, p->type, bp, dst, dst_size);
+		return;
+	}
+
+	/* The header is written last, once the payload size is known */
+	stats_start(bp->stats, &clock);
+	for (i = 0; i < p->tables; i++)
+		canon_codes(p->lens[i], codes[i]);
+	stats_stop(bp->stats, STATS_TREE, &clock);
+	lens_stats(bp->stats, p->lens, p->tables);
+	if (p->type == BLOCK_REPEAT)
+		stats_reuse(bp->stats);
+
+	jump = &dst[BLOCK_HEADER_SIZE];
+	if (p->type != BLOCK_REPEAT) {
+		memcpy(jump, p->head, p->head_size);
+		jump += p->head_size;
+	}
+	pos = jump + (bp->streams - 1) * sizeof(uint32_t);
+	end = dst + block_bound(n);
+
+	/* Every stream starts where the previous one ended */
+	stats_start(bp->stats, &clock);
+	seg = segment_size(n, bp->streams);
+	for (i = 0; i < bp->streams; i++) {
+		first = (size_t) i * seg < n ? (size_t) i * seg : n;
+		len = n - first < seg ? n - first : seg;
+
+		bw_init_mem(&bw, pos, end - pos);
+		if (p->tables > 1)
+			huf_encode_ctx(&bw, codes, p->tables, p->m->map,
+					&src[first], len);
+		else
+			huf_encode(&bw, codes[0], &src[first], len);
+		bw_finish(&bw);
+		if (i < bp->streams - 1)
+			put_le32(&jump[i * sizeof(uint32_t)], bw.pos - bw.buf);
+		pos = bw.pos;
+	}
+
+	stats_stop(bp->stats, STATS_ENCODE, &clock);
+
+	/* The estimate missed, the codes don't shrink the block */
+	if (pos - &dst[BLOCK_HEADER_SIZE] >= n &&
+			!(chained && p->type == BLOCK_HUF)) {
+		store_block(src, n, BLOCK_RAW, bp, dst, dst_size);
+		return;
+	}
+	pos += put_checksum(bp, src, n, pos);
+
+	bh.type = p->type;
+	bh.flags = streams_flag(bp->streams) |
+		(bp->checksum ? BLOCK_CHECKSUM : 0);
+	bh.raw_size = n;
+	bh.comp_size = pos - &dst[BLOCK_HEADER_SIZE];
+	frame_put_block(dst, &bh);
+	*dst_size = BLOCK_HEADER_SIZE + bh.comp_size;
+}
+
+/*
+ * Plans the n chars at src as the blocks bp->split ends where the counts
+ * change, the counts of their segments standing for theirs. Every plan is
+ * left in *plans, even a failed one, unless they can't be allocated.
+ */
+static enum huf_result plan_split(const uint8_t *src, uint32_t n,
+		const struct block_params *bp, struct block_plan **plans,
+		int *count)
+{
+	uint32_t (*seg)[ASCII_SIZE];
+	uint32_t freq[ASCII_SIZE];
+	struct stats_clock clock;
+	struct block_plan *p;
+	enum huf_result r;
+	uint32_t nseg, first, k, i;
+	int c;
+
+	nseg = (n + SPLIT_SEGMENT - 1) / SPLIT_SEGMENT;
+	seg = (uint32_t (*)[ASCII_SIZE]) huf_malloc(nseg * sizeof(*seg));
+	p = (struct block_plan *) huf_calloc(nseg / SPLIT_MIN + 1,
+			sizeof(struct block_plan));
+	if (seg == NULL || p == NULL) {
+		free(seg);
+		free(p);
+		return HUF_ERROR_MEMORY_ALLOC;
+	}
+	*plans = p;
+	*count = 0;
+
+	stats_start(bp->stats, &clock);
+	split_count(src, n, seg);
+	stats_stop(bp->stats, STATS_HIST, &clock);
+
+	r = HUF_SUCCESS;
+	for (first = 0; first < nseg && r == HUF_SUCCESS; first += k) {
+		stats_start(bp->stats, &clock);
+		k = split_next(&seg[first], nseg - first, bp->max_len);
+		memset(freq, 0, sizeof(freq));
+		for (i = first; i < first + k; i++)
+			for (c = 0; c < ASCII_SIZE; c++)
+				freq[c] += seg[i][c];
+		stats_stop(bp->stats, STATS_HIST, &clock);
+
+		p = &(*plans)[(*count)++];
+		p->src = &src[first * SPLIT_SEGMENT];
+		p->n = first + k < nseg ? k * SPLIT_SEGMENT :
+			n - first * SPLIT_SEGMENT;
+		r = plan_block(bp, freq, p);
+	}
+	free(seg);
+
+	return r;
+}
+
+/*
+ * Compresses the n chars at src into a whole block, header included, dst
+ * must hold block_bound(n) bytes. With bp->split the chars may make
+ * several blocks, one after the other, and dst must hold split_bound(n)
+ * bytes. The blocks take the seq-th turn of the chain, in which every call
+ * takes its turn, unless chain is NULL and they stand alone.
+ */
+enum huf_result block_compress(const uint8_t *src, uint32_t n,
+		const struct block_params *bp, struct block_chain *chain,
+		uint64_t seq, uint8_t *dst, size_t *dst_size)
+{
+	struct block_plan one, *plans = &one;
+	enum huf_result r;
+	size_t size;
+	int flag, count, i;
+
+	one.src = src;
+	one.n = n;
+	one.m = NULL;
+	count = 1;
+	flag = streams_flag(bp->streams);
+	r = HUF_ERROR_INVALID_PARAMETER;
+	if (n > 0 && (1 << flag) == bp->streams &&
+			bp->streams <= MAX_STREAMS && bp->tables >= 1 &&
+			bp->tables <= CTX_MAX_TABLES &&
+			!(bp->fast && (bp->tables > 1 || bp->split))) {
+		if (bp->split && n >= 2 * SPLIT_MIN * SPLIT_SEGMENT)
+			r = plan_split(src, n, bp, &plans, &count);
+		else
+			r = plan_block(bp, NULL, &one);
+	}
+
+	/* A failed block still takes its turn, the next ones wait for it */
+	if (r != HUF_SUCCESS)
+		for (i = 0; i < count; i++)
+			plans[i].type = BLOCK_END;
+	if (chain != NULL)
+		pick_table(chain, seq, plans, count);
+
+	*dst_size = 0;
+	for (i = 0; r == HUF_SUCCESS && i < count; i++) {
+		write_block(plans[i].src, plans[i].n, bp, &plans[i],
+				chain != NULL, &dst[*dst_size], &size);
+		*dst_size += size;
+	}
+	for (i = 0; i < count; i++)
+		free(plans[i].m);
+	if (plans != &one)
+		free(plans);
+
+	return r;
+}
+
+/*
+ * Checks the sizes in the block header against the frame header, and that
+ * the block type is the one of the frame
+ */
+enum huf_result block_check(struct frame_header *fh, struct block_header *bh)
+{
+	uint32_t size;
+
+	if (bh->raw_size > fh->block_size || bh->comp_size >
+			block_bound(bh->raw_size) - BLOCK_HEADER_SIZE)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	/* The payload without the checksum */
+	size = bh->comp_size;
+	if (bh->flags & BLOCK_CHECKSUM) {
+		if (size < CHECKSUM_SIZE)
+			return HUF_ERROR_INVALID_RESOURCE;
+		size -= CHECKSUM_SIZE;
+	}
+	if (size == 0 || (bh->type == BLOCK_RAW && size != bh->raw_size) ||
+			(bh->type == BLOCK_RLE && size != 1))
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	/* Adaptive frames hold nothing else, and only them */
+	if ((bh->type == BLOCK_ADAPTIVE) != !!(fh->flags & FRAME_ADAPTIVE))
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Gets the decoder of a BLOCK_REPEAT block, building it from table only if
+ * it isn't the one already there
+ */
+static enum huf_result repeat_decoder(struct block_decoder *bd,
+		const struct block_table *table, struct huf_stats *stats)
+{
+	struct huf_node huftree[2 * ASCII_SIZE - 1];
+	struct stats_clock clock;
+	uint16_t huftree_size;
+	enum huf_result r;
+	int bits, c;
+
+	if (table == NULL || table->id == 0)
+		return HUF_ERROR_INVALID_RESOURCE;
+	lens_stats(stats, &table->lens, 1);
+	stats_reuse(stats);
+	if (bd->id == table->id)
+		return HUF_SUCCESS;
+
+	stats_start(stats, &clock);
+	bits = DEC_MIN_BITS;
+	for (c = 0; c < ASCII_SIZE; c++)
+		if (table->lens[c] > bits)
+			bits = table->lens[c];
+
+	bd->id = 0;
+	r = canon_tree(table->lens, huftree, &huftree_size);
+	if (r != HUF_SUCCESS)
+		return r;
+	r = huf_decoder_init_bits(&bd->dec[0], huftree, huftree_size, bits);
+	if (r != HUF_SUCCESS)
+		return r;
+	bd->id = table->id;
+	stats_stop(stats, STATS_TABLE, &clock);
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Builds the decoders of a BLOCK_HUF or BLOCK_CTX block from the context
+ * map and code lengths at the start of its payload, *used being their size
+ */
+static enum huf_result read_decoders(struct block_header *bh,
+		const uint8_t *payload, uint32_t comp_size,
+		struct block_decoder *bd, const struct block_table *table,
+		uint8_t map[ASCII_SIZE], int *tables, size_t *used,
+		struct huf_stats *stats)
+{
+	struct huf_node huftree[CTX_MAX_TABLES][2 * ASCII_SIZE - 1];
+	struct stats_clock clock;
+	uint8_t lens[CTX_MAX_TABLES][ASCII_SIZE];
+	uint16_t huftree_size;
+	enum huf_result r;
+	size_t n;
+	int bits, i, c;
+
+	/* Rebuilding the trees from the code lengths */
+	stats_start(stats, &clock);
+	*tables = 1;
+	*used = 0;
+	if (bh->type == BLOCK_CTX) {
+		r = ctx_read_map(map, tables, payload, comp_size);
+		if (r != HUF_SUCCESS)
+			return r;
+		if (*tables < 2)
+			return HUF_ERROR_INVALID_RESOURCE;
+		*used = CTX_MAP_SIZE;
+	}
+	bits = DEC_MIN_BITS;
+	for (i = 0; i < *tables; i++) {
+		r = canon_read(lens[i], &payload[*used], comp_size - *used,
+				&n);
+		if (r != HUF_SUCCESS)
+			return r;
+		*used += n;
+		for (c = 0; c < ASCII_SIZE; c++)
+			if (lens[i][c] > bits)
+				bits = lens[i][c];
+	}
+
+	/* The tables of a block share a width, the widest code sets it */
+	bd->id = 0;
+	for (i = 0; i < *tables; i++) {
+		r = canon_tree(lens[i], huftree[i], &huftree_size);
+		if (r != HUF_SUCCESS)
+			return r;
+		r = huf_decoder_init_bits(&bd->dec[i], huftree[i],
+				huftree_size, bits);
+		if (r != HUF_SUCCESS)
+			return r;
+	}
+	if (bh->type == BLOCK_HUF && table != NULL)
+		bd->id = table->id;
+	stats_stop(stats, STATS_TABLE, &clock);
+	lens_stats(stats, lens, *tables);
+
+	return HUF_SUCCESS;
+}
+
+/* Decodes the chars of the block from the comp_size bytes of its payload */
+static enum huf_result decode_payload(struct block_header *bh,
+		const uint8_t *payload, uint32_t comp_size, uint8_t *dst,
+		struct block_decoder *bd, const struct block_table *table,
+		struct huf_stats *stats)
+{
+	struct bit_reader br[MAX_STREAMS];
+	struct stats_clock clock;
+	const uint8_t *jump;
+	uint8_t map[ASCII_SIZE];
+	enum huf_result r;
+	size_t used, left, size;
+	int streams, tables, i;
+
+	/* Stored blocks are copied, runs filled */
+	if (bh->type == BLOCK_RAW || bh->type == BLOCK_RLE) {
+		stats_start(stats, &clock);
+		if (bh->type == BLOCK_RAW)
+			memcpy(dst, payload, bh->raw_size);
+		else
+			memset(dst, payload[0], bh->raw_size);
+		stats_stop(stats, STATS_DECODE, &clock);
+		return HUF_SUCCESS;
+	}
+
+	if (bh->type == BLOCK_REPEAT) {
+		tables = 1;
+		used = 0;
+		r = repeat_decoder(bd, table, stats);
+	} else {
+		r = read_decoders(bh, payload, comp_size, bd, table, map,
+				&tables, &used, stats);
+	}
+	if (r != HUF_SUCCESS)
+		return r;
+
+	/* The streams are found through the jump table */
+	streams = 1 << (bh->flags & BLOCK_STREAMS_MASK);
+	left = comp_size - used;
+	if (left < (streams - 1) * sizeof(uint32_t))
+		return HUF_ERROR_INVALID_RESOURCE;
+	left -= (streams - 1) * sizeof(uint32_t);
+	jump = &payload[used];
+	payload = jump + (streams - 1) * sizeof(uint32_t);
+
+	for (i = 0; i < streams - 1; i++) {
+		size = get_le32(&jump[i * sizeof(uint32_t)]);
+		if (size > left)
+			return HUF_ERROR_INVALID_RESOURCE;
+		br_init_mem(&br[i], payload, size);
+		payload += size;
+		left -= size;
+	}
+	br_init_mem(&br[i], payload, left);
+
+	stats_start(stats, &clock);
+	if (tables > 1)
+		r = huf_decode_ctx_streams(bd->dec, map, br, streams, dst,
+				bh->raw_size);
+	else
+		r = huf_decode_streams(bd->dec, br, streams, dst,
+				bh->raw_size);
+	stats_stop(stats, STATS_DECODE, &clock);
+
+	return r;
+}
+
+/*
+ * Follows the blocks of a frame in table, which the block described by bh
+ * replaces if it is a BLOCK_HUF block. Every block has to go through it, in
+ * order, before it is decompressed.
+ */
+enum huf_result block_table_update(struct block_table *table,
+		struct block_header *bh, const uint8_t *payload)
+{
+	enum huf_result r;
+	uint32_t size;
+	size_t used;
+
+	if (bh->type != BLOCK_HUF)
+		return HUF_SUCCESS;
+
+	size = bh->comp_size;
+	if (bh->flags & BLOCK_CHECKSUM)
+		size -= CHECKSUM_SIZE;
+	r = canon_read(table->lens, payload, size, &used);
+	if (r != HUF_SUCCESS)
+		return r;
+	table->id++;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Decompresses the payload of the block described by bh into dst, adding to
+ * stats unless it is NULL. table is the one the block went through, which
+ * it may be coded with.
+ */
+enum huf_result block_decompress(struct block_header *bh,
+		const uint8_t *payload, uint8_t *dst, struct block_decoder *dec,
+		const struct block_table *table, struct huf_stats *stats)
+{
+	struct stats_clock clock;
+	enum huf_result r;
+	uint32_t size;
+
+	size = bh->comp_size;
+	if (bh->flags & BLOCK_CHECKSUM)
+		size -= CHECKSUM_SIZE;
+	r = decode_payload(bh, payload, size, dst, dec, table, stats);
+	if (r != HUF_SUCCESS || !(bh->flags & BLOCK_CHECKSUM))
+		return r;
+
+	stats_start(stats, &clock);
+	if (crc32c(0, dst, bh->raw_size) != get_le32(&payload[size]))
+		r = HUF_ERROR_CHECKSUM;
+	stats_stop(stats, STATS_CHECK, &clock);
+
+	return r;
+}
@@ -0,0 +1,144 @@
+/*
+ * Compression of the input one independent block at a time. Every block
+ * carries the code lengths of its own chars, so at most one block of text
+ * and its compressed form are ever held in memory.
+ *
+ * The text of a block can be split into 2, 4 or 8 consecutive segments of
+ * equal size (the last one may be shorter), each coded in its own bit
+ * stream, so the decoder follows several independent streams in the same
+ * loop. The payload is then
+ *
+ *	code lengths	as written by canon_write
+ *	jump table	byte size of every stream but the last, 32 bits each
+ *	streams		one after the other, each padded to a whole byte
+ *
+ * A BLOCK_CTX block codes every char with the table its preceding char maps
+ * to, as explained in ctx.h. Its payload starts with the map, followed by
+ * the code lengths of every table. The first char of every stream is
+ * preceded by a 0.
+ *
+ * The counts of the block pick its type before any code is built. A block
+ * of a single char is a BLOCK_RLE block, its payload being that char. A
+ * block whose entropy, given the preceding char when tables are picked by
+ * it, doesn't save 1 / BLOCK_MIN_GAIN of its size is stored as it is in a
+ * BLOCK_RAW block, as is any block the codes failed to shrink.
+ *
+ * With BLOCK_CHECKSUM the payload of any of them ends with the CRC32C of the
+ * chars of the block, computed by the thread coding it right after counting
+ * them and checked right after decoding, while the block is still in cache.
+ *
+ * A BLOCK_REPEAT block is coded with the code lengths of the last BLOCK_HUF
+ * block before it in the frame, so its payload starts with the jump table.
+ * The encoder picks it when the bits of the block under the old codes don't
+ * cost more than its own codes and their code lengths. The blocks of a frame
+ * are chained for that: each one is counted and given its codes on its own,
+ * then waits for the one before it to have picked its table, which is only
+ * a sum over the chars, and is coded on its own again. The decoder keeps
+ * the table of the last BLOCK_HUF block, and a decoder built from it stays
+ * as it is for the BLOCK_REPEAT blocks that follow.
+ */
+
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "frame.h"
+#include "decode.h"
+#include "stats.h"
+#include "ctx.h"
+
+#define MIN_BLOCK_SIZE		(1 << 17)
+#define MAX_BLOCK_SIZE		(1 << 24)
+#define DEFAULT_BLOCK_SIZE	(1 << 20)
+#define MAX_STREAMS		(1 << BLOCK_STREAMS_MASK)
+#define DEFAULT_STREAMS		(4)
+#define BLOCK_MIN_GAIN		(32)	/* codes have to save 1/32 of a block */
+
+/* How the blocks are compressed */
+struct block_params {
+	int max_len;			/* longest code */
+	int streams;			/* interleaved bit streams, a power of 2 */
+	int tables;			/* most tables per block, 1 for order 0 */
+	int checksum;			/* end the blocks with BLOCK_CHECKSUM */
+	int fast;			/* codes from a sample, order 0 only */
+	int split;			/* blocks end where the counts change */
+	struct huf_stats *stats;	/* NULL unless --stats */
+};
+
+/*
+ * The code lengths of the last BLOCK_HUF block of a frame. The tables of a
+ * frame are numbered from 1, id is 0 until there is one.
+ */
+struct block_table {
+	uint32_t id;
+	uint8_t lens[ASCII_SIZE];
+};
+
+/* The blocks of a frame picking their tables one after the other */
+struct block_chain {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint64_t next;			/* block whose turn it is */
+	struct block_table table;
+};
+
+/*
+ * Decoders of a block, and the table the first one was built from. The ids
+ * start over with every frame, so id is cleared before the first block.
+ */
+struct block_decoder {
+	struct huf_decoder dec[CTX_MAX_TABLES];
+	uint32_t id;			/* 0 unless built from a block_table */
+};
+
+/* Sets the default parameters */
+void block_params_init(struct block_params *bp);
+
+/* Starts a chain with no table, for the blocks of a new frame */
+void block_chain_init(struct block_chain *c);
+
+/* Gets the chain ready for the next frame */
+void block_chain_reset(struct block_chain *c);
+
+void block_chain_destroy(struct block_chain *c);
+
+/* Largest compressed block, header included, for n chars */
+size_t block_bound(uint32_t n);
+
+/*
+ * Compresses the n chars at src into a whole block, header included, dst
+ * must hold block_bound(n) bytes. With bp->split the chars may make
+ * several blocks, one after the other, and dst must hold split_bound(n)
+ * bytes. The blocks take the seq-th turn of the chain, in which every call
+ * takes its turn, unless chain is NULL and they stand alone.
+ */
+enum huf_result block_compress(const uint8_t *src, uint32_t n,
+		const struct block_params *bp, struct block_chain *chain,
+		uint64_t seq, uint8_t *dst, size_t *dst_size);
+
+/*
+ * Checks the sizes in the block header against the frame header, and that
+ * the block type is the one of the frame
+ */
+enum huf_result block_check(struct frame_header *fh, struct block_header *bh);
+
+/*
+ * Follows the blocks of a frame in table, which the block described by bh
+ * replaces if it is a BLOCK_HUF block. Every block has to go through it, in
+ * order, before it is decompressed.
+ */
+enum huf_result block_table_update(struct block_table *table,
+		struct block_header *bh, const uint8_t *payload);
+
+/*
+ * Decompresses the payload of the block described by bh into dst, adding to
+ * stats unless it is NULL. table is the one the block went through, which
+ * it may be coded with.
+ */
+enum huf_result block_decompress(struct block_header *bh,
+		const uint8_t *payload, uint8_t *dst, struct block_decoder *dec,
+		const struct block_table *table, struct huf_stats *stats);
+
+#endif	/* #ifndef BLOCK_H */
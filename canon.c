@@ -0,0 +1,384 @@
+#include <string.h>
+
+#include "canon.h"
+
+/* Below this many chars, listing them is cheaper than the 32 byte bitmap */
+#define LIST_MAX		(ASCII_SIZE / 8)
+
+/*
+ * Sorts the chars by frequency, least frequent first, and among equal ones
+ * from the highest char down. Radix sort, one pass per byte of the counts
+ * that isn't zero everywhere.
+ */
+static void sort_by_freq(uint32_t freq[ASCII_SIZE], uint16_t *syms, int n)
+{
+	uint16_t tmp[ASCII_SIZE];
+	uint32_t count[ASCII_SIZE];
+	uint32_t all, pos, c;
+	int shift, i;
+
+	all = 0;
+	for (i = 0; i < n; i++)
+		all |= freq[syms[i]];
+
+	for (shift = 0; shift < 32; shift += 8) {
+		if ((all >> shift) == 0)
+			break;
+
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < n; i++)
+			count[(freq[syms[i]] >> shift) & 0xff]++;
+		pos = 0;
+		for (i = 0; i < ASCII_SIZE; i++) {
+			c = count[i];
+			count[i] = pos;
+			pos += c;
+		}
+		for (i = 0; i < n; i++)
+			tmp[count[(freq[syms[i]] >> shift) & 0xff]++] = syms[i];
+		memcpy(syms, tmp, n * sizeof(uint16_t));
+	}
+}
+
+/*
+ * Turns the n >= 2 ascending weights in a into the code lengths of an
+ * optimal prefix code, in place and in linear time (Moffat and Katajainen,
+ * "In-Place Calculation of Minimum-Redundancy Codes"). The weights must add
+ * up to less than 2^32.
+ */
+static void min_redundancy(uint32_t *a, int n)
+{
+	int root, leaf, next, avail, used, depth;
+
+	/* Building the tree, a node holds its weight then its parent */
+	a[0] += a[1];
+	root = 0;
+	leaf = 2;
+	for (next = 1; next < n - 1; next++) {
+		if (leaf >= n || a[root] < a[leaf]) {
+			a[next] = a[root];
+			a[root++] = next;
+		} else {
+			a[next] = a[leaf++];
+		}
+
+		if (leaf >= n || (root < next && a[root] < a[leaf])) {
+			a[next] += a[root];
+			a[root++] = next;
+		} else {
+			a[next] += a[leaf++];
+		}
+	}
+
+	/* The depth of every internal node, from the root down */
+	a[n - 2] = 0;
+	for (next = n - 3; next >= 0; next--)
+		a[next] = a[a[next]] + 1;
+
+	/* The depth of the leaves, from the internal nodes on every level */
+	avail = 1;
+	used = 0;
+	depth = 0;
+	root = n - 2;
+	next = n - 1;
+	while (avail > 0) {
+		while (root >= 0 && (int) a[root] == depth) {
+			used++;
+			root--;
+		}
+		while (avail > used) {
+			a[next--] = depth;
+			avail--;
+		}
+		avail = 2 * used;
+		depth++;
+		used = 0;
+	}
+}
+
+/*
+ * Lowers the leaves deeper than max_len, keeping the code complete (JPEG
+ * Annex K.3). Two leaves at the deepest level i are replaced by their parent
+ * at i - 1, and a leaf at some level j < i - 1 becomes a node with the two
+ * removed leaves as children at j + 1.
+ */
+static void limit_depth(uint32_t *bl_count, int depth, int max_len)
+{
+	int i, j;
+
+	for (i = depth; i > max_len; i--) {
+		while (bl_count[i] > 0) {
+			j = i - 2;
+			while (j > 0 && bl_count[j] == 0)
+				j--;
+
+			bl_count[i] -= 2;
+			bl_count[i - 1]++;
+			bl_count[j + 1] += 2;
+			bl_count[j]--;
+		}
+	}
+}
+
+/*
+ * Computes the optimal code lengths for freq, then lowers the deepest ones
+ * until none is longer than max_len. Nothing is allocated, the tree is built
+ * in place over the sorted counts.
+ */
+enum huf_result canon_lengths(uint32_t freq[ASCII_SIZE], int max_len,
+		uint8_t lens[ASCII_SIZE])
+{
+	uint16_t syms[ASCII_SIZE];
+	uint32_t a[ASCII_SIZE];
+	uint32_t bl_count[ASCII_SIZE] = {0};
+	int nsyms, len, max_depth;
+	int i;
+
+	if (max_len < MIN_CODE_LEN || max_len > MAX_CODE_LEN)
+		return HUF_ERROR_INVALID_PARAMETER;
+
+	memset(lens, 0, ASCII_SIZE * sizeof(uint8_t));
+	nsyms = 0;
+	for (i = ASCII_SIZE - 1; i >= 0; i--)
+		if (freq[i] > 0)
+			syms[nsyms++] = i;
+
+	if (nsyms == 0)
+		return HUF_SUCCESS;
+
+	/*
+	 * A lone char still needs a complete code, the neighbouring char
+	 * takes the other one bit code and is never written
+	 */
+	if (nsyms == 1) {
+		lens[syms[0]] = 1;
+		lens[syms[0] ^ 1] = 1;
+		return HUF_SUCCESS;
+	}
+
+	sort_by_freq(freq, syms, nsyms);
+	for (i = 0; i < nsyms; i++)
+		a[i] = freq[syms[i]];
+	min_redundancy(a, nsyms);
+
+	/* Counting the leaves on every level, the first one is the deepest */
+	max_depth = a[0];
+	for (i = 0; i < nsyms; i++)
+		bl_count[a[i]]++;
+
+	limit_depth(bl_count, max_depth, max_len);
+
+	/* Handing out the lengths, shortest first, to the most frequent chars */
+	len = 1;
+	for (i = nsyms - 1; i >= 0; i--) {
+		while (bl_count[len] == 0)
+			len++;
+		lens[syms[i]] = len;
+		bl_count[len]--;
+	}
+
+	return HUF_SUCCESS;
+}
+
+/* The first canonical code of every length */
+static void first_codes(const uint8_t lens[ASCII_SIZE],
+		uint32_t next_code[MAX_CODE_LEN + 1])
+{
+	uint32_t bl_count[MAX_CODE_LEN + 1] = {0};
+	uint32_t code;
+	int i;
+
+	for (i = 0; i < ASCII_SIZE; i++)
+		bl_count[lens[i]]++;
+	bl_count[0] = 0;
+
+	code = 0;
+	for (i = 1; i <= MAX_CODE_LEN; i++) {
+		code = (code + bl_count[i - 1]) << 1;
+		next_code[i] = code;
+	}
+}
+
+/* Assigns the canonical codes for the code lengths */
+void canon_codes(uint8_t lens[ASCII_SIZE], struct huf_code codes[ASCII_SIZE])
+{
+	uint32_t next_code[MAX_CODE_LEN + 1];
+	int i;
+
+	first_codes(lens, next_code);
+	for (i = 0; i < ASCII_SIZE; i++) {
+		codes[i].len = lens[i];
+		codes[i].code = lens[i] > 0 ? next_code[lens[i]]++ : 0;
+	}
+}
+
+/* The code lengths must describe a complete prefix code */
+static enum huf_result check_kraft(const uint8_t lens[ASCII_SIZE])
+{
+	uint32_t sum;
+	int i;
+
+	sum = 0;
+	for (i = 0; i < ASCII_SIZE; i++) {
+		if (lens[i] > MAX_CODE_LEN)
+			return HUF_ERROR_INVALID_RESOURCE;
+		if (lens[i] > 0)
+			sum += 1 << (MAX_CODE_LEN - lens[i]);
+	}
+
+	if (sum != 1 << MAX_CODE_LEN)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Builds the Huffman tree matching the canonical codes for the decoder,
+ * huftree needs room for 2 * ASCII_SIZE - 1 nodes
+ */
+enum huf_result canon_tree(const uint8_t lens[ASCII_SIZE],
+		struct huf_node *huftree, uint16_t *huftree_size)
+{
+	uint32_t next_code[MAX_CODE_LEN + 1];
+	uint32_t code;
+	int16_t node, child;
+	enum huf_result r;
+	int i, j, bit;
+
+	r = check_kraft(lens);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	huftree[0].val = 0;
+	huftree[0].left = NO_CHILD;
+	huftree[0].right = NO_CHILD;
+	*huftree_size = 1;
+
+	first_codes(lens, next_code);
+	for (i = 0; i < ASCII_SIZE; i++) {
+		if (lens[i] == 0)
+			continue;
+
+		/* Following the code from the root, adding the missing nodes */
+		code = next_code[lens[i]]++;
+		node = 0;
+		for (j = lens[i] - 1; j >= 0; j--) {
+			bit = (code >> j) & 1;
+			child = bit ? huftree[node].right : huftree[node].left;
+
+			if (child == NO_CHILD) {
+				child = *huftree_size;
+				huftree[child].val = 0;
+				huftree[child].left = NO_CHILD;
+				huftree[child].right = NO_CHILD;
+				(*huftree_size)++;
+
+				if (bit)
+					huftree[node].right = child;
+				else
+					huftree[node].left = child;
+			}
+			node = child;
+		}
+		huftree[node].val = i;
+	}
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Serializes the code lengths into buf, returns the number of bytes used:
+ *	- the number of coded chars minus one
+ *	- the chars themselves if there are few of them, a bitmap otherwise
+ *	- the code length of every coded char, in char order, two per byte
+ */
+size_t canon_write(uint8_t lens[ASCII_SIZE], uint8_t *buf)
+{
+	size_t pos;
+	int nsyms, k;
+	int i;
+
+	nsyms = 0;
+	for (i = 0; i < ASCII_SIZE; i++)
+		if (lens[i] > 0)
+			nsyms++;
+	if (nsyms == 0)
+		return 0;
+
+	buf[0] = nsyms - 1;
+	pos = 1;
+	if (nsyms < LIST_MAX) {
+		for (i = 0; i < ASCII_SIZE; i++)
+			if (lens[i] > 0)
+				buf[pos++] = i;
+	} else {
+		memset(&buf[pos], 0, ASCII_SIZE / 8);
+		for (i = 0; i < ASCII_SIZE; i++)
+			if (lens[i] > 0)
+				buf[pos + i / 8] |= 1 << (i % 8);
+		pos += ASCII_SIZE / 8;
+	}
+
+	k = 0;
+	for (i = 0; i < ASCII_SIZE; i++) {
+		if (lens[i] == 0)
+			continue;
+		if (k % 2 == 0)
+			buf[pos] = lens[i] << 4;
+		else
+			buf[pos++] |= lens[i];
+		k++;
+	}
+	if (k % 2 == 1)
+		pos++;
+
+	return pos;
+}
+
+/* Reads the code lengths written by canon_write from the n bytes at buf */
+enum huf_result canon_read(uint8_t lens[ASCII_SIZE], const uint8_t *buf,
+		size_t n, size_t *used)
+{
+	uint8_t syms[ASCII_SIZE];
+	size_t pos;
+	int nsyms;
+	int i;
+
+	if (n < 1)
+		return HUF_ERROR_END_OF_FILE;
+	nsyms = buf[0] + 1;
+	pos = 1;
+
+	if (nsyms < LIST_MAX) {
+		if (n < pos + nsyms)
+			return HUF_ERROR_END_OF_FILE;
+		for (i = 0; i < nsyms; i++)
+			syms[i] = buf[pos++];
+	} else {
+		if (n < pos + ASCII_SIZE / 8)
+			return HUF_ERROR_END_OF_FILE;
+		nsyms = 0;
+		for (i = 0; i < ASCII_SIZE; i++)
+			if (buf[pos + i / 8] & (1 << (i % 8)))
+				syms[nsyms++] = i;
+		pos += ASCII_SIZE / 8;
+	}
+
+	if (n < pos + (nsyms + 1) / 2)
+		return HUF_ERROR_END_OF_FILE;
+
+	memset(lens, 0, ASCII_SIZE * sizeof(uint8_t));
+	for (i = 0; i < nsyms; i++) {
+		if (i % 2 == 0)
+			lens[syms[i]] = buf[pos] >> 4;
+		else
+			lens[syms[i]] = buf[pos++] & 0x0f;
+		if (lens[syms[i]] == 0)
+			return HUF_ERROR_INVALID_RESOURCE;
+	}
+	if (nsyms % 2 == 1)
+		pos++;
+	*used = pos;
+
+	return check_kraft(lens);
+}
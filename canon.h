@@ -0,0 +1,42 @@
+/*
+ * Canonical Huffman codes. Only the code length of every char is stored in
+ * the file, the codes themselves are assigned in (length, char) order, so
+ * both sides rebuild the same tree from the lengths alone.
+ */
+
+#ifndef CANON_H
+#define CANON_H
+
+#include "common.h"
+
+#define MIN_CODE_LEN		(8)	/* 2^8 codes fit all the chars */
+#define MAX_CODE_LEN		(15)
+#define DEFAULT_CODE_LEN	(11)	/* the decoder table resolves them all */
+#define FAST_CODE_LEN		(14)	/* room for the chars a sample missed */
+
+/* Largest serialized table: count, bitmap and a nibble for every char */
+#define CANON_TABLE_MAX		(1 + ASCII_SIZE / 8 + ASCII_SIZE / 2)
+
+/*
+ * Computes the optimal code lengths for freq, then lowers the deepest ones
+ * until none is longer than max_len. Nothing is allocated, the tree is built
+ * in place over the sorted counts.
+ */
+enum huf_result canon_lengths(uint32_t freq[ASCII_SIZE], int max_len,
+		uint8_t lens[ASCII_SIZE]);
+
+/* Assigns the canonical codes for the code lengths */
+void canon_codes(uint8_t lens[ASCII_SIZE], struct huf_code codes[ASCII_SIZE]);
+
+/* Builds the Huffman tree matching the canonical codes for the decoder */
+enum huf_result canon_tree(const uint8_t lens[ASCII_SIZE],
+		struct huf_node *huftree, uint16_t *huftree_size);
+
+/* Serializes the code lengths into buf, returns the number of bytes used */
+size_t canon_write(uint8_t lens[ASCII_SIZE], uint8_t *buf);
+
+/* Reads the code lengths written by canon_write from the n bytes at buf */
+enum huf_result canon_read(uint8_t lens[ASCII_SIZE], const uint8_t *buf,
+		size_t n, size_t *used);
+
+#endif	/* #ifndef CANON_H */
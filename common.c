@@ -2,6 +2,42 @@
 
 #define PRINTERR(msg)	fprintf(stderr, "[ ERROR ] %s", msg)
 
+static uint64_t alloc_count;
+
+/*
+ * The allocator of the library, which counts the allocations for --stats.
+ * What they return is freed with free.
+ */
+void *huf_malloc(size_t size)
+{
+	__atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+	return malloc(size);
+}
+
+void *huf_calloc(size_t nmemb, size_t size)
+{
+	__atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+	return calloc(nmemb, size);
+}
+
+void *huf_realloc(void *ptr, size_t size)
+{
+	__atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+	return realloc(ptr, size);
+}
+
+int huf_memalign(void **memptr, size_t alignment, size_t size)
+{
+	__atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+	return posix_memalign(memptr, alignment, size);
+}
+
+/* Allocations made through the library so far, by all threads */
+uint64_t huf_alloc_count(void)
+{
+	return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+}
+
 /* Prints the message associated with the defined result codes */
 void huf_print_result(enum huf_result msg)
 {
@@ -26,6 +62,12 @@ void huf_print_result(enum huf_result msg)
 		PRINTERR("Queue size exceeded.\n");
 	else if (msg == HUF_ERROR_UNKNOWN_OPTION)
 		PRINTERR("Unknown option.\n");
+	else if (msg == HUF_ERROR_BUFFER_SIZE)
+		PRINTERR("Output buffer too small.\n");
+	else if (msg == HUF_ERROR_CHECKSUM)
+		PRINTERR("Checksum mismatch, the data is corrupted.\n");
+	else if (msg == HUF_ERROR_UNSUPPORTED)
+		PRINTERR("Format not supported here.\n");
 	else if (msg == HUF_ERROR_UNKNOWN_ERROR)
 		PRINTERR("Unknown error occured.\n");
 }
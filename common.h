@@ -11,19 +11,22 @@
 
 #define ASCII_SIZE		(256)
 #define NO_CHILD		(-1)
-#define TEXT_SIZE		(100)
 #define NOT_VISITED		(0)
 #define IS_VISITED		(1)
-#define LEFT_CHILD_CODE		('0')
-#define RIGHT_CHILD_CODE	('1')
 #define WRITE_SIZE		(8)		/* bits to write at a time */
-/* 
- * Maximum huftree size 2^16 - 1, max level = log2(2^16 - 1 + 1) = 16.
- * We start creating the code at level 1, so we only need 15 digits. But we
- * also need the null terminating character for the code string, therefore the
- * code is 16 characters in size.
+#define ENC_BUF_SIZE		(1 << 20)	/* compressed bytes to write at a time */
+/*
+ * The Huffman tree is built from at most 2^32 - 1 chars, and a leaf at depth
+ * d needs at least Fibonacci(d + 2) of them, so no code is longer than 46
+ * bits and it always fits in 64.
  */
-#define CODE_SIZE	(16)
+#define MAX_TREE_CODE_LEN	(64)
+
+/*
+ * The library is built with hidden symbols, only the functions marked with
+ * HUF_API are exported by libhuffman.so
+ */
+#define HUF_API		__attribute__((visibility("default")))
 
 /* Defined when compiling */
 #ifdef DEBUG
@@ -53,6 +56,9 @@ enum huf_result {
 	HUF_ERROR_QUEUE_NOT_INITIALIZED	= 8,
 	HUF_ERROR_QUEUE_SIZE_EXCEEDED	= 9,
 	HUF_ERROR_UNKNOWN_OPTION	= 10,	
+	HUF_ERROR_BUFFER_SIZE		= 11,	/* Output buffer too small */
+	HUF_ERROR_CHECKSUM		= 12,	/* Data doesn't match its checksum */
+	HUF_ERROR_UNSUPPORTED		= 13,	/* Format not handled by the call */
 	HUF_ERROR_UNKNOWN_ERROR		= 99,	
 };
 
@@ -63,6 +69,12 @@ struct __attribute__((__packed__)) huf_node {
 	int16_t right;
 };
 
+/* Code of a char, its len low bits are written most significant first */
+struct huf_code {
+	uint64_t code;
+	uint8_t len;
+};
+
 /* Temporary Huffman node necessary for building the tree in memory */
 struct __attribute__((aligned)) tmp_huf_node {
 	unsigned int freq;			/* number of apparitions */
@@ -71,8 +83,20 @@ struct __attribute__((aligned)) tmp_huf_node {
 	int16_t right;
 };
 
+/*
+ * The allocator of the library, which counts the allocations for --stats.
+ * What they return is freed with free.
+ */
+void *huf_malloc(size_t size);
+void *huf_calloc(size_t nmemb, size_t size);
+void *huf_realloc(void *ptr, size_t size);
+int huf_memalign(void **memptr, size_t alignment, size_t size);
+
+/* Allocations made through the library so far, by all threads */
+uint64_t huf_alloc_count(void);
+
 /* Prints the messages associated with the result codes */
-void huf_print_result(enum huf_result msg);
+HUF_API void huf_print_result(enum huf_result msg);
 
 enum huf_result print_tmp_huftree(struct tmp_huf_node *huf, uint16_t size);
 enum huf_result print_huftree(struct huf_node *huf, uint16_t size);
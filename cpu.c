@@ -0,0 +1,61 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "cpu.h"
+
+/* The name of every CPU_ flag, in their order */
+static const char *const feature_names[] = {"bmi2", "avx2", "sse4.2"};
+
+#define CPU_FEATURES	(int) (sizeof(feature_names) / sizeof(feature_names[0]))
+
+static pthread_once_t cpu_once = PTHREAD_ONCE_INIT;
+static int features;
+static char name[32];
+
+static void cpu_detect(void)
+{
+	const char *allowed;
+	int i;
+
+#ifdef CPU_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("bmi2"))
+		features |= CPU_BMI2;
+	if (__builtin_cpu_supports("avx2"))
+		features |= CPU_AVX2;
+	if (__builtin_cpu_supports("sse4.2"))
+		features |= CPU_SSE42;
+#endif
+
+	allowed = getenv("HUF_CPU");
+	for (i = 0; i < CPU_FEATURES; i++)
+		if (allowed != NULL && strstr(allowed, feature_names[i]) == NULL)
+			features &= ~(1 << i);
+
+	strcpy(name, "portable");
+	for (i = 0; i < CPU_FEATURES; i++) {
+		if (!(features & (1 << i)))
+			continue;
+		if (strcmp(name, "portable") == 0)
+			name[0] = '\0';
+		else
+			strcat(name, "+");
+		strcat(name, feature_names[i]);
+	}
+}
+
+/* The features usable for the variants, a mask of CPU_ flags */
+int cpu_features(void)
+{
+	pthread_once(&cpu_once, cpu_detect);
+
+	return features;
+}
+
+/* Names the features usable, "portable" if none is */
+const char *cpu_name(void)
+{
+	pthread_once(&cpu_once, cpu_detect);
+
+	return name;
+}
@@ -0,0 +1,33 @@
+/*
+ * Features of the processor the program runs on, read once with CPUID. The
+ * loops doing most of the bit work are built a second time for the features
+ * they gain from, the decoder lookups and the code packing for BMI2, the
+ * histogram for AVX2. The variant run is picked from these, the portable one
+ * serving every other processor.
+ *
+ * Setting HUF_CPU to the features to use, like "bmi2,avx2" or "none", limits
+ * the variants picked to those, so all of them can be run on the same
+ * machine.
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+#include "common.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86
+#define CPU_TARGET(features)	__attribute__((target(features)))
+#endif
+
+#define CPU_BMI2		(1 << 0)	/* shlx, shrx, bzhi */
+#define CPU_AVX2		(1 << 1)
+#define CPU_SSE42		(1 << 2)	/* crc32 */
+
+/* The features usable for the variants, a mask of CPU_ flags */
+int cpu_features(void);
+
+/* Names the features usable, "portable" if none is */
+const char *cpu_name(void);
+
+#endif	/* #ifndef CPU_H */
@@ -0,0 +1,156 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "crc.h"
+#include "cpu.h"
+#include "frame.h"
+
+#if defined(CPU_X86) && defined(__x86_64__)
+#define CRC_SSE42
+#include <nmmintrin.h>
+#endif
+
+/*
+ * The crc32 instruction takes 3 cycles, and issues every cycle. Blocks of at
+ * least CRC_LANES_MIN bytes are cut in three lanes, each with a CRC of its
+ * own, which are joined at the end.
+ */
+#define CRC_LANES		(3)
+#define CRC_LANES_MIN		(1 << 12)
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+/* tables[k][b] is the CRC of b followed by k zero bytes */
+static uint32_t tables[8][ASCII_SIZE];
+
+/* x2n[k] is x^(2^k) modulo the polynomial */
+static uint32_t x2n[32];
+
+/* a * b modulo the polynomial, both reflected */
+static uint32_t mult_mod(uint32_t a, uint32_t b)
+{
+	uint32_t m, p;
+
+	m = (uint32_t) 1 << 31;
+	p = 0;
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+	}
+
+	return p;
+}
+
+/*
+ * The CRC computed over crc followed by n zero bytes, without the
+ * inversions, which is what crc adds to the CRC of the n bytes that follow
+ */
+static uint32_t crc_shift(uint32_t crc, size_t n)
+{
+	uint32_t p;
+	int k;
+
+	p = (uint32_t) 1 << 31;
+	for (k = 3; n > 0; n >>= 1, k++)
+		if (n & 1)
+			p = mult_mod(x2n[k & 31], p);
+
+	return mult_mod(p, crc);
+}
+
+static void init_tables(void)
+{
+	uint32_t c;
+	int b, k;
+
+	x2n[0] = (uint32_t) 1 << 30;
+	for (k = 1; k < 32; k++)
+		x2n[k] = mult_mod(x2n[k - 1], x2n[k - 1]);
+
+	for (b = 0; b < ASCII_SIZE; b++) {
+		c = b;
+		for (k = 0; k < 8; k++)
+			c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+		tables[0][b] = c;
+	}
+	for (k = 1; k < 8; k++)
+		for (b = 0; b < ASCII_SIZE; b++)
+			tables[k][b] = (tables[k - 1][b] >> 8) ^
+				tables[0][tables[k - 1][b] & 0xff];
+}
+
+static uint32_t crc_slice8(uint32_t crc, const uint8_t *p, size_t n)
+{
+	uint64_t w;
+
+	pthread_once(&tables_once, init_tables);
+	for (; n >= 8; n -= 8, p += 8) {
+		w = get_le64(p) ^ crc;
+		crc = tables[7][w & 0xff] ^ tables[6][(w >> 8) & 0xff] ^
+			tables[5][(w >> 16) & 0xff] ^
+			tables[4][(w >> 24) & 0xff] ^
+			tables[3][(w >> 32) & 0xff] ^
+			tables[2][(w >> 40) & 0xff] ^
+			tables[1][(w >> 48) & 0xff] ^ tables[0][w >> 56];
+	}
+	for (; n > 0; n--, p++)
+		crc = (crc >> 8) ^ tables[0][(crc ^ *p) & 0xff];
+
+	return crc;
+}
+
+#ifdef CRC_SSE42
+CPU_TARGET("sse4.2")
+static uint32_t crc_sse42(uint32_t crc, const uint8_t *p, size_t n)
+{
+	uint64_t c = crc, c1, c2, w, w1, w2;
+	size_t lane, i;
+
+	/* The lanes are computed together, each from a CRC of 0 */
+	if (n >= CRC_LANES_MIN) {
+		pthread_once(&tables_once, init_tables);
+		lane = n / CRC_LANES & ~(size_t) 7;
+		c1 = 0;
+		c2 = 0;
+		for (i = 0; i < lane; i += 8) {
+			memcpy(&w, &p[i], sizeof(uint64_t));
+			memcpy(&w1, &p[lane + i], sizeof(uint64_t));
+			memcpy(&w2, &p[2 * lane + i], sizeof(uint64_t));
+			c = _mm_crc32_u64(c, w);
+			c1 = _mm_crc32_u64(c1, w1);
+			c2 = _mm_crc32_u64(c2, w2);
+		}
+		c = crc_shift(c, lane) ^ c1;
+		c = crc_shift(c, lane) ^ c2;
+		p += CRC_LANES * lane;
+		n -= CRC_LANES * lane;
+	}
+
+	for (; n >= 8; n -= 8, p += 8) {
+		memcpy(&w, p, sizeof(uint64_t));
+		c = _mm_crc32_u64(c, w);
+	}
+	for (; n > 0; n--, p++)
+		c = _mm_crc32_u8(c, *p);
+
+	return c;
+}
+#endif
+
+/* CRC32C of the n bytes at src following the bytes crc was computed on */
+uint32_t crc32c(uint32_t crc, const void *src, size_t n)
+{
+	const uint8_t *p = (const uint8_t *) src;
+
+#ifdef CRC_SSE42
+	if (cpu_features() & CPU_SSE42)
+		return ~crc_sse42(~crc, p, n);
+#endif
+
+	return ~crc_slice8(~crc, p, n);
+}
@@ -0,0 +1,18 @@
+/*
+ * CRC32C, the Castagnoli polynomial, as computed by the crc32 instruction of
+ * SSE 4.2, over three parts of the bytes at once. Other processors go
+ * through the slice-by-8 tables, which fold 8 bytes at a time with a lookup
+ * per byte.
+ */
+
+#ifndef CRC_H
+#define CRC_H
+
+#include "common.h"
+
+#define CRC32C_POLY		(0x82f63b78)	/* reflected */
+
+/* CRC32C of the n bytes at src following the bytes crc was computed on */
+uint32_t crc32c(uint32_t crc, const void *src, size_t n);
+
+#endif	/* #ifndef CRC_H */
@@ -0,0 +1,255 @@
+#include <string.h>
+
+#include "ctx.h"
+#include "hist.h"
+
+#define LOG_FRAC		HIST_LOG_FRAC	/* fraction bits of the estimates */
+#define ONE_BIT			(1 << LOG_FRAC)
+#define KMEANS_ROUNDS		(4)
+#define SYMS_LISTED		(ASCII_SIZE / 8)	/* as in canon_write */
+
+/* Estimated code length of every char in every table */
+struct ctx_bits {
+	uint32_t len[CTX_MAX_TABLES][ASCII_SIZE];
+};
+
+/*
+ * The code length of a char is about log2(total / count), no less than a
+ * bit. A char missing from the table would need a longer code than any.
+ */
+static void table_bits(const uint32_t freq[ASCII_SIZE], uint32_t len[ASCII_SIZE])
+{
+	uint32_t total, log_total;
+	int i;
+
+	total = 0;
+	for (i = 0; i < ASCII_SIZE; i++)
+		total += freq[i];
+	log_total = hist_log2(total > 0 ? total : 1);
+
+	for (i = 0; i < ASCII_SIZE; i++) {
+		if (freq[i] == 0)
+			len[i] = log_total + ONE_BIT;
+		else
+			len[i] = log_total - hist_log2(freq[i]);
+		if (len[i] < ONE_BIT)
+			len[i] = ONE_BIT;
+	}
+}
+
+/* Bits of the table as written by canon_write */
+static uint64_t table_cost(const uint32_t freq[ASCII_SIZE])
+{
+	uint64_t nsyms = 0;
+	int i;
+
+	for (i = 0; i < ASCII_SIZE; i++)
+		if (freq[i] > 0)
+			nsyms++;
+
+	return 8 * (1 + (nsyms < SYMS_LISTED ? nsyms : SYMS_LISTED) +
+			(nsyms + 1) / 2);
+}
+
+/* Bits of the chars following context c with the code lengths len */
+static uint64_t row_cost(const struct ctx_model *m, int c,
+		const uint32_t len[ASCII_SIZE])
+{
+	uint64_t cost = 0;
+	int i, s;
+
+	for (i = 0; i < m->nsyms[c]; i++) {
+		s = m->syms[c][i];
+		cost += (uint64_t) m->freq[c][s] * len[s];
+	}
+
+	return cost;
+}
+
+/* Sums the rows of every table, dropping the tables left without any */
+static void count_tables(struct ctx_model *m)
+{
+	uint8_t renum[CTX_MAX_TABLES];
+	int used[CTX_MAX_TABLES] = {0};
+	int c, t, i;
+
+	for (c = 0; c < ASCII_SIZE; c++)
+		if (m->nsyms[c] > 0)
+			used[m->map[c]] = 1;
+
+	t = 0;
+	for (i = 0; i < m->tables; i++) {
+		renum[i] = t;
+		t += used[i];
+	}
+	m->tables = t > 0 ? t : 1;
+
+	memset(m->tfreq, 0, sizeof(m->tfreq));
+	for (c = 0; c < ASCII_SIZE; c++) {
+		if (m->nsyms[c] == 0) {
+			m->map[c] = 0;
+			continue;
+		}
+		m->map[c] = renum[m->map[c]];
+		for (i = 0; i < m->nsyms[c]; i++)
+			m->tfreq[m->map[c]][m->syms[c][i]] +=
+				m->freq[c][m->syms[c][i]];
+	}
+}
+
+/* Estimated size of the block in bits, tables and map included */
+static uint64_t model_cost(const struct ctx_model *m, struct ctx_bits *b)
+{
+	uint64_t cost = 0;
+	int c, t;
+
+	for (t = 0; t < m->tables; t++) {
+		table_bits(m->tfreq[t], b->len[t]);
+		cost += table_cost(m->tfreq[t]) << LOG_FRAC;
+	}
+	for (c = 0; c < ASCII_SIZE; c++)
+		if (m->nsyms[c] > 0)
+			cost += row_cost(m, c, b->len[m->map[c]]);
+	if (m->tables > 1)
+		cost += (uint64_t) (8 * CTX_MAP_SIZE) << LOG_FRAC;
+
+	return cost;
+}
+
+/* Moves every context to the table coding its chars in the fewest bits */
+static void assign(struct ctx_model *m, struct ctx_bits *b)
+{
+	uint64_t cost, best;
+	int c, t;
+
+	for (c = 0; c < ASCII_SIZE; c++) {
+		if (m->nsyms[c] == 0)
+			continue;
+
+		best = row_cost(m, c, b->len[m->map[c]]);
+		for (t = 0; t < m->tables; t++) {
+			cost = row_cost(m, c, b->len[t]);
+			if (cost < best) {
+				best = cost;
+				m->map[c] = t;
+			}
+		}
+	}
+}
+
+/*
+ * The context losing the most bits to the table it shares, against a table
+ * of its own, or -1 if none does
+ */
+static int worst_context(const struct ctx_model *m, struct ctx_bits *b,
+		const uint64_t self[ASCII_SIZE])
+{
+	uint64_t cost, loss = 0;
+	int c, worst = -1;
+
+	for (c = 0; c < ASCII_SIZE; c++) {
+		if (m->nsyms[c] == 0)
+			continue;
+
+		cost = row_cost(m, c, b->len[m->map[c]]);
+		if (cost > self[c] && cost - self[c] > loss) {
+			loss = cost - self[c];
+			worst = c;
+		}
+	}
+
+	return worst;
+}
+
+/*
+ * Groups the rows of m->freq into at most max_tables clusters, filling the
+ * map and the counts of every table. A single table holds the counts of the
+ * whole block.
+ */
+void ctx_cluster(struct ctx_model *m, int max_tables)
+{
+	struct ctx_bits b;
+	uint8_t best_map[ASCII_SIZE];
+	uint64_t self[ASCII_SIZE];
+	uint32_t len[ASCII_SIZE];
+	uint64_t cost, best_cost;
+	int best_tables, c, s, i, seed;
+
+	/* The chars of every row, and what it costs with its own table */
+	for (c = 0; c < ASCII_SIZE; c++) {
+		m->nsyms[c] = 0;
+		for (s = 0; s < ASCII_SIZE; s++)
+			if (m->freq[c][s] > 0)
+				m->syms[c][m->nsyms[c]++] = s;
+		if (m->nsyms[c] > 0) {
+			table_bits(m->freq[c], len);
+			self[c] = row_cost(m, c, len);
+		}
+	}
+
+	memset(m->map, 0, ASCII_SIZE);
+	m->tables = 1;
+	count_tables(m);
+	best_cost = model_cost(m, &b);
+	best_tables = 1;
+	memcpy(best_map, m->map, ASCII_SIZE);
+
+	while (m->tables < max_tables) {
+		seed = worst_context(m, &b, self);
+		if (seed < 0)
+			break;
+		m->map[seed] = m->tables++;
+
+		for (i = 0; i < KMEANS_ROUNDS; i++) {
+			count_tables(m);
+			model_cost(m, &b);
+			assign(m, &b);
+		}
+		count_tables(m);
+		cost = model_cost(m, &b);
+
+		/* Another table has to pay for itself */
+		if (cost >= best_cost)
+			break;
+		best_cost = cost;
+		best_tables = m->tables;
+		memcpy(best_map, m->map, ASCII_SIZE);
+	}
+
+	memcpy(m->map, best_map, ASCII_SIZE);
+	m->tables = best_tables;
+	count_tables(m);
+}
+
+/* Serializes the map of the tables, CTX_MAP_SIZE bytes */
+void ctx_write_map(const struct ctx_model *m, uint8_t *buf)
+{
+	int c;
+
+	buf[0] = m->tables - 1;
+	for (c = 0; c < ASCII_SIZE; c += 2)
+		buf[1 + c / 2] = m->map[c] | (m->map[c + 1] << 4);
+}
+
+/* Reads the map written by ctx_write_map from the n bytes at buf */
+enum huf_result ctx_read_map(uint8_t map[ASCII_SIZE], int *tables,
+		const uint8_t *buf, size_t n)
+{
+	int c;
+
+	if (n < CTX_MAP_SIZE)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	*tables = buf[0] + 1;
+	if (*tables > CTX_MAX_TABLES)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	for (c = 0; c < ASCII_SIZE; c += 2) {
+		map[c] = buf[1 + c / 2] & 0x0f;
+		map[c + 1] = buf[1 + c / 2] >> 4;
+		if (map[c] >= *tables || map[c + 1] >= *tables)
+			return HUF_ERROR_INVALID_RESOURCE;
+	}
+
+	return HUF_SUCCESS;
+}
@@ -0,0 +1,48 @@
+/*
+ * Order-1 context modeling. Every char is coded with the table picked by the
+ * char before it, the preceding chars being grouped into at most
+ * CTX_MAX_TABLES clusters followed by similar chars, so a block carries a
+ * few code tables instead of one per context.
+ *
+ * The clusters are found by k-means over the pair counts of the block, the
+ * distance of a context to a cluster being the bits its chars would take
+ * with the code of the cluster, as estimated from the counts. Clusters are
+ * added one at a time, seeded by the context served worst, for as long as
+ * the estimated size, tables included, goes down.
+ *
+ * The map is stored as the number of tables less one, then a nibble for
+ * every preceding char, the even ones in the low half of the byte.
+ */
+
+#ifndef CTX_H
+#define CTX_H
+
+#include "common.h"
+
+#define CTX_MAX_TABLES		(16)
+#define CTX_MAP_SIZE		(1 + ASCII_SIZE / 2)
+
+struct ctx_model {
+	uint32_t freq[ASCII_SIZE][ASCII_SIZE];	/* a row per preceding char */
+	uint8_t syms[ASCII_SIZE][ASCII_SIZE];	/* the chars counted in a row */
+	uint16_t nsyms[ASCII_SIZE];
+	uint8_t map[ASCII_SIZE];		/* the table of every context */
+	int tables;
+	uint32_t tfreq[CTX_MAX_TABLES][ASCII_SIZE];	/* counts of a table */
+};
+
+/*
+ * Groups the rows of m->freq into at most max_tables clusters, filling the
+ * map and the counts of every table. A single table holds the counts of the
+ * whole block.
+ */
+void ctx_cluster(struct ctx_model *m, int max_tables);
+
+/* Serializes the map of the tables, CTX_MAP_SIZE bytes */
+void ctx_write_map(const struct ctx_model *m, uint8_t *buf);
+
+/* Reads the map written by ctx_write_map from the n bytes at buf */
+enum huf_result ctx_read_map(uint8_t map[ASCII_SIZE], int *tables,
+		const uint8_t *buf, size_t n);
+
+#endif	/* #ifndef CTX_H */
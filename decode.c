@@ -0,0 +1,507 @@
+#include "decode.h"
+#include "block.h"
+#include "cpu.h"
+
+static inline int is_leaf(struct huf_node *huftree, int16_t node)
+{
+	return huftree[node].left == NO_CHILD && huftree[node].right == NO_CHILD;
+}
+
+/*
+ * Fills the table entries for the subtree rooted at node, which is reached
+ * by the first depth bits of code
+ */
+static enum huf_result fill_table(struct huf_decoder *d, int16_t node,
+		uint32_t code, int depth)
+{
+	struct huf_node *n;
+	enum huf_result r;
+	uint32_t first, last;
+
+	if (node < 0 || node >= d->tree_size)
+		return HUF_ERROR_INVALID_RESOURCE;
+	n = &d->tree[node];
+
+	/* Every index starting with the code of the leaf decodes to it */
+	if (is_leaf(d->tree, node)) {
+		if (depth == 0)
+			return HUF_ERROR_INVALID_RESOURCE;
+
+		first = code << (d->bits - depth);
+		last = first + (1 << (d->bits - depth));
+		for (; first < last; first++) {
+			d->table[first].sym = n->val;
+			d->table[first].len = depth;
+		}
+		return HUF_SUCCESS;
+	}
+
+	/* The code is longer than the table, the tree walk continues here */
+	if (depth == d->bits) {
+		d->table[code].sym = node;
+		d->table[code].len = 0;
+		d->long_codes = 1;
+		return HUF_SUCCESS;
+	}
+
+	r = fill_table(d, n->left, code << 1, depth + 1);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	return fill_table(d, n->right, (code << 1) | 1, depth + 1);
+}
+
+/* Depth of the deepest leaf under node, DEC_TABLE_BITS at most */
+static int tree_bits(struct huf_decoder *d, int16_t node, int depth)
+{
+	int left, right;
+
+	/* Bad nodes are left to fill_table */
+	if (node < 0 || node >= d->tree_size || depth == DEC_TABLE_BITS ||
+			is_leaf(d->tree, node))
+		return depth;
+
+	left = tree_bits(d, d->tree[node].left, depth + 1);
+	right = tree_bits(d, d->tree[node].right, depth + 1);
+
+	return left > right ? left : right;
+}
+
+/* Builds the lookup table for the Huffman tree */
+enum huf_result huf_decoder_init(struct huf_decoder *d,
+		struct huf_node *huftree, uint16_t huftree_size)
+{
+	return huf_decoder_init_bits(d, huftree, huftree_size, DEC_MIN_BITS);
+}
+
+/*
+ * Same as huf_decoder_init, the table being at least bits wide, so decoders
+ * used together share a width
+ */
+enum huf_result huf_decoder_init_bits(struct huf_decoder *d,
+		struct huf_node *huftree, uint16_t huftree_size, int bits)
+{
+	if (huftree == NULL || huftree_size < 2)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	d->tree = huftree;
+	d->tree_size = huftree_size;
+	d->long_codes = 0;
+
+	d->bits = tree_bits(d, 0, 0);
+	if (d->bits < bits)
+		d->bits = bits < DEC_TABLE_BITS ? bits : DEC_TABLE_BITS;
+	if (d->bits < DEC_MIN_BITS)
+		d->bits = DEC_MIN_BITS;
+
+	return fill_table(d, 0, 0, 0);
+}
+
+/* Follows the tree one bit at a time for codes longer than the table */
+static enum huf_result decode_long(struct huf_decoder *d,
+		struct bit_reader *br, int16_t node, uint8_t *c)
+{
+	do {
+		if (br->count < 1)
+			br_refill(br);
+		if (br->count < 1)
+			return HUF_ERROR_END_OF_FILE;
+
+		if (br_peek(br, 1) == 0)
+			node = d->tree[node].left;
+		else
+			node = d->tree[node].right;
+		br_consume(br, 1);
+
+		if (node < 0 || node >= d->tree_size)
+			return HUF_ERROR_INVALID_RESOURCE;
+	} while (!is_leaf(d->tree, node));
+
+	*c = d->tree[node].val;
+
+	return HUF_SUCCESS;
+}
+
+/* Decodes a single char, of any length */
+static inline enum huf_result decode_char(struct huf_decoder *d,
+		struct bit_reader *br, uint8_t *c)
+{
+	struct dec_entry e;
+	enum huf_result r;
+
+	if (br->count < d->bits)
+		br_refill(br);
+
+	e = d->table[br_peek(br, d->bits)];
+	if (e.len != 0) {
+		*c = e.sym;
+		br_consume(br, e.len);
+	} else {
+		br_consume(br, d->bits);
+		if (br->count < 0)
+			return HUF_ERROR_END_OF_FILE;
+		r = decode_long(d, br, e.sym, c);
+		if (r != HUF_SUCCESS)
+			return r;
+	}
+
+	/* Zeros are read past the end of the stream, the code was cut */
+	if (br->count < 0)
+		return HUF_ERROR_END_OF_FILE;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * The loops over the streams, and over the lookups of a round, have constant
+ * bounds in the kernels. Unrolled, the state of every stream is a variable
+ * of its own, which the compiler keeps in a register.
+ */
+#define DEC_UNROLL		_Pragma("GCC unroll 16")
+
+/*
+ * Rounds the streams can all take with fast refills, out of at most count
+ * chars. A refill loads at most 7 bytes and needs 8 left, as most load far
+ * less the rounds are counted again once taken.
+ */
+static inline __attribute__((always_inline)) size_t fast_rounds(
+		const struct bit_reader *br, int streams, int bits,
+		size_t count)
+{
+	size_t rounds, left;
+	int s;
+
+	rounds = count / DEC_PER_REFILL(bits);
+	DEC_UNROLL
+	for (s = 0; s < streams; s++) {
+		left = br[s].end - br[s].pos;
+		if (left < 8)
+			return 0;
+		if ((left - 8) / 7 + 1 < rounds)
+			rounds = (left - 8) / 7 + 1;
+	}
+
+	return rounds;
+}
+
+/*
+ * Copies the state of the n readers the rounds use, which the chars stored
+ * can't alias, so it stays in registers
+ */
+static inline __attribute__((always_inline)) void copy_readers(
+		struct bit_reader *dst, const struct bit_reader *src, int n)
+{
+	int s;
+
+	DEC_UNROLL
+	for (s = 0; s < n; s++) {
+		dst[s].bits = src[s].bits;
+		dst[s].count = src[s].count;
+		dst[s].pos = src[s].pos;
+		dst[s].end = src[s].end;
+	}
+}
+
+/*
+ * Decodes up to count chars from every stream into the segments of seg chars
+ * starting at out, DEC_PER_REFILL(bits) at a time, and returns how many. All
+ * the codes have to be resolved by the table, a whole round of lookups then
+ * fits in the bits of a single refill. The rounds stop before a stream needs
+ * the slow refill.
+ */
+static inline __attribute__((always_inline)) size_t decode_rounds(
+		const struct dec_entry *table, int bits,
+		struct bit_reader *br, int streams, uint8_t *out, size_t seg,
+		size_t count)
+{
+	struct bit_reader r[MAX_STREAMS];
+	struct dec_entry e;
+	size_t rounds, done, i;
+	int s, k;
+
+	copy_readers(r, br, streams);
+	done = 0;
+	while ((rounds = fast_rounds(r, streams, bits, count - done)) > 0) {
+		for (i = 0; i < rounds; i++) {
+			DEC_UNROLL
+			for (s = 0; s < streams; s++)
+				br_refill_fast(&r[s]);
+
+			DEC_UNROLL
+			for (k = 0; k < DEC_PER_REFILL(bits); k++) {
+				DEC_UNROLL
+				for (s = 0; s < streams; s++) {
+					e = table[br_peek(&r[s], bits)];
+					out[s * seg + k] = e.sym;
+					br_consume(&r[s], e.len);
+				}
+			}
+			out += DEC_PER_REFILL(bits);
+		}
+		done += rounds * DEC_PER_REFILL(bits);
+	}
+	copy_readers(br, r, streams);
+
+	return done;
+}
+
+/*
+ * Same as decode_rounds, the table of every lookup being the one of the
+ * char decoded before it in the same stream
+ */
+static inline __attribute__((always_inline)) size_t decode_ctx_rounds(
+		const struct dec_entry **table, int bits,
+		struct bit_reader *br, int streams, uint8_t *out, size_t seg,
+		uint8_t *prev, size_t count)
+{
+	struct bit_reader r[MAX_STREAMS];
+	uint8_t p[MAX_STREAMS];
+	struct dec_entry e;
+	size_t rounds, done, i;
+	int s, k;
+
+	copy_readers(r, br, streams);
+	DEC_UNROLL
+	for (s = 0; s < streams; s++)
+		p[s] = prev[s];
+
+	done = 0;
+	while ((rounds = fast_rounds(r, streams, bits, count - done)) > 0) {
+		for (i = 0; i < rounds; i++) {
+			DEC_UNROLL
+			for (s = 0; s < streams; s++)
+				br_refill_fast(&r[s]);
+
+			DEC_UNROLL
+			for (k = 0; k < DEC_PER_REFILL(bits); k++) {
+				DEC_UNROLL
+				for (s = 0; s < streams; s++) {
+					e = table[p[s]][br_peek(&r[s],
+							bits)];
+					out[s * seg + k] = e.sym;
+					p[s] = e.sym;
+					br_consume(&r[s], e.len);
+				}
+			}
+			out += DEC_PER_REFILL(bits);
+		}
+		done += rounds * DEC_PER_REFILL(bits);
+	}
+	copy_readers(br, r, streams);
+	DEC_UNROLL
+	for (s = 0; s < streams; s++)
+		prev[s] = p[s];
+
+	return done;
+}
+
+/*
+ * The rounds for a table width, with the width and the stream count as
+ * constants. The lookups of a round are then unrolled, with no loop counter
+ * taking a register from the streams, and the peeks shift by an immediate,
+ * about a tenth faster than rounds taking the width as an argument. Every
+ * variant is built with the target attributes attr.
+ */
+#define DECODE_KERNELS(variant, bits, attr)				\
+attr static size_t decode_rounds_##variant##_##bits(			\
+		const struct dec_entry *table, struct bit_reader *br,	\
+		int streams, uint8_t *out, size_t seg, size_t count)	\
+{									\
+	if (streams == 1)						\
+		return decode_rounds(table, bits, br, 1, out, seg,	\
+				count);					\
+	else if (streams == 2)						\
+		return decode_rounds(table, bits, br, 2, out, seg,	\
+				count);					\
+	else if (streams == 4)						\
+		return decode_rounds(table, bits, br, 4, out, seg,	\
+				count);					\
+	else								\
+		return decode_rounds(table, bits, br, 8, out, seg,	\
+				count);					\
+}									\
+									\
+attr static size_t decode_ctx_rounds_##variant##_##bits(		\
+		const struct dec_entry **table, struct bit_reader *br,	\
+		int streams, uint8_t *out, size_t seg, uint8_t *prev,	\
+		size_t count)						\
+{									\
+	if (streams == 1)						\
+		return decode_ctx_rounds(table, bits, br, 1, out, seg,	\
+				prev, count);				\
+	else if (streams == 2)						\
+		return decode_ctx_rounds(table, bits, br, 2, out, seg,	\
+				prev, count);				\
+	else if (streams == 4)						\
+		return decode_ctx_rounds(table, bits, br, 4, out, seg,	\
+				prev, count);				\
+	else								\
+		return decode_ctx_rounds(table, bits, br, 8, out, seg,	\
+				prev, count);				\
+}
+
+#define DECODE_VARIANT(variant, attr)					\
+	DECODE_KERNELS(variant, 6, attr)				\
+	DECODE_KERNELS(variant, 7, attr)				\
+	DECODE_KERNELS(variant, 8, attr)				\
+	DECODE_KERNELS(variant, 9, attr)				\
+	DECODE_KERNELS(variant, 10, attr)				\
+	DECODE_KERNELS(variant, 11, attr)
+
+struct dec_kernel {
+	size_t (*rounds)(const struct dec_entry *table, struct bit_reader *br,
+			int streams, uint8_t *out, size_t seg, size_t count);
+	size_t (*ctx_rounds)(const struct dec_entry **table,
+			struct bit_reader *br, int streams, uint8_t *out,
+			size_t seg, uint8_t *prev, size_t count);
+};
+
+#define DEC_KERNEL(variant, bits)					\
+	[bits] = {decode_rounds_##variant##_##bits,			\
+		decode_ctx_rounds_##variant##_##bits}
+
+/* The kernels of a variant, indexed by the width of the table */
+#define DEC_KERNEL_TABLE(variant)					\
+static const struct dec_kernel						\
+		kernels_##variant[DEC_TABLE_BITS + 1] = {		\
+	DEC_KERNEL(variant, 6),						\
+	DEC_KERNEL(variant, 7),						\
+	DEC_KERNEL(variant, 8),						\
+	DEC_KERNEL(variant, 9),						\
+	DEC_KERNEL(variant, 10),					\
+	DEC_KERNEL(variant, 11),					\
+};
+
+DECODE_VARIANT(portable, )
+DEC_KERNEL_TABLE(portable)
+
+#ifdef CPU_X86
+/* The shifts by the code lengths need no count register and leave the flags */
+DECODE_VARIANT(bmi2, CPU_TARGET("bmi2"))
+DEC_KERNEL_TABLE(bmi2)
+#endif
+
+/* The kernels of the variant the processor runs best */
+static const struct dec_kernel *dec_kernels(void)
+{
+#ifdef CPU_X86
+	if (cpu_features() & CPU_BMI2)
+		return kernels_bmi2;
+#endif
+
+	return kernels_portable;
+}
+
+/* Decodes n chars from the bit stream into out */
+enum huf_result huf_decode(struct huf_decoder *d, struct bit_reader *br,
+		uint8_t *out, size_t n)
+{
+	enum huf_result r;
+	size_t i, done;
+
+	done = 0;
+	if (!d->long_codes)
+		done = dec_kernels()[d->bits].rounds(d->table, br, 1, out, 0,
+				n);
+
+	for (i = done; i < n; i++) {
+		r = decode_char(d, br, &out[i]);
+		if (r != HUF_SUCCESS)
+			return r;
+	}
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Decodes n chars from the streams chars coding consecutive segments of out,
+ * as split by block_compress. The streams are advanced together, so the
+ * lookups in one of them don't wait on the others.
+ */
+enum huf_result huf_decode_streams(struct huf_decoder *d,
+		struct bit_reader *br, int streams, uint8_t *out, size_t n)
+{
+	uint8_t *seg_out[streams];
+	size_t seg_len[streams];
+	size_t seg, first, done;
+	enum huf_result r;
+	int s;
+
+	seg = (n + streams - 1) / streams;
+	for (s = 0; s < streams; s++) {
+		first = (size_t) s * seg < n ? (size_t) s * seg : n;
+		seg_out[s] = &out[first];
+		seg_len[s] = n - first < seg ? n - first : seg;
+	}
+
+	/* The last segment is the shortest, the others are all that long */
+	done = 0;
+	if (!d->long_codes)
+		done = dec_kernels()[d->bits].rounds(d->table, br, streams,
+				out, seg, seg_len[streams - 1]);
+
+	/* The rest of every segment, one char at a time */
+	for (s = 0; s < streams; s++) {
+		if (br[s].count < 0)
+			return HUF_ERROR_END_OF_FILE;
+		r = huf_decode(d, &br[s], &seg_out[s][done], seg_len[s] - done);
+		if (r != HUF_SUCCESS)
+			return r;
+	}
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Same as huf_decode_streams, every char being decoded with the decoder its
+ * preceding char maps to. The first char of every segment is preceded by a
+ * 0.
+ */
+enum huf_result huf_decode_ctx_streams(struct huf_decoder *dec,
+		const uint8_t map[ASCII_SIZE], struct bit_reader *br,
+		int streams, uint8_t *out, size_t n)
+{
+	const struct dec_entry *table[ASCII_SIZE];
+	uint8_t *seg_out[streams];
+	size_t seg_len[streams];
+	uint8_t prev[streams];
+	size_t seg, first, done, i;
+	enum huf_result r;
+	int long_codes, bits, s;
+
+	/* The rounds need every table to have the same width */
+	long_codes = 0;
+	bits = dec[map[0]].bits;
+	for (i = 0; i < ASCII_SIZE; i++) {
+		table[i] = dec[map[i]].table;
+		long_codes |= dec[map[i]].long_codes;
+		long_codes |= dec[map[i]].bits != bits;
+	}
+
+	seg = (n + streams - 1) / streams;
+	for (s = 0; s < streams; s++) {
+		first = (size_t) s * seg < n ? (size_t) s * seg : n;
+		seg_out[s] = &out[first];
+		seg_len[s] = n - first < seg ? n - first : seg;
+		prev[s] = 0;
+	}
+
+	done = 0;
+	if (!long_codes)
+		done = dec_kernels()[bits].ctx_rounds(table, br, streams,
+				out, seg, prev, seg_len[streams - 1]);
+
+	for (s = 0; s < streams; s++) {
+		if (br[s].count < 0)
+			return HUF_ERROR_END_OF_FILE;
+		for (i = done; i < seg_len[s]; i++) {
+			r = decode_char(&dec[map[prev[s]]], &br[s],
+					&seg_out[s][i]);
+			if (r != HUF_SUCCESS)
+				return r;
+			prev[s] = seg_out[s][i];
+		}
+	}
+
+	return HUF_SUCCESS;
+}
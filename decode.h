@@ -0,0 +1,68 @@
+/*
+ * Table driven Huffman decoder. The tree read from the file is turned into a
+ * lookup table indexed by the next DEC_TABLE_BITS bits of the stream, so all
+ * the codes up to that length are resolved with a single lookup. Longer codes
+ * fall back to walking the tree from the node the table stopped at.
+ *
+ * The table is only as wide as the longest code, so trees of short codes get
+ * a small table and a bit buffer refill serves more lookups. The rounds of
+ * lookups are generated for every width, and the decoder keeps the one of
+ * its table.
+ */
+
+#ifndef DECODE_H
+#define DECODE_H
+
+#include "common.h"
+#include "bitstream.h"
+
+#define DEC_TABLE_BITS		(11)	/* widest table */
+#define DEC_MIN_BITS		(6)	/* narrowest table */
+#define DEC_PER_REFILL(bits)	(56 / (bits))	/* lookups per refill */
+
+struct dec_entry {
+	uint16_t sym;		/* decoded char, or tree node for long codes */
+	uint8_t len;		/* code length, 0 if longer than the table */
+};
+
+struct huf_decoder {
+	struct dec_entry table[1 << DEC_TABLE_BITS];
+	struct huf_node *tree;
+	uint16_t tree_size;
+	int bits;		/* width of the table */
+	int long_codes;		/* some codes are longer than the table */
+};
+
+/* Builds the lookup table for the Huffman tree */
+enum huf_result huf_decoder_init(struct huf_decoder *d,
+		struct huf_node *huftree, uint16_t huftree_size);
+
+/*
+ * Same as huf_decoder_init, the table being at least bits wide, so decoders
+ * used together share a width
+ */
+enum huf_result huf_decoder_init_bits(struct huf_decoder *d,
+		struct huf_node *huftree, uint16_t huftree_size, int bits);
+
+/* Decodes n chars from the bit stream into out */
+enum huf_result huf_decode(struct huf_decoder *d, struct bit_reader *br,
+		uint8_t *out, size_t n);
+
+/*
+ * Decodes n chars from the streams chars coding consecutive segments of out,
+ * as split by block_compress. The streams are advanced together, so the
+ * lookups in one of them don't wait on the others.
+ */
+enum huf_result huf_decode_streams(struct huf_decoder *d,
+		struct bit_reader *br, int streams, uint8_t *out, size_t n);
+
+/*
+ * Same as huf_decode_streams, every char being decoded with the decoder its
+ * preceding char maps to. The first char of every segment is preceded by a
+ * 0.
+ */
+enum huf_result huf_decode_ctx_streams(struct huf_decoder *dec,
+		const uint8_t map[ASCII_SIZE], struct bit_reader *br,
+		int streams, uint8_t *out, size_t n);
+
+#endif	/* #ifndef DECODE_H */
@@ -0,0 +1,217 @@
+#include "encode.h"
+#include "cpu.h"
+
+/*
+ * Up to 7 bits stay pending after a flush, so 4 codes of at most 14 bits or
+ * 2 codes of at most 28 bits fit in the bit buffer before the next one
+ */
+#define QUAD_CODE_LEN		(14)
+#define PAIR_CODE_LEN		(28)
+#define HALF_CODE_LEN		(32)
+
+/* Codes longer than half the bit buffer are written in two halves */
+static inline __attribute__((always_inline)) void put_code(
+		struct bit_writer *bw, const struct huf_code *c)
+{
+	if (c->len > HALF_CODE_LEN) {
+		bw_put(bw, c->code >> HALF_CODE_LEN, c->len - HALF_CODE_LEN);
+		bw_flush(bw);
+		bw_put(bw, c->code & 0xffffffff, HALF_CODE_LEN);
+	} else {
+		bw_put(bw, c->code, c->len);
+	}
+}
+
+/*
+ * Appends c to the len bits of *code. The codes written together are joined
+ * first, away from the bits of the writer, which then take them at once.
+ */
+static inline __attribute__((always_inline)) void join_code(uint64_t *code,
+		int *len, const struct huf_code *c)
+{
+	*code = (*code << c->len) | c->code;
+	*len += c->len;
+}
+
+/*
+ * Stores the pending word and drains the buffer once it fills. The loops
+ * work on a copy of the bits, their count and the position of the writer,
+ * which the bytes stored can't alias, so they stay in registers. Only a
+ * drain goes through the writer itself.
+ */
+static inline __attribute__((always_inline)) void flush_copy(
+		struct bit_writer *bw, struct bit_writer *w)
+{
+	bw_flush(w);
+	if (w->pos >= w->limit) {
+		bw->bits = w->bits;
+		bw->count = w->count;
+		bw->pos = w->pos;
+		bw_drain(bw);
+		w->pos = bw->pos;
+	}
+}
+
+/* Copies what the loops update, the rest of w is left unset */
+static inline __attribute__((always_inline)) void copy_writer(
+		struct bit_writer *w, const struct bit_writer *bw)
+{
+	w->bits = bw->bits;
+	w->count = bw->count;
+	w->pos = bw->pos;
+	w->limit = bw->limit;
+}
+
+/* The packing loops of huf_encode, built once for every variant */
+static inline __attribute__((always_inline)) void encode(
+		struct bit_writer *bw, struct huf_code codes[ASCII_SIZE],
+		const uint8_t *src, size_t n)
+{
+	struct bit_writer w;
+	uint64_t code;
+	size_t i;
+	int max_len, len;
+
+	max_len = 0;
+	for (i = 0; i < ASCII_SIZE; i++)
+		if (codes[i].len > max_len)
+			max_len = codes[i].len;
+
+	copy_writer(&w, bw);
+	i = 0;
+	if (max_len <= QUAD_CODE_LEN) {
+		for (; i + 4 <= n; i += 4) {
+			code = codes[src[i]].code;
+			len = codes[src[i]].len;
+			join_code(&code, &len, &codes[src[i + 1]]);
+			join_code(&code, &len, &codes[src[i + 2]]);
+			join_code(&code, &len, &codes[src[i + 3]]);
+			bw_put(&w, code, len);
+			flush_copy(bw, &w);
+		}
+	} else if (max_len <= PAIR_CODE_LEN) {
+		for (; i + 2 <= n; i += 2) {
+			code = codes[src[i]].code;
+			len = codes[src[i]].len;
+			join_code(&code, &len, &codes[src[i + 1]]);
+			bw_put(&w, code, len);
+			flush_copy(bw, &w);
+		}
+	}
+
+	for (; i < n; i++) {
+		put_code(&w, &codes[src[i]]);
+		flush_copy(bw, &w);
+	}
+	bw->bits = w.bits;
+	bw->count = w.count;
+	bw->pos = w.pos;
+}
+
+/* The packing loops of huf_encode_ctx, built once for every variant */
+static inline __attribute__((always_inline)) void encode_ctx(
+		struct bit_writer *bw, struct huf_code codes[][ASCII_SIZE],
+		int tables, const uint8_t map[ASCII_SIZE], const uint8_t *src,
+		size_t n)
+{
+	struct huf_code *table[ASCII_SIZE];
+	struct bit_writer w;
+	uint64_t code;
+	uint8_t prev;
+	size_t i;
+	int max_len, len, t;
+
+	max_len = 0;
+	for (t = 0; t < tables; t++)
+		for (i = 0; i < ASCII_SIZE; i++)
+			if (codes[t][i].len > max_len)
+				max_len = codes[t][i].len;
+	for (i = 0; i < ASCII_SIZE; i++)
+		table[i] = codes[map[i]];
+
+	copy_writer(&w, bw);
+	i = 0;
+	prev = 0;
+	if (max_len <= QUAD_CODE_LEN) {
+		for (; i + 4 <= n; i += 4) {
+			code = table[prev][src[i]].code;
+			len = table[prev][src[i]].len;
+			join_code(&code, &len, &table[src[i]][src[i + 1]]);
+			join_code(&code, &len, &table[src[i + 1]][src[i + 2]]);
+			join_code(&code, &len, &table[src[i + 2]][src[i + 3]]);
+			bw_put(&w, code, len);
+			flush_copy(bw, &w);
+			prev = src[i + 3];
+		}
+	}
+
+	for (; i < n; i++) {
+		put_code(&w, &table[prev][src[i]]);
+		flush_copy(bw, &w);
+		prev = src[i];
+	}
+	bw->bits = w.bits;
+	bw->count = w.count;
+	bw->pos = w.pos;
+}
+
+static void encode_portable(struct bit_writer *bw,
+		struct huf_code codes[ASCII_SIZE], const uint8_t *src, size_t n)
+{
+	encode(bw, codes, src, n);
+}
+
+static void encode_ctx_portable(struct bit_writer *bw,
+		struct huf_code codes[][ASCII_SIZE], int tables,
+		const uint8_t map[ASCII_SIZE], const uint8_t *src, size_t n)
+{
+	encode_ctx(bw, codes, tables, map, src, n);
+}
+
+#ifdef CPU_X86
+/* Every code is shifted in by its length, shlx needs no count register */
+CPU_TARGET("bmi2")
+static void encode_bmi2(struct bit_writer *bw,
+		struct huf_code codes[ASCII_SIZE], const uint8_t *src, size_t n)
+{
+	encode(bw, codes, src, n);
+}
+
+CPU_TARGET("bmi2")
+static void encode_ctx_bmi2(struct bit_writer *bw,
+		struct huf_code codes[][ASCII_SIZE], int tables,
+		const uint8_t map[ASCII_SIZE], const uint8_t *src, size_t n)
+{
+	encode_ctx(bw, codes, tables, map, src, n);
+}
+#endif
+
+/* Writes the codes of the n chars at src */
+void huf_encode(struct bit_writer *bw, struct huf_code codes[ASCII_SIZE],
+		const uint8_t *src, size_t n)
+{
+#ifdef CPU_X86
+	if (cpu_features() & CPU_BMI2) {
+		encode_bmi2(bw, codes, src, n);
+		return;
+	}
+#endif
+	encode_portable(bw, codes, src, n);
+}
+
+/*
+ * Writes the codes of the n chars at src, every char with the codes of the
+ * table its preceding char maps to, the first one being preceded by a 0
+ */
+void huf_encode_ctx(struct bit_writer *bw,
+		struct huf_code codes[][ASCII_SIZE], int tables,
+		const uint8_t map[ASCII_SIZE], const uint8_t *src, size_t n)
+{
+#ifdef CPU_X86
+	if (cpu_features() & CPU_BMI2) {
+		encode_ctx_bmi2(bw, codes, tables, map, src, n);
+		return;
+	}
+#endif
+	encode_ctx_portable(bw, codes, tables, map, src, n);
+}
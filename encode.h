@@ -0,0 +1,25 @@
+/*
+ * Huffman encoder. The codes are packed into the 64-bit buffer of the bit
+ * writer, which is stored a whole word at a time, as many codes as fit
+ * between two stores.
+ */
+
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include "common.h"
+#include "bitstream.h"
+
+/* Writes the codes of the n chars at src */
+void huf_encode(struct bit_writer *bw, struct huf_code codes[ASCII_SIZE],
+		const uint8_t *src, size_t n);
+
+/*
+ * Writes the codes of the n chars at src, every char with the codes of the
+ * table its preceding char maps to, the first one being preceded by a 0
+ */
+void huf_encode_ctx(struct bit_writer *bw,
+		struct huf_code codes[][ASCII_SIZE], int tables,
+		const uint8_t map[ASCII_SIZE], const uint8_t *src, size_t n);
+
+#endif	/* #ifndef ENCODE_H */
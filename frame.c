@@ -0,0 +1,100 @@
+#include <string.h>
+
+#include "frame.h"
+
+/* Serializes the frame header, FRAME_HEADER_SIZE bytes */
+void frame_put_header(uint8_t *buf, struct frame_header *fh)
+{
+	memcpy(buf, HUF_MAGIC, HUF_MAGIC_SIZE);
+	buf[8] = fh->version;
+	buf[9] = fh->flags;
+	put_le16(&buf[10], 0);
+	put_le32(&buf[12], fh->block_size);
+	put_le64(&buf[16], fh->content_size);
+}
+
+/* Parses the FRAME_HEADER_SIZE bytes at buf */
+enum huf_result frame_get_header(const uint8_t *buf, struct frame_header *fh)
+{
+	if (memcmp(buf, HUF_MAGIC, HUF_MAGIC_SIZE) != 0)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	fh->version = buf[8];
+	fh->flags = buf[9];
+	fh->block_size = get_le32(&buf[12]);
+	fh->content_size = get_le64(&buf[16]);
+
+	if (fh->version != FRAME_VERSION)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	return HUF_SUCCESS;
+}
+
+/* Serializes the block header, returns the number of bytes used */
+size_t frame_put_block(uint8_t *buf, struct block_header *bh)
+{
+	buf[0] = bh->type;
+	if (bh->type == BLOCK_END)
+		return 1;
+
+	buf[1] = bh->flags;
+	put_le32(&buf[2], bh->raw_size);
+	put_le32(&buf[6], bh->comp_size);
+
+	return BLOCK_HEADER_SIZE;
+}
+
+/* Parses the block header bytes following the type byte at buf[0] */
+enum huf_result frame_get_block(const uint8_t *buf, struct block_header *bh)
+{
+	bh->type = buf[0];
+	bh->flags = buf[1];
+	bh->raw_size = get_le32(&buf[2]);
+	bh->comp_size = get_le32(&buf[6]);
+
+	if ((bh->type == BLOCK_HUF || bh->type == BLOCK_CTX ||
+				bh->type == BLOCK_REPEAT) &&
+			(bh->flags & ~(BLOCK_STREAMS_MASK | BLOCK_CHECKSUM)) == 0)
+		return HUF_SUCCESS;
+	if ((bh->type == BLOCK_RAW || bh->type == BLOCK_RLE) &&
+			(bh->flags & ~BLOCK_CHECKSUM) == 0)
+		return HUF_SUCCESS;
+	if (bh->type == BLOCK_ADAPTIVE && bh->flags == 0)
+		return HUF_SUCCESS;
+
+	return HUF_ERROR_INVALID_RESOURCE;
+}
+
+/* Serializes an index entry, INDEX_ENTRY_SIZE bytes */
+void frame_put_entry(uint8_t *buf, struct index_entry *e)
+{
+	put_le64(buf, e->raw_offset);
+	put_le64(&buf[8], e->comp_offset);
+}
+
+/* Parses the INDEX_ENTRY_SIZE bytes at buf */
+void frame_get_entry(const uint8_t *buf, struct index_entry *e)
+{
+	e->raw_offset = get_le64(buf);
+	e->comp_offset = get_le64(&buf[8]);
+}
+
+/* Serializes the index footer, INDEX_FOOTER_SIZE bytes */
+void frame_put_footer(uint8_t *buf, struct index_footer *ft)
+{
+	put_le64(buf, ft->raw_size);
+	put_le64(&buf[8], ft->blocks);
+	memcpy(&buf[16], HUF_INDEX_MAGIC, HUF_MAGIC_SIZE);
+}
+
+/* Parses the INDEX_FOOTER_SIZE bytes at buf */
+enum huf_result frame_get_footer(const uint8_t *buf, struct index_footer *ft)
+{
+	if (memcmp(&buf[16], HUF_INDEX_MAGIC, HUF_MAGIC_SIZE) != 0)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	ft->raw_size = get_le64(buf);
+	ft->blocks = get_le64(&buf[8]);
+
+	return HUF_SUCCESS;
+}
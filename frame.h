@@ -0,0 +1,139 @@
+/*
+ * Layout of the files that start with a magic number. The original format
+ * starts directly with the char count, its sixth byte is the high byte of a
+ * tree size that never goes over 511, so the first six bytes of the magic
+ * can't be mistaken for one.
+ *
+ *	frame header	magic, version, flags, block size, content size
+ *	block		type, flags, raw size, compressed size, payload
+ *			and, with BLOCK_CHECKSUM, the CRC32C of the raw chars
+ *	...
+ *	end		a single BLOCK_END type byte
+ *	index		only with FRAME_INDEX, see below
+ *
+ * The index lets a reader go straight to the block holding an offset of the
+ * text. It holds the text offset and the frame offset of every block header,
+ * then a footer with the text size, the number of blocks and the index
+ * magic, so it is found from the end of the file.
+ *
+ * All the integers are stored little endian.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "common.h"
+
+#define HUF_MAGIC		"\x89HUF\r\n\x1a\n"
+#define HUF_MAGIC_SIZE		(8)
+#define HUF_MAGIC_CHECK		(6)	/* bytes telling it from the old format */
+#define FRAME_VERSION		(1)
+#define FRAME_HEADER_SIZE	(24)
+#define BLOCK_HEADER_SIZE	(10)
+#define HUF_INDEX_MAGIC		"\x89HUFIDX\n"
+#define INDEX_ENTRY_SIZE	(16)
+#define INDEX_FOOTER_SIZE	(24)
+#define CHECKSUM_SIZE		(4)	/* CRC32C ending a block payload */
+
+/* Frame header flags */
+#define FRAME_CONTENT_SIZE	(1 << 0)	/* content_size is known */
+#define FRAME_INDEX		(1 << 1)	/* the index follows the end */
+#define FRAME_ADAPTIVE		(1 << 2)	/* BLOCK_ADAPTIVE blocks only */
+
+/* Block header flags */
+#define BLOCK_STREAMS_MASK	(0x03)		/* log2 of the substreams */
+#define BLOCK_CHECKSUM		(1 << 2)	/* the payload ends with a CRC */
+
+enum block_type {
+	BLOCK_END		= 0,
+	BLOCK_HUF		= 1,	/* canonical code lengths, bit stream */
+	BLOCK_ADAPTIVE		= 2,	/* bit stream, codes from the blocks before */
+	BLOCK_CTX		= 3,	/* code lengths per context cluster, streams */
+	BLOCK_RAW		= 4,	/* the chars as they are */
+	BLOCK_RLE		= 5,	/* a single char, repeated raw_size times */
+	BLOCK_REPEAT		= 6,	/* streams, codes of the last BLOCK_HUF */
+};
+
+struct frame_header {
+	uint8_t version;
+	uint8_t flags;
+	uint32_t block_size;		/* largest raw size of a block */
+	uint64_t content_size;		/* total chars, if FRAME_CONTENT_SIZE */
+};
+
+struct block_header {
+	uint8_t type;
+	uint8_t flags;
+	uint32_t raw_size;		/* chars in the block */
+	uint32_t comp_size;		/* payload bytes following the header */
+};
+
+/* Where a block starts */
+struct index_entry {
+	uint64_t raw_offset;		/* in the text */
+	uint64_t comp_offset;		/* of the header, from the frame start */
+};
+
+struct index_footer {
+	uint64_t raw_size;		/* chars in the whole frame */
+	uint64_t blocks;		/* entries before the footer */
+};
+
+static inline void put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static inline void put_le32(uint8_t *p, uint32_t v)
+{
+	put_le16(p, v);
+	put_le16(p + 2, v >> 16);
+}
+
+static inline void put_le64(uint8_t *p, uint64_t v)
+{
+	put_le32(p, v);
+	put_le32(p + 4, v >> 32);
+}
+
+static inline uint16_t get_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+	return get_le16(p) | ((uint32_t) get_le16(p + 2) << 16);
+}
+
+static inline uint64_t get_le64(const uint8_t *p)
+{
+	return get_le32(p) | ((uint64_t) get_le32(p + 4) << 32);
+}
+
+/* Serializes the frame header, FRAME_HEADER_SIZE bytes */
+void frame_put_header(uint8_t *buf, struct frame_header *fh);
+
+/* Parses the FRAME_HEADER_SIZE bytes at buf */
+enum huf_result frame_get_header(const uint8_t *buf, struct frame_header *fh);
+
+/* Serializes the block header, returns the number of bytes used */
+size_t frame_put_block(uint8_t *buf, struct block_header *bh);
+
+/* Parses the block header bytes following the type byte at buf[0] */
+enum huf_result frame_get_block(const uint8_t *buf, struct block_header *bh);
+
+/* Serializes an index entry, INDEX_ENTRY_SIZE bytes */
+void frame_put_entry(uint8_t *buf, struct index_entry *e);
+
+/* Parses the INDEX_ENTRY_SIZE bytes at buf */
+void frame_get_entry(const uint8_t *buf, struct index_entry *e);
+
+/* Serializes the index footer, INDEX_FOOTER_SIZE bytes */
+void frame_put_footer(uint8_t *buf, struct index_footer *ft);
+
+/* Parses the INDEX_FOOTER_SIZE bytes at buf */
+enum huf_result frame_get_footer(const uint8_t *buf, struct index_footer *ft);
+
+#endif	/* #ifndef FRAME_H */
@@ -0,0 +1,267 @@
+#include <string.h>
+
+#include "hist.h"
+#include "pool.h"
+#include "cpu.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+/* A part of the text counted by a worker thread */
+struct hist_job {
+	struct pool_job job;
+	const uint8_t *src;
+	size_t n;
+	uint32_t freq[ASCII_SIZE];
+};
+
+/* Counts 8 chars, two in every lane */
+static inline void count_word(const uint8_t *src,
+		uint32_t lanes[HIST_LANES][ASCII_SIZE])
+{
+	uint64_t w;
+
+	memcpy(&w, src, sizeof(uint64_t));
+	lanes[0][(uint8_t) w]++;
+	lanes[1][(uint8_t) (w >> 8)]++;
+	lanes[2][(uint8_t) (w >> 16)]++;
+	lanes[3][(uint8_t) (w >> 24)]++;
+	lanes[0][(uint8_t) (w >> 32)]++;
+	lanes[1][(uint8_t) (w >> 40)]++;
+	lanes[2][(uint8_t) (w >> 48)]++;
+	lanes[3][(uint8_t) (w >> 56)]++;
+}
+
+static void count_lanes(const uint8_t *src, size_t n,
+		uint32_t lanes[HIST_LANES][ASCII_SIZE])
+{
+	size_t i;
+
+	for (i = 0; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t))
+		count_word(&src[i], lanes);
+	for (; i < n; i++)
+		lanes[i % HIST_LANES][src[i]]++;
+}
+
+#ifdef CPU_X86
+/*
+ * Low entropy text is mostly made of runs, a whole HIST_RUN bytes of the
+ * same char are told apart with a single compare and counted at once
+ */
+CPU_TARGET("avx2")
+static void count_lanes_avx2(const uint8_t *src, size_t n,
+		uint32_t lanes[HIST_LANES][ASCII_SIZE])
+{
+	__m256i v, first;
+	size_t i;
+
+	for (i = 0; i + HIST_RUN <= n; i += HIST_RUN) {
+		v = _mm256_loadu_si256((const __m256i *) &src[i]);
+		first = _mm256_set1_epi8(src[i]);
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, first)) == -1) {
+			lanes[0][src[i]] += HIST_RUN;
+			continue;
+		}
+
+		count_word(&src[i], lanes);
+		count_word(&src[i + 8], lanes);
+		count_word(&src[i + 16], lanes);
+		count_word(&src[i + 24], lanes);
+	}
+	count_lanes(&src[i], n - i, lanes);
+}
+#endif
+
+/* Adds the n chars at src to the lanes, with the best variant */
+static void count_part(const uint8_t *src, size_t n,
+		uint32_t lanes[HIST_LANES][ASCII_SIZE])
+{
+#ifdef CPU_X86
+	if (cpu_features() & CPU_AVX2)
+		count_lanes_avx2(src, n, lanes);
+	else
+#endif
+		count_lanes(src, n, lanes);
+}
+
+/* Counts the apparitions of every char in the n < 2^32 chars at src */
+void hist_count(const uint8_t *src, size_t n, uint32_t freq[ASCII_SIZE])
+{
+	uint32_t lanes[HIST_LANES][ASCII_SIZE];
+	int i;
+
+	memset(lanes, 0, sizeof(lanes));
+	count_part(src, n, lanes);
+
+	for (i = 0; i < ASCII_SIZE; i++)
+		freq[i] = lanes[0][i] + lanes[1][i] + lanes[2][i] +
+			lanes[3][i];
+}
+
+/*
+ * Estimates the counts of the n < 2^32 chars at src from one chunk of
+ * HIST_SAMPLE_CHUNK bytes out of every HIST_SAMPLE_RATE, scaled up to n.
+ * The other chunks aren't read, so a char missing from the sample may
+ * still be in the text: every char gets a count of at least 1, unless the
+ * sample is all the text or the text turns out to be a run of the single
+ * char sampled.
+ */
+void hist_sample(const uint8_t *src, size_t n, uint32_t freq[ASCII_SIZE])
+{
+	uint32_t lanes[HIST_LANES][ASCII_SIZE];
+	uint64_t sampled, count;
+	size_t i, k;
+	int syms, c;
+
+	memset(lanes, 0, sizeof(lanes));
+	sampled = 0;
+	for (i = 0; i < n; i += HIST_SAMPLE_CHUNK * HIST_SAMPLE_RATE) {
+		k = n - i < HIST_SAMPLE_CHUNK ? n - i : HIST_SAMPLE_CHUNK;
+		count_part(&src[i], k, lanes);
+		sampled += k;
+	}
+
+	syms = 0;
+	for (c = 0; c < ASCII_SIZE; c++) {
+		count = (uint64_t) lanes[0][c] + lanes[1][c] + lanes[2][c] +
+			lanes[3][c];
+		freq[c] = sampled > 0 ? count * n / sampled : 0;
+		if (freq[c] > 0)
+			syms++;
+	}
+
+	/* A sample of all the text is exact, a run is stored as one */
+	if (sampled == n)
+		return;
+	if (syms == 1) {
+		for (i = 1; i < n && src[i] == src[0]; i++)
+			;
+		if (i == n)
+			return;
+	}
+
+	for (c = 0; c < ASCII_SIZE; c++)
+		if (freq[c] == 0)
+			freq[c] = 1;
+}
+
+/*
+ * Adds the pairs of the n chars at src to freq, a row for every preceding
+ * char. The first char is preceded by prev.
+ */
+void hist_count_pairs(const uint8_t *src, size_t n, uint8_t prev,
+		uint32_t freq[ASCII_SIZE][ASCII_SIZE])
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		freq[prev][src[i]]++;
+		prev = src[i];
+	}
+}
+
+static void hist_slot(void *arg)
+{
+	struct hist_job *h = (struct hist_job *) arg;
+
+	hist_count(h->src, h->n, h->freq);
+}
+
+/*
+ * Same as hist_count, large inputs are split between up to nthreads threads
+ * counting their part on their own
+ */
+void hist_count_mt(const uint8_t *src, size_t n, int nthreads,
+		uint32_t freq[ASCII_SIZE])
+{
+	struct hist_job *jobs;
+	struct pool *pool;
+	size_t part;
+	int nparts, i, c;
+
+	nparts = nthreads;
+	if (n / HIST_MT_MIN < (size_t) nparts)
+		nparts = n / HIST_MT_MIN;
+
+	/* Counting alone when threads don't pay off, or can't be had */
+	jobs = NULL;
+	pool = NULL;
+	if (nparts > 1)
+		jobs = (struct hist_job *) huf_calloc(nparts,
+				sizeof(struct hist_job));
+	if (jobs == NULL || pool_init(&pool, nparts) != HUF_SUCCESS) {
+		free(jobs);
+		hist_count(src, n, freq);
+		return;
+	}
+
+	part = n / nparts;
+	for (i = 0; i < nparts; i++) {
+		jobs[i].job.fn = hist_slot;
+		jobs[i].job.arg = &jobs[i];
+		jobs[i].src = &src[i * part];
+		jobs[i].n = i == nparts - 1 ? n - i * part : part;
+		pool_submit(pool, &jobs[i].job);
+	}
+
+	for (c = 0; c < ASCII_SIZE; c++)
+		freq[c] = 0;
+	for (i = 0; i < nparts; i++) {
+		pool_wait(pool, &jobs[i].job);
+		for (c = 0; c < ASCII_SIZE; c++)
+			freq[c] += jobs[i].freq[c];
+	}
+
+	pool_destroy(&pool);
+	free(jobs);
+}
+
+/* log2(x) for x >= 1, with HIST_LOG_FRAC fraction bits */
+uint32_t hist_log2(uint32_t x)
+{
+	uint64_t m;
+	uint32_t r;
+	int e, i;
+
+	e = 31 - __builtin_clz(x);
+	r = (uint32_t) e << HIST_LOG_FRAC;
+
+	/* Squaring the mantissa in [1, 2) doubles its log */
+	m = (uint64_t) x << (31 - e);
+	for (i = HIST_LOG_FRAC - 1; i >= 0; i--) {
+		m = (m * m) >> 31;
+		if (m >= (uint64_t) 1 << 32) {
+			m >>= 1;
+			r |= 1 << i;
+		}
+	}
+
+	return r;
+}
+
+/*
+ * Bits taken by the chars counted in freq, less than 2^32 of them, if coded
+ * with their entropy, which no prefix code gets under
+ */
+uint64_t hist_entropy(const uint32_t freq[ASCII_SIZE])
+{
+	uint64_t total, bits;
+	uint32_t log_total;
+	int i;
+
+	total = 0;
+	for (i = 0; i < ASCII_SIZE; i++)
+		total += freq[i];
+	if (total == 0)
+		return 0;
+
+	log_total = hist_log2((uint32_t) total);
+	bits = 0;
+	for (i = 0; i < ASCII_SIZE; i++)
+		if (freq[i] > 0)
+			bits += (uint64_t) freq[i] *
+				(log_total - hist_log2(freq[i]));
+
+	return bits >> HIST_LOG_FRAC;
+}
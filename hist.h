@@ -0,0 +1,57 @@
+/*
+ * Byte histogram of the text, the first pass of every compression. The
+ * counts are spread over interleaved sub-histograms, so a run of the same
+ * char doesn't wait on its own counter, and merged at the end. A strided
+ * sample of the text can stand for all of it, when speed matters more than
+ * the best codes.
+ */
+
+#ifndef HIST_H
+#define HIST_H
+
+#include "common.h"
+
+#define HIST_LANES		(4)		/* interleaved sub-histograms */
+#define HIST_RUN		(32)		/* bytes compared at once by AVX2 */
+#define HIST_MT_MIN		(1 << 22)	/* smallest part given to a thread */
+#define HIST_LOG_FRAC		(8)		/* fraction bits of hist_log2 */
+#define HIST_SAMPLE_CHUNK	(4096)		/* bytes sampled together */
+#define HIST_SAMPLE_RATE	(8)		/* one chunk sampled out of */
+
+/* Counts the apparitions of every char in the n < 2^32 chars at src */
+void hist_count(const uint8_t *src, size_t n, uint32_t freq[ASCII_SIZE]);
+
+/*
+ * Estimates the counts of the n < 2^32 chars at src from one chunk of
+ * HIST_SAMPLE_CHUNK bytes out of every HIST_SAMPLE_RATE, scaled up to n.
+ * The other chunks aren't read, so a char missing from the sample may
+ * still be in the text: every char gets a count of at least 1, unless the
+ * sample is all the text or the text turns out to be a run of the single
+ * char sampled.
+ */
+void hist_sample(const uint8_t *src, size_t n, uint32_t freq[ASCII_SIZE]);
+
+/*
+ * Same as hist_count, large inputs are split between up to nthreads threads
+ * counting their part on their own
+ */
+void hist_count_mt(const uint8_t *src, size_t n, int nthreads,
+		uint32_t freq[ASCII_SIZE]);
+
+/*
+ * Adds the pairs of the n chars at src to freq, a row for every preceding
+ * char. The first char is preceded by prev.
+ */
+void hist_count_pairs(const uint8_t *src, size_t n, uint8_t prev,
+		uint32_t freq[ASCII_SIZE][ASCII_SIZE]);
+
+/* log2(x) for x >= 1, with HIST_LOG_FRAC fraction bits */
+uint32_t hist_log2(uint32_t x);
+
+/*
+ * Bits taken by the chars counted in freq, less than 2^32 of them, if coded
+ * with their entropy, which no prefix code gets under
+ */
+uint64_t hist_entropy(const uint32_t freq[ASCII_SIZE]);
+
+#endif	/* #ifndef HIST_H */
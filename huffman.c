@@ -0,0 +1,662 @@
+#include <string.h>
+
+#include "huffman.h"
+#include "frame.h"
+#include "block.h"
+#include "canon.h"
+
+/* Where the frame parsing of a decompression context is at */
+enum dctx_state {
+	DCTX_FRAME,			/* gathering the frame header */
+	DCTX_BLOCK,			/* gathering a block header */
+	DCTX_PAYLOAD,			/* gathering a block payload */
+	DCTX_DONE,			/* the end block was seen */
+};
+
+/* Bytes produced by a context and not handed out yet */
+struct out_buf {
+	uint8_t *data;
+	size_t pos;			/* first byte not handed out */
+	size_t len;
+	size_t mem;
+};
+
+struct huf_cctx {
+	uint32_t block_size;
+	struct block_params bp;
+	struct block_chain chain;
+	uint64_t blocks;		/* of the frame so far */
+	uint8_t *text;			/* the partial block, block_size bytes */
+	size_t text_len;
+	struct out_buf out;
+	uint64_t size;			/* recorded total, if has_size */
+	uint64_t total;
+	int has_size;
+	int started;			/* the frame header was written */
+	int finished;
+};
+
+struct huf_dctx {
+	enum dctx_state state;
+	struct frame_header fh;
+	struct block_header bh;
+	uint8_t head[FRAME_HEADER_SIZE];
+	size_t head_len;
+	uint8_t *comp;			/* a payload split between chunks */
+	size_t comp_len;
+	size_t comp_mem;
+	struct block_decoder *dec;
+	struct block_table table;
+	struct out_buf out;
+	uint64_t total;
+};
+
+/*
+ * Makes room for n more bytes, moving the ones not handed out yet to the
+ * start of the buffer
+ */
+static enum huf_result out_reserve(struct out_buf *o, size_t n)
+{
+	uint8_t *tmp;
+	size_t mem;
+
+	if (o->pos > 0) {
+		memmove(o->data, &o->data[o->pos], o->len - o->pos);
+		o->len -= o->pos;
+		o->pos = 0;
+	}
+	if (o->len + n <= o->mem)
+		return HUF_SUCCESS;
+
+	mem = o->mem > 0 ? o->mem : DEFAULT_BLOCK_SIZE;
+	while (mem < o->len + n)
+		mem *= 2;
+	tmp = (uint8_t *) huf_realloc(o->data, mem * sizeof(uint8_t));
+	if (tmp == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+	o->data = tmp;
+	o->mem = mem;
+
+	return HUF_SUCCESS;
+}
+
+static void out_take(struct out_buf *o, const uint8_t **data, size_t *size)
+{
+	*data = &o->data[o->pos];
+	*size = o->len - o->pos;
+	o->pos = o->len;
+}
+
+/*
+ * Creates a compression context, blocks of block_size chars (0 for the
+ * default) with codes of at most max_len bits (0 for the default)
+ */
+enum huf_result huf_cctx_create(struct huf_cctx **cctx, uint32_t block_size,
+		int max_len)
+{
+	if (block_size == 0)
+		block_size = DEFAULT_BLOCK_SIZE;
+	if (max_len == 0)
+		max_len = DEFAULT_CODE_LEN;
+	if (block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE ||
+			max_len < MIN_CODE_LEN || max_len > MAX_CODE_LEN)
+		return HUF_ERROR_INVALID_PARAMETER;
+
+	*cctx = (struct huf_cctx *) huf_calloc(1, sizeof(struct huf_cctx));
+	if (*cctx == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+	(*cctx)->block_size = block_size;
+	block_params_init(&(*cctx)->bp);
+	(*cctx)->bp.max_len = max_len;
+	block_chain_init(&(*cctx)->chain);
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Records the total size of the message in the frame header, must come
+ * before the first chunk. The decoder can then allocate the output once.
+ */
+enum huf_result huf_cctx_set_size(struct huf_cctx *cctx, uint64_t size)
+{
+	if (cctx->started)
+		return HUF_ERROR_INVALID_PARAMETER;
+
+	cctx->size = size;
+	cctx->has_size = 1;
+
+	return HUF_SUCCESS;
+}
+
+/* Writes the frame header before the first block */
+static enum huf_result cctx_start(struct huf_cctx *cctx)
+{
+	struct frame_header fh;
+	enum huf_result r;
+
+	if (cctx->started)
+		return HUF_SUCCESS;
+
+	r = out_reserve(&cctx->out, FRAME_HEADER_SIZE);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	fh.version = FRAME_VERSION;
+	fh.flags = cctx->has_size ? FRAME_CONTENT_SIZE : 0;
+	fh.block_size = cctx->block_size;
+	fh.content_size = cctx->size;
+	frame_put_header(&cctx->out.data[cctx->out.len], &fh);
+	cctx->out.len += FRAME_HEADER_SIZE;
+	cctx->started = 1;
+
+	return HUF_SUCCESS;
+}
+
+static enum huf_result cctx_block(struct huf_cctx *cctx, const uint8_t *src,
+		size_t n)
+{
+	enum huf_result r;
+	size_t size;
+
+	r = out_reserve(&cctx->out, block_bound(n));
+	if (r != HUF_SUCCESS)
+		return r;
+
+	r = block_compress(src, n, &cctx->bp, &cctx->chain, cctx->blocks++,
+			&cctx->out.data[cctx->out.len], &size);
+	if (r != HUF_SUCCESS)
+		return r;
+	cctx->out.len += size;
+
+	return HUF_SUCCESS;
+}
+
+/* Compresses the n bytes at src, every whole block is output right away */
+enum huf_result huf_cctx_feed(struct huf_cctx *cctx, const void *src,
+		size_t n)
+{
+	const uint8_t *p = (const uint8_t *) src;
+	enum huf_result r;
+	size_t k;
+
+	if (cctx->finished)
+		return HUF_ERROR_INVALID_PARAMETER;
+	r = cctx_start(cctx);
+	if (r != HUF_SUCCESS)
+		return r;
+	cctx->total += n;
+
+	while (n > 0) {
+		/* Whole blocks in the chunk are compressed without a copy */
+		if (cctx->text_len == 0 && n >= cctx->block_size) {
+			r = cctx_block(cctx, p, cctx->block_size);
+			if (r != HUF_SUCCESS)
+				return r;
+			p += cctx->block_size;
+			n -= cctx->block_size;
+			continue;
+		}
+
+		if (cctx->text == NULL) {
+			cctx->text = (uint8_t *) huf_malloc(cctx->block_size *
+					sizeof(uint8_t));
+			if (cctx->text == NULL)
+				return HUF_ERROR_MEMORY_ALLOC;
+		}
+
+		k = cctx->block_size - cctx->text_len;
+		if (k > n)
+			k = n;
+		memcpy(&cctx->text[cctx->text_len], p, k);
+		cctx->text_len += k;
+		p += k;
+		n -= k;
+
+		if (cctx->text_len == cctx->block_size) {
+			r = cctx_block(cctx, cctx->text, cctx->text_len);
+			if (r != HUF_SUCCESS)
+				return r;
+			cctx->text_len = 0;
+		}
+	}
+
+	return HUF_SUCCESS;
+}
+
+/* Compresses the last partial block and ends the frame */
+enum huf_result huf_cctx_finish(struct huf_cctx *cctx)
+{
+	struct block_header bh;
+	enum huf_result r;
+
+	if (cctx->finished)
+		return HUF_ERROR_INVALID_PARAMETER;
+	if (cctx->has_size && cctx->total != cctx->size)
+		return HUF_ERROR_INVALID_PARAMETER;
+	r = cctx_start(cctx);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	if (cctx->text_len > 0) {
+		r = cctx_block(cctx, cctx->text, cctx->text_len);
+		if (r != HUF_SUCCESS)
+			return r;
+		cctx->text_len = 0;
+	}
+
+	r = out_reserve(&cctx->out, BLOCK_HEADER_SIZE);
+	if (r != HUF_SUCCESS)
+		return r;
+	bh.type = BLOCK_END;
+	cctx->out.len += frame_put_block(&cctx->out.data[cctx->out.len], &bh);
+	cctx->finished = 1;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Hands out the compressed bytes produced so far, they stay valid until the
+ * next call on the context
+ */
+void huf_cctx_output(struct huf_cctx *cctx, const uint8_t **data,
+		size_t *size)
+{
+	out_take(&cctx->out, data, size);
+}
+
+/* Starts a new message, keeping the buffers and the parameters */
+void huf_cctx_reset(struct huf_cctx *cctx)
+{
+	cctx->text_len = 0;
+	cctx->out.pos = 0;
+	cctx->out.len = 0;
+	cctx->size = 0;
+	cctx->total = 0;
+	cctx->has_size = 0;
+	cctx->started = 0;
+	cctx->finished = 0;
+	cctx->blocks = 0;
+	block_chain_reset(&cctx->chain);
+}
+
+void huf_cctx_free(struct huf_cctx **cctx)
+{
+	if (*cctx == NULL)
+		return;
+
+	free((*cctx)->text);
+	free((*cctx)->out.data);
+	block_chain_destroy(&(*cctx)->chain);
+	free(*cctx);
+	*cctx = NULL;
+}
+
+/* Creates a decompression context */
+enum huf_result huf_dctx_create(struct huf_dctx **dctx)
+{
+	*dctx = (struct huf_dctx *) huf_calloc(1, sizeof(struct huf_dctx));
+	if (*dctx == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+
+	(*dctx)->dec = (struct block_decoder *) huf_malloc(
+			sizeof(struct block_decoder));
+	if ((*dctx)->dec == NULL) {
+		huf_dctx_free(dctx);
+		return HUF_ERROR_MEMORY_ALLOC;
+	}
+	(*dctx)->state = DCTX_FRAME;
+
+	return HUF_SUCCESS;
+}
+
+/* Decodes a whole payload straight into the output */
+static enum huf_result dctx_block(struct huf_dctx *dctx,
+		const uint8_t *payload)
+{
+	enum huf_result r;
+
+	r = out_reserve(&dctx->out, dctx->bh.raw_size);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	r = block_table_update(&dctx->table, &dctx->bh, payload);
+	if (r != HUF_SUCCESS)
+		return r;
+	r = block_decompress(&dctx->bh, payload,
+			&dctx->out.data[dctx->out.len], dctx->dec,
+			&dctx->table, NULL);
+	if (r != HUF_SUCCESS)
+		return r;
+	dctx->out.len += dctx->bh.raw_size;
+	dctx->total += dctx->bh.raw_size;
+	dctx->state = DCTX_BLOCK;
+
+	return HUF_SUCCESS;
+}
+
+/* Parses the frame or block header gathered in head */
+static enum huf_result dctx_header(struct huf_dctx *dctx)
+{
+	enum huf_result r;
+
+	dctx->head_len = 0;
+	if (dctx->state == DCTX_FRAME) {
+		r = frame_get_header(dctx->head, &dctx->fh);
+		if (r != HUF_SUCCESS)
+			return r;
+		if (dctx->fh.block_size > MAX_BLOCK_SIZE)
+			return HUF_ERROR_INVALID_RESOURCE;
+		if (dctx->fh.flags & FRAME_ADAPTIVE)
+			return HUF_ERROR_UNSUPPORTED;
+		dctx->table.id = 0;
+		dctx->dec->id = 0;
+		dctx->state = DCTX_BLOCK;
+		return HUF_SUCCESS;
+	}
+
+	if (dctx->head[0] == BLOCK_END) {
+		if ((dctx->fh.flags & FRAME_CONTENT_SIZE) &&
+				dctx->total != dctx->fh.content_size)
+			return HUF_ERROR_INVALID_RESOURCE;
+		dctx->state = DCTX_DONE;
+		return HUF_SUCCESS;
+	}
+
+	r = frame_get_block(dctx->head, &dctx->bh);
+	if (r != HUF_SUCCESS)
+		return r;
+	r = block_check(&dctx->fh, &dctx->bh);
+	if (r != HUF_SUCCESS)
+		return r;
+	dctx->state = DCTX_PAYLOAD;
+
+	return HUF_SUCCESS;
+}
+
+/* Decompresses the n bytes at src, every whole block is output right away */
+enum huf_result huf_dctx_feed(struct huf_dctx *dctx, const void *src,
+		size_t n)
+{
+	const uint8_t *p = (const uint8_t *) src;
+	enum huf_result r;
+	size_t need, k;
+
+	while (n > 0) {
+		/* Nothing but the block index may follow the end */
+		if (dctx->state == DCTX_DONE)
+			return dctx->fh.flags & FRAME_INDEX ? HUF_SUCCESS :
+				HUF_ERROR_INVALID_RESOURCE;
+
+		if (dctx->state == DCTX_PAYLOAD) {
+			/* A payload whole in the chunk is decoded in place */
+			if (dctx->comp_len == 0 && n >= dctx->bh.comp_size) {
+				r = dctx_block(dctx, p);
+				if (r != HUF_SUCCESS)
+					return r;
+				p += dctx->bh.comp_size;
+				n -= dctx->bh.comp_size;
+				continue;
+			}
+
+			if (dctx->comp_mem < dctx->bh.comp_size) {
+				free(dctx->comp);
+				dctx->comp_mem = block_bound(dctx->fh.block_size);
+				dctx->comp = (uint8_t *) huf_malloc(dctx->comp_mem *
+						sizeof(uint8_t));
+				if (dctx->comp == NULL) {
+					dctx->comp_mem = 0;
+					return HUF_ERROR_MEMORY_ALLOC;
+				}
+			}
+
+			k = dctx->bh.comp_size - dctx->comp_len;
+			if (k > n)
+				k = n;
+			memcpy(&dctx->comp[dctx->comp_len], p, k);
+			dctx->comp_len += k;
+			p += k;
+			n -= k;
+
+			if (dctx->comp_len == dctx->bh.comp_size) {
+				dctx->comp_len = 0;
+				r = dctx_block(dctx, dctx->comp);
+				if (r != HUF_SUCCESS)
+					return r;
+			}
+			continue;
+		}
+
+		/* The end block is a single type byte */
+		if (dctx->state == DCTX_FRAME)
+			need = FRAME_HEADER_SIZE;
+		else if (dctx->head_len == 0 || dctx->head[0] == BLOCK_END)
+			need = 1;
+		else
+			need = BLOCK_HEADER_SIZE;
+
+		k = need - dctx->head_len;
+		if (k > n)
+			k = n;
+		memcpy(&dctx->head[dctx->head_len], p, k);
+		dctx->head_len += k;
+		p += k;
+		n -= k;
+
+		if (dctx->head_len == need &&
+				(need > 1 || dctx->head[0] == BLOCK_END)) {
+			r = dctx_header(dctx);
+			if (r != HUF_SUCCESS)
+				return r;
+		}
+	}
+
+	return HUF_SUCCESS;
+}
+
+/* Checks that the frame ended, and had the size it recorded */
+enum huf_result huf_dctx_finish(struct huf_dctx *dctx)
+{
+	if (dctx->state != DCTX_DONE)
+		return HUF_ERROR_END_OF_FILE;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Hands out the decompressed bytes produced so far, they stay valid until
+ * the next call on the context
+ */
+void huf_dctx_output(struct huf_dctx *dctx, const uint8_t **data,
+		size_t *size)
+{
+	out_take(&dctx->out, data, size);
+}
+
+/* Starts a new message, keeping the buffers */
+void huf_dctx_reset(struct huf_dctx *dctx)
+{
+	dctx->state = DCTX_FRAME;
+	dctx->head_len = 0;
+	dctx->comp_len = 0;
+	dctx->out.pos = 0;
+	dctx->out.len = 0;
+	dctx->total = 0;
+}
+
+void huf_dctx_free(struct huf_dctx **dctx)
+{
+	if (*dctx == NULL)
+		return;
+
+	free((*dctx)->comp);
+	free((*dctx)->dec);
+	free((*dctx)->out.data);
+	free(*dctx);
+	*dctx = NULL;
+}
+
+/* Largest compressed size of n bytes, in the default blocks */
+size_t huf_compress_bound(size_t n)
+{
+	size_t size;
+
+	size = FRAME_HEADER_SIZE + 1;
+	size += n / DEFAULT_BLOCK_SIZE * block_bound(DEFAULT_BLOCK_SIZE);
+	if (n % DEFAULT_BLOCK_SIZE > 0)
+		size += block_bound(n % DEFAULT_BLOCK_SIZE);
+
+	return size;
+}
+
+/*
+ * Compresses the n bytes at src into dst, *dst_size holds its size and is
+ * set to the compressed size. dst should hold huf_compress_bound(n) bytes.
+ */
+enum huf_result huf_compress(void *dst, size_t *dst_size, const void *src,
+		size_t n)
+{
+	const uint8_t *in = (const uint8_t *) src;
+	uint8_t *out = (uint8_t *) dst;
+	struct block_params bp;
+	struct block_chain chain;
+	struct frame_header fh;
+	struct block_header bh;
+	enum huf_result r;
+	size_t pos, k, size;
+	uint64_t seq;
+
+	if (*dst_size < FRAME_HEADER_SIZE + 1)
+		return HUF_ERROR_BUFFER_SIZE;
+
+	fh.version = FRAME_VERSION;
+	fh.flags = FRAME_CONTENT_SIZE;
+	fh.block_size = DEFAULT_BLOCK_SIZE;
+	fh.content_size = n;
+	frame_put_header(out, &fh);
+	pos = FRAME_HEADER_SIZE;
+
+	/* The blocks are compressed straight into dst */
+	block_params_init(&bp);
+	block_chain_init(&chain);
+	r = HUF_SUCCESS;
+	for (seq = 0; n > 0; seq++) {
+		k = n < DEFAULT_BLOCK_SIZE ? n : DEFAULT_BLOCK_SIZE;
+		if (*dst_size - pos < block_bound(k)) {
+			r = HUF_ERROR_BUFFER_SIZE;
+			break;
+		}
+
+		r = block_compress(in, k, &bp, &chain, seq, &out[pos], &size);
+		if (r != HUF_SUCCESS)
+			break;
+		pos += size;
+		in += k;
+		n -= k;
+	}
+	block_chain_destroy(&chain);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	if (*dst_size - pos < 1)
+		return HUF_ERROR_BUFFER_SIZE;
+	bh.type = BLOCK_END;
+	pos += frame_put_block(&out[pos], &bh);
+	*dst_size = pos;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Decompresses the frame in the n bytes at src into dst, *dst_size holds
+ * its size and is set to the decompressed size
+ */
+enum huf_result huf_decompress(void *dst, size_t *dst_size, const void *src,
+		size_t n)
+{
+	const uint8_t *in = (const uint8_t *) src;
+	uint8_t *out = (uint8_t *) dst;
+	struct block_decoder *dec;
+	struct block_table table;
+	struct frame_header fh;
+	struct block_header bh;
+	struct index_footer ft;
+	enum huf_result r;
+	size_t pos, total;
+
+	if (n < FRAME_HEADER_SIZE)
+		return HUF_ERROR_END_OF_FILE;
+	r = frame_get_header(in, &fh);
+	if (r != HUF_SUCCESS)
+		return r;
+	if (fh.flags & FRAME_ADAPTIVE)
+		return HUF_ERROR_UNSUPPORTED;
+
+	dec = (struct block_decoder *) huf_malloc(sizeof(struct block_decoder));
+	if (dec == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+	dec->id = 0;
+	table.id = 0;
+
+	pos = FRAME_HEADER_SIZE;
+	total = 0;
+	while (1) {
+		if (pos == n) {
+			r = HUF_ERROR_END_OF_FILE;
+			break;
+		}
+		if (in[pos] == BLOCK_END) {
+			pos++;
+			break;
+		}
+
+		if (n - pos < BLOCK_HEADER_SIZE) {
+			r = HUF_ERROR_END_OF_FILE;
+			break;
+		}
+		r = frame_get_block(&in[pos], &bh);
+		if (r == HUF_SUCCESS)
+			r = block_check(&fh, &bh);
+		if (r != HUF_SUCCESS)
+			break;
+		pos += BLOCK_HEADER_SIZE;
+
+		if (n - pos < bh.comp_size) {
+			r = HUF_ERROR_END_OF_FILE;
+			break;
+		}
+		if (*dst_size - total < bh.raw_size) {
+			r = HUF_ERROR_BUFFER_SIZE;
+			break;
+		}
+
+		r = block_table_update(&table, &bh, &in[pos]);
+		if (r == HUF_SUCCESS)
+			r = block_decompress(&bh, &in[pos], &out[total], dec,
+					&table, NULL);
+		if (r != HUF_SUCCESS)
+			break;
+		pos += bh.comp_size;
+		total += bh.raw_size;
+	}
+	free(dec);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	/* The index holds an entry per block */
+	if (fh.flags & FRAME_INDEX) {
+		if (n - pos < INDEX_FOOTER_SIZE ||
+				frame_get_footer(&in[n - INDEX_FOOTER_SIZE],
+					&ft) != HUF_SUCCESS ||
+				ft.raw_size != total || ft.blocks !=
+				(n - pos - INDEX_FOOTER_SIZE) / INDEX_ENTRY_SIZE)
+			return HUF_ERROR_INVALID_RESOURCE;
+		pos += ft.blocks * INDEX_ENTRY_SIZE + INDEX_FOOTER_SIZE;
+	}
+
+	if (pos != n || ((fh.flags & FRAME_CONTENT_SIZE) &&
+				total != fh.content_size))
+		return HUF_ERROR_INVALID_RESOURCE;
+	*dst_size = total;
+
+	return HUF_SUCCESS;
+}
@@ -0,0 +1,100 @@
+/*
+ * libhuffman, the public interface. Data is compressed into the framed
+ * format, either in one call between two buffers or pushed through a
+ * context a chunk at a time. Contexts keep no global state, so every thread
+ * can use its own, and they keep their buffers when reset for the next
+ * message.
+ *
+ * A context is used as:
+ *
+ *	huf_cctx_feed(cctx, chunk, n);		as many times as needed
+ *	huf_cctx_output(cctx, &data, &size);	after any call, may be empty
+ *	huf_cctx_finish(cctx);			then the last output
+ *	huf_cctx_reset(cctx);			ready for the next message
+ *
+ * The decompression context works the same way on compressed chunks.
+ * Adaptive frames, written by "huffman -a", are decoded by the program only,
+ * the library gives them up with HUF_ERROR_UNSUPPORTED.
+ */
+
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+#include "common.h"
+
+struct huf_cctx;
+struct huf_dctx;
+
+/*
+ * Creates a compression context, blocks of block_size chars (0 for the
+ * default) with codes of at most max_len bits (0 for the default)
+ */
+HUF_API enum huf_result huf_cctx_create(struct huf_cctx **cctx,
+		uint32_t block_size, int max_len);
+
+/*
+ * Records the total size of the message in the frame header, must come
+ * before the first chunk. The decoder can then allocate the output once.
+ */
+HUF_API enum huf_result huf_cctx_set_size(struct huf_cctx *cctx,
+		uint64_t size);
+
+/* Compresses the n bytes at src, every whole block is output right away */
+HUF_API enum huf_result huf_cctx_feed(struct huf_cctx *cctx,
+		const void *src, size_t n);
+
+/* Compresses the last partial block and ends the frame */
+HUF_API enum huf_result huf_cctx_finish(struct huf_cctx *cctx);
+
+/*
+ * Hands out the compressed bytes produced so far, they stay valid until the
+ * next call on the context
+ */
+HUF_API void huf_cctx_output(struct huf_cctx *cctx, const uint8_t **data,
+		size_t *size);
+
+/* Starts a new message, keeping the buffers and the parameters */
+HUF_API void huf_cctx_reset(struct huf_cctx *cctx);
+
+HUF_API void huf_cctx_free(struct huf_cctx **cctx);
+
+/* Creates a decompression context */
+HUF_API enum huf_result huf_dctx_create(struct huf_dctx **dctx);
+
+/* Decompresses the n bytes at src, every whole block is output right away */
+HUF_API enum huf_result huf_dctx_feed(struct huf_dctx *dctx,
+		const void *src, size_t n);
+
+/* Checks that the frame ended, and had the size it recorded */
+HUF_API enum huf_result huf_dctx_finish(struct huf_dctx *dctx);
+
+/*
+ * Hands out the decompressed bytes produced so far, they stay valid until
+ * the next call on the context
+ */
+HUF_API void huf_dctx_output(struct huf_dctx *dctx, const uint8_t **data,
+		size_t *size);
+
+/* Starts a new message, keeping the buffers */
+HUF_API void huf_dctx_reset(struct huf_dctx *dctx);
+
+HUF_API void huf_dctx_free(struct huf_dctx **dctx);
+
+/* Largest compressed size of n bytes, in the default blocks */
+HUF_API size_t huf_compress_bound(size_t n);
+
+/*
+ * Compresses the n bytes at src into dst, *dst_size holds its size and is
+ * set to the compressed size. dst should hold huf_compress_bound(n) bytes.
+ */
+HUF_API enum huf_result huf_compress(void *dst, size_t *dst_size,
+		const void *src, size_t n);
+
+/*
+ * Decompresses the frame in the n bytes at src into dst, *dst_size holds
+ * its size and is set to the decompressed size
+ */
+HUF_API enum huf_result huf_decompress(void *dst, size_t *dst_size,
+		const void *src, size_t n);
+
+#endif	/* #ifndef HUFFMAN_H */
@@ -0,0 +1,615 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "io.h"
+#include "ring.h"
+
+static enum huf_result write_all(struct huf_output *out, const uint8_t *p,
+		size_t n)
+{
+	struct stats_clock clock;
+	enum huf_result r;
+	ssize_t k;
+
+	r = HUF_SUCCESS;
+	stats_start(out->stats, &clock);
+	while (n > 0) {
+		k = write(out->fd, p, n);
+		if (k < 0 && errno == EINTR)
+			continue;
+		if (k <= 0) {
+			r = HUF_ERROR_FILE_ACCESS;
+			break;
+		}
+		p += k;
+		n -= k;
+	}
+	stats_stop(out->stats, STATS_WRITE, &clock);
+
+	return r;
+}
+
+static enum huf_result flush_buf(struct huf_output *out)
+{
+	struct stats_clock clock;
+	enum huf_result r;
+
+	if (out->len == 0)
+		return HUF_SUCCESS;
+
+	/* The writer takes the buffer, only the wait for another one counts */
+	if (out->ring != NULL) {
+		stats_start(out->stats, &clock);
+		r = ring_put(out->ring, out->len, &out->buf);
+		stats_stop(out->stats, STATS_WRITE, &clock);
+	} else {
+		r = write_all(out, out->buf, out->len);
+	}
+	out->len = 0;
+
+	return r;
+}
+
+/* Reads at most n bytes into dst, *k is 0 at the end of the input */
+static enum huf_result read_some(struct huf_input *in, uint8_t *dst,
+		size_t n, size_t *k)
+{
+	enum huf_result r;
+	ssize_t got;
+
+	if (in->ring != NULL) {
+		if (in->chunk_len == 0) {
+			r = ring_get(in->ring, &in->chunk, &in->chunk_len);
+			if (r != HUF_SUCCESS)
+				return r;
+		}
+		/* Nothing to copy at the end, the chunk may be NULL */
+		*k = n < in->chunk_len ? n : in->chunk_len;
+		if (*k == 0)
+			return HUF_SUCCESS;
+		memcpy(dst, in->chunk, *k);
+		in->chunk += *k;
+		in->chunk_len -= *k;
+		return HUF_SUCCESS;
+	}
+
+	do {
+		got = read(in->fd, dst, n);
+	} while (got < 0 && errno == EINTR);
+	if (got < 0)
+		return HUF_ERROR_FILE_ACCESS;
+	*k = got;
+
+	return HUF_SUCCESS;
+}
+
+/* Asks for the pages of a mapped input following the next n bytes */
+static void advise_ahead(struct huf_input *in, size_t n)
+{
+	uint64_t start, end;
+
+	end = in->pos + n + (n > IO_READ_AHEAD ? n : IO_READ_AHEAD);
+	if (end > in->size)
+		end = in->size;
+	if (in->advised >= in->pos + n + IO_READ_AHEAD / 2 ||
+			in->advised >= end)
+		return;
+
+	start = in->advised > in->pos ? in->advised : in->pos;
+	start &= ~(uint64_t) (IO_ALIGN - 1);
+	madvise((void *) (in->map + start), end - start, MADV_WILLNEED);
+	in->advised = end;
+}
+
+/* Opens the input, "-" is the standard input */
+enum huf_result io_open_in(struct huf_input *in, const char *path)
+{
+	struct stat st;
+	off_t start;
+	void *map;
+
+	in->map = NULL;
+	in->size = 0;
+	in->pos = 0;
+	in->buf = NULL;
+	in->eof = 0;
+	in->stats = NULL;
+	in->ring = NULL;
+	in->chunk_len = 0;
+	in->advised = 0;
+
+	if (strcmp(path, "-") == 0)
+		in->fd = STDIN_FILENO;
+	else
+		in->fd = open(path, O_RDONLY);
+	if (in->fd < 0)
+		return HUF_ERROR_FILE_ACCESS;
+
+	/* Mapping the whole file, reading resumes where the fd was */
+	if (fstat(in->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+		if (map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			in->map = (const uint8_t *) map;
+			in->size = st.st_size;
+			start = lseek(in->fd, 0, SEEK_CUR);
+			if (start > 0 && start <= st.st_size)
+				in->pos = start;
+		}
+	}
+
+	return HUF_SUCCESS;
+}
+
+/* Opens the output, "-" is the standard output */
+enum huf_result io_open_out(struct huf_output *out, const char *path)
+{
+	out->map = NULL;
+	out->size = 0;
+	out->pos = 0;
+	out->len = 0;
+	out->stats = NULL;
+	out->ring = NULL;
+	out->discard = 0;
+
+	if (huf_memalign((void **) &out->buf, IO_ALIGN, IO_BUF_SIZE) != 0)
+		return HUF_ERROR_MEMORY_ALLOC;
+
+	if (strcmp(path, "-") == 0)
+		out->fd = STDOUT_FILENO;
+	else
+		out->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (out->fd < 0) {
+		free(out->buf);
+		out->buf = NULL;
+		return HUF_ERROR_FILE_ACCESS;
+	}
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Reads the n bytes at data as if they were a mapped file. Nothing is to be
+ * freed, so the input is not closed.
+ */
+void io_open_mem(struct huf_input *in, const uint8_t *data, uint64_t n)
+{
+	in->fd = -1;
+	in->map = data;
+	in->size = n;
+	in->pos = 0;
+	in->buf = NULL;
+	in->eof = 0;
+	in->stats = NULL;
+	in->ring = NULL;
+	in->chunk_len = 0;
+	in->advised = 0;
+}
+
+/*
+ * Counts the bytes written to the output and drops them, for checking a
+ * file without writing it. Nothing is to be freed, so the output is not
+ * closed.
+ */
+void io_open_null(struct huf_output *out)
+{
+	out->fd = -1;
+	out->map = NULL;
+	out->size = 0;
+	out->pos = 0;
+	out->buf = NULL;
+	out->len = 0;
+	out->stats = NULL;
+	out->ring = NULL;
+	out->discard = 1;
+}
+
+/*
+ * Reads the rest of the input ahead of the callers: a stream on another
+ * thread, a mapped file by asking the kernel for the pages coming next
+ */
+enum huf_result io_read_ahead(struct huf_input *in)
+{
+	if (in->map != NULL) {
+		in->advised = in->pos;
+		advise_ahead(in, 0);
+		return HUF_SUCCESS;
+	}
+	if (in->ring != NULL || in->eof)
+		return HUF_SUCCESS;
+
+	return ring_start_reader(&in->ring, in->fd);
+}
+
+/* Writes the buffered output behind the callers, on another thread */
+enum huf_result io_write_behind(struct huf_output *out)
+{
+	enum huf_result r;
+	uint8_t *buf;
+
+	if (out->ring != NULL || out->map != NULL)
+		return HUF_SUCCESS;
+
+	r = flush_buf(out);
+	if (r != HUF_SUCCESS)
+		return r;
+	r = ring_start_writer(&out->ring, out->fd, &buf);
+	if (r != HUF_SUCCESS)
+		return r;
+	free(out->buf);
+	out->buf = buf;
+
+	return HUF_SUCCESS;
+}
+
+/* Size of a mapped input, 0 for streams */
+uint64_t io_in_size(struct huf_input *in)
+{
+	return in->map != NULL ? in->size - in->pos : 0;
+}
+
+/*
+ * Hands out the next n bytes of the input, fewer at the end. They point into
+ * the mapping if there is one, otherwise they are read into dst, or into the
+ * input buffer if dst is NULL (n is then at most IO_BUF_SIZE).
+ */
+enum huf_result io_next(struct huf_input *in, uint8_t *dst, size_t n,
+		const uint8_t **data, size_t *got)
+{
+	struct stats_clock clock;
+	enum huf_result r;
+	size_t k;
+
+	if (in->map != NULL) {
+		if (n > in->size - in->pos)
+			n = in->size - in->pos;
+		if (in->advised > 0)
+			advise_ahead(in, n);
+		*data = in->map + in->pos;
+		*got = n;
+		in->pos += n;
+		return HUF_SUCCESS;
+	}
+
+	if (dst == NULL) {
+		if (in->buf == NULL &&
+				huf_memalign((void **) &in->buf, IO_ALIGN,
+					IO_BUF_SIZE) != 0) {
+			in->buf = NULL;
+			return HUF_ERROR_MEMORY_ALLOC;
+		}
+		dst = in->buf;
+		if (n > IO_BUF_SIZE)
+			n = IO_BUF_SIZE;
+	}
+
+	*got = 0;
+	stats_start(in->stats, &clock);
+	while (*got < n && !in->eof) {
+		r = read_some(in, dst + *got, n - *got, &k);
+		if (r != HUF_SUCCESS)
+			return r;
+		if (k == 0)
+			in->eof = 1;
+		*got += k;
+	}
+	stats_stop(in->stats, STATS_READ, &clock);
+	*data = dst;
+	in->pos += *got;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Same as io_next, except that streams return after the first read giving
+ * any bytes, instead of waiting for all n
+ */
+enum huf_result io_next_avail(struct huf_input *in, uint8_t *dst, size_t n,
+		const uint8_t **data, size_t *got)
+{
+	struct stats_clock clock;
+	enum huf_result r;
+	size_t k;
+
+	if (in->map != NULL || in->eof || n == 0)
+		return io_next(in, dst, n, data, got);
+
+	stats_start(in->stats, &clock);
+	r = read_some(in, dst, n, &k);
+	stats_stop(in->stats, STATS_READ, &clock);
+	if (r != HUF_SUCCESS)
+		return r;
+	if (k == 0)
+		in->eof = 1;
+
+	*data = dst;
+	*got = k;
+	in->pos += k;
+
+	return HUF_SUCCESS;
+}
+
+/* Reads exactly n bytes into dst */
+enum huf_result io_read(struct huf_input *in, uint8_t *dst, size_t n)
+{
+	const uint8_t *data;
+	enum huf_result r;
+	size_t got;
+
+	r = io_next(in, dst, n, &data, &got);
+	if (r != HUF_SUCCESS)
+		return r;
+	if (got < n)
+		return HUF_ERROR_END_OF_FILE;
+	if (data != dst)
+		memcpy(dst, data, n);
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Hands out the rest of the input at once, in place if it is mapped, else
+ * read into *buf, which the caller frees
+ */
+enum huf_result io_read_all(struct huf_input *in, const uint8_t **data,
+		uint64_t *size, uint8_t **buf)
+{
+	enum huf_result r;
+	const uint8_t *p;
+	size_t mem, got;
+	uint8_t *tmp;
+
+	*buf = NULL;
+	if (in->map != NULL) {
+		*size = in->size - in->pos;
+		return io_next(in, NULL, *size, data, &got);
+	}
+
+	/* Streams are read in large chunks, doubling the buffer */
+	mem = 0;
+	*size = 0;
+	do {
+		if (*size == mem) {
+			mem = mem == 0 ? IO_BUF_SIZE : mem * 2;
+			tmp = (uint8_t *) huf_realloc(*buf, mem * sizeof(uint8_t));
+			if (tmp == NULL) {
+				free(*buf);
+				*buf = NULL;
+				return HUF_ERROR_MEMORY_ALLOC;
+			}
+			*buf = tmp;
+		}
+		r = io_next(in, *buf + *size, mem - *size, &p, &got);
+		if (r != HUF_SUCCESS) {
+			free(*buf);
+			*buf = NULL;
+			return r;
+		}
+		*size += got;
+	} while (got > 0);
+	*data = *buf;
+
+	return HUF_SUCCESS;
+}
+
+/* Skips exactly n bytes, streams read them into the input buffer */
+enum huf_result io_skip(struct huf_input *in, uint64_t n)
+{
+	const uint8_t *data;
+	enum huf_result r;
+	size_t got;
+
+	while (n > 0) {
+		r = io_next(in, NULL, n < IO_BUF_SIZE ? n : IO_BUF_SIZE,
+				&data, &got);
+		if (r != HUF_SUCCESS)
+			return r;
+		if (got == 0)
+			return HUF_ERROR_END_OF_FILE;
+		n -= got;
+	}
+
+	return HUF_SUCCESS;
+}
+
+/* Offset of the next byte in the input */
+uint64_t io_tell(struct huf_input *in)
+{
+	return in->pos;
+}
+
+/* Moves to the offset pos of a mapped input, streams can't seek */
+enum huf_result io_seek(struct huf_input *in, uint64_t pos)
+{
+	if (in->map == NULL)
+		return HUF_ERROR_INVALID_PARAMETER;
+	if (pos > in->size)
+		return HUF_ERROR_INVALID_RESOURCE;
+	in->pos = pos;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Allocates and maps the next size bytes of a regular output file, the
+ * callers then fill them through io_reserved. Fails if the disk is full,
+ * other outputs are left buffered.
+ */
+enum huf_result io_reserve(struct huf_output *out, uint64_t size)
+{
+	struct stat st;
+	enum huf_result r;
+	uint64_t end;
+	void *map;
+	int err;
+
+	if (size == 0 || out->map != NULL)
+		return HUF_SUCCESS;
+	if (fstat(out->fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+			(fcntl(out->fd, F_GETFL) & O_ACCMODE) != O_RDWR)
+		return HUF_SUCCESS;
+
+	r = flush_buf(out);
+	if (r == HUF_SUCCESS && out->ring != NULL)
+		r = ring_drain(out->ring);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	/*
+	 * A sparse file would only run out of space under the mapping, with a
+	 * SIGBUS, so the blocks are allocated first
+	 */
+	end = out->pos + size;
+	err = posix_fallocate(out->fd, out->pos, size);
+	if (err != 0) {
+		if (ftruncate(out->fd, out->pos) != 0 || err == ENOSPC ||
+				err == EFBIG)
+			return HUF_ERROR_FILE_ACCESS;
+		return HUF_SUCCESS;
+	}
+
+	/* The mapping starts at the beginning of the file, page aligned */
+	map = mmap(NULL, end, PROT_READ | PROT_WRITE, MAP_SHARED, out->fd, 0);
+	if (map == MAP_FAILED) {
+		if (ftruncate(out->fd, out->pos) != 0)
+			return HUF_ERROR_FILE_ACCESS;
+		return HUF_SUCCESS;
+	}
+
+	out->map = (uint8_t *) map;
+	out->size = end;
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Returns the next n reserved bytes of the output and counts them as
+ * written, or NULL if they have to go through io_write
+ */
+uint8_t *io_reserved(struct huf_output *out, size_t n)
+{
+	uint8_t *p;
+
+	if (out->map == NULL || n > out->size - out->pos)
+		return NULL;
+
+	p = out->map + out->pos;
+	out->pos += n;
+
+	return p;
+}
+
+/* Writes n bytes, large writes skip the buffer */
+enum huf_result io_write(struct huf_output *out, const void *src, size_t n)
+{
+	const uint8_t *s = (const uint8_t *) src;
+	enum huf_result r;
+	uint8_t *p;
+	size_t k;
+
+	if (n == 0)
+		return HUF_SUCCESS;
+	if (out->discard) {
+		out->pos += n;
+		return HUF_SUCCESS;
+	}
+
+	/* Once the output is mapped everything has to go there */
+	if (out->map != NULL) {
+		p = io_reserved(out, n);
+		if (p == NULL)
+			return HUF_ERROR_INVALID_RESOURCE;
+		memcpy(p, src, n);
+		return HUF_SUCCESS;
+	}
+
+	out->pos += n;
+	if (out->len + n > IO_BUF_SIZE) {
+		r = flush_buf(out);
+		if (r != HUF_SUCCESS)
+			return r;
+	}
+	if (n >= IO_BUF_SIZE && out->ring == NULL)
+		return write_all(out, s, n);
+
+	/* Behind a writer everything goes through the ring buffers */
+	while (n > IO_BUF_SIZE - out->len) {
+		k = IO_BUF_SIZE - out->len;
+		memcpy(&out->buf[out->len], s, k);
+		out->len += k;
+		r = flush_buf(out);
+		if (r != HUF_SUCCESS)
+			return r;
+		s += k;
+		n -= k;
+	}
+	memcpy(&out->buf[out->len], s, n);
+	out->len += n;
+
+	return HUF_SUCCESS;
+}
+
+/* Writes the buffered bytes right away */
+enum huf_result io_flush(struct huf_output *out)
+{
+	enum huf_result r;
+
+	if (out->map != NULL)
+		return HUF_SUCCESS;
+
+	r = flush_buf(out);
+	if (r == HUF_SUCCESS && out->ring != NULL)
+		r = ring_drain(out->ring);
+
+	return r;
+}
+
+/* Closes the input */
+void io_close_in(struct huf_input *in)
+{
+	ring_stop(&in->ring);
+	if (in->map != NULL)
+		munmap((void *) in->map, in->size);
+	in->map = NULL;
+	free(in->buf);
+	in->buf = NULL;
+	if (in->fd > STDERR_FILENO)
+		close(in->fd);
+	in->fd = -1;
+}
+
+/* Writes the pending bytes and closes the output */
+enum huf_result io_close_out(struct huf_output *out)
+{
+	enum huf_result r;
+
+	r = HUF_SUCCESS;
+	if (out->map != NULL) {
+		munmap(out->map, out->size);
+		out->map = NULL;
+		/* Cutting off whatever was reserved and not written */
+		if (out->pos != out->size && ftruncate(out->fd, out->pos) != 0)
+			r = HUF_ERROR_FILE_ACCESS;
+	} else {
+		r = flush_buf(out);
+	}
+
+	/* The ring owns the buffer being filled */
+	if (out->ring != NULL) {
+		if (ring_stop(&out->ring) != HUF_SUCCESS)
+			r = HUF_ERROR_FILE_ACCESS;
+		out->buf = NULL;
+	}
+	free(out->buf);
+	out->buf = NULL;
+
+	if (out->fd > STDERR_FILENO && close(out->fd) != 0)
+		r = HUF_ERROR_FILE_ACCESS;
+	out->fd = -1;
+
+	return r;
+}
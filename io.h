@@ -0,0 +1,141 @@
+/*
+ * Input and output files. Regular input files are memory mapped and read in
+ * place. The output is mapped when its final size is known upfront, so the
+ * decompressed text is produced directly in the file. Everything else, like
+ * pipes, goes through large aligned buffers with one system call per buffer.
+ *
+ * Reading ahead and writing behind let the system calls overlap with the
+ * work on the data: a stream is then read, or written, by a thread of its
+ * own through a ring of buffers, and the kernel is asked to fetch the pages
+ * of a mapped input before they are reached.
+ */
+
+#ifndef IO_H
+#define IO_H
+
+#include "common.h"
+#include "stats.h"
+
+#define IO_BUF_SIZE		(1 << 20)
+#define IO_ALIGN		(4096)
+#define IO_READ_AHEAD		(16 << 20)	/* of a mapped input */
+
+struct io_ring;
+
+struct huf_input {
+	int fd;
+	const uint8_t *map;		/* the whole file, NULL if not mapped */
+	uint64_t size;			/* mapped size */
+	uint64_t pos;			/* bytes handed out so far */
+	uint8_t *buf;			/* IO_BUF_SIZE, for io_next without dst */
+	int eof;
+	struct huf_stats *stats;	/* the reads are timed, if not NULL */
+	struct io_ring *ring;		/* reading ahead, for streams */
+	const uint8_t *chunk;		/* rest of the last read of the ring */
+	size_t chunk_len;
+	uint64_t advised;		/* mapped bytes read ahead, if not 0 */
+};
+
+struct huf_output {
+	int fd;
+	uint8_t *map;			/* reserved part of the file, if any */
+	uint64_t size;			/* reserved size */
+	uint64_t pos;			/* bytes written so far */
+	uint8_t *buf;			/* IO_BUF_SIZE, pending bytes */
+	size_t len;
+	struct huf_stats *stats;	/* the writes are timed, if not NULL */
+	struct io_ring *ring;		/* writing behind */
+	int discard;			/* nothing is written, only counted */
+};
+
+/* Opens the input, "-" is the standard input */
+enum huf_result io_open_in(struct huf_input *in, const char *path);
+
+/* Opens the output, "-" is the standard output */
+enum huf_result io_open_out(struct huf_output *out, const char *path);
+
+/*
+ * Reads the n bytes at data as if they were a mapped file. Nothing is to be
+ * freed, so the input is not closed.
+ */
+void io_open_mem(struct huf_input *in, const uint8_t *data, uint64_t n);
+
+/*
+ * Counts the bytes written to the output and drops them, for checking a
+ * file without writing it. Nothing is to be freed, so the output is not
+ * closed.
+ */
+void io_open_null(struct huf_output *out);
+
+/*
+ * Reads the rest of the input ahead of the callers: a stream on another
+ * thread, a mapped file by asking the kernel for the pages coming next
+ */
+enum huf_result io_read_ahead(struct huf_input *in);
+
+/* Writes the buffered output behind the callers, on another thread */
+enum huf_result io_write_behind(struct huf_output *out);
+
+/* Size of a mapped input, 0 for streams */
+uint64_t io_in_size(struct huf_input *in);
+
+/*
+ * Hands out the next n bytes of the input, fewer at the end. They point into
+ * the mapping if there is one, otherwise they are read into dst, or into the
+ * input buffer if dst is NULL (n is then at most IO_BUF_SIZE).
+ */
+enum huf_result io_next(struct huf_input *in, uint8_t *dst, size_t n,
+		const uint8_t **data, size_t *got);
+
+/*
+ * Same as io_next, except that streams return after the first read giving
+ * any bytes, instead of waiting for all n
+ */
+enum huf_result io_next_avail(struct huf_input *in, uint8_t *dst, size_t n,
+		const uint8_t **data, size_t *got);
+
+/*
+ * Hands out the rest of the input at once, in place if it is mapped, else
+ * read into *buf, which the caller frees
+ */
+enum huf_result io_read_all(struct huf_input *in, const uint8_t **data,
+		uint64_t *size, uint8_t **buf);
+
+/* Reads exactly n bytes into dst */
+enum huf_result io_read(struct huf_input *in, uint8_t *dst, size_t n);
+
+/* Skips exactly n bytes, streams read them into the input buffer */
+enum huf_result io_skip(struct huf_input *in, uint64_t n);
+
+/* Offset of the next byte in the input */
+uint64_t io_tell(struct huf_input *in);
+
+/* Moves to the offset pos of a mapped input, streams can't seek */
+enum huf_result io_seek(struct huf_input *in, uint64_t pos);
+
+/*
+ * Allocates and maps the next size bytes of a regular output file, the
+ * callers then fill them through io_reserved. Fails if the disk is full,
+ * other outputs are left buffered.
+ */
+enum huf_result io_reserve(struct huf_output *out, uint64_t size);
+
+/*
+ * Returns the next n reserved bytes of the output and counts them as
+ * written, or NULL if they have to go through io_write
+ */
+uint8_t *io_reserved(struct huf_output *out, size_t n);
+
+/* Writes n bytes, large writes skip the buffer */
+enum huf_result io_write(struct huf_output *out, const void *src, size_t n);
+
+/* Writes the buffered bytes right away */
+enum huf_result io_flush(struct huf_output *out);
+
+/* Closes the input */
+void io_close_in(struct huf_input *in);
+
+/* Writes the pending bytes and closes the output */
+enum huf_result io_close_out(struct huf_output *out);
+
+#endif	/* #ifndef IO_H */
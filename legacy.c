@@ -0,0 +1,331 @@
+#include <string.h>
+
+#include "legacy.h"
+#include "tree.h"
+#include "encode.h"
+#include "decode.h"
+#include "bitstream.h"
+#include "hist.h"
+
+/*
+ * Gets the ASCII text to be compressed, in place for a mapped input,
+ * otherwise read into *textbuf, and counts its chars on nthreads threads,
+ * or estimates them from a sample if fast
+ */
+static enum huf_result get_origtext(struct huf_input *in, int nthreads,
+		int fast, uint32_t freq[ASCII_SIZE], uint32_t *total,
+		const uint8_t **text, uint8_t **textbuf,
+		struct huf_stats *stats);
+
+/* Writes the Huffman tree to file */
+static enum huf_result write_huf(struct huf_output *out, uint32_t total_chars,
+		uint16_t huftree_size, struct huf_node *huftree);
+
+/* Writes the codes of the text after the tree */
+static enum huf_result compress(struct huf_output *out, const uint8_t *text,
+		uint32_t total, struct huf_code char_codes[ASCII_SIZE]);
+
+/*
+ * Compresses the whole input, its chars are counted on nthreads threads, or
+ * estimated from a sample if fast. The stages are timed in stats unless it
+ * is NULL, the encoding includes writing its output.
+ */
+enum huf_result legacy_compress(struct huf_input *in, struct huf_output *out,
+		int nthreads, int fast, struct huf_stats *stats)
+{
+	/*
+	 * The temporary Huffman tree implemented as an array which contains 
+	 * at position 0 the root of the tree, then the characters read from
+	 * the file and towards the tail all the other interior nodes
+	 */
+	struct tmp_huf_node *tmp_huftree = NULL;
+	struct huf_node *huftree = NULL;
+	struct huf_code char_codes[ASCII_SIZE] = {{0}};
+	struct stats_clock clock;
+	uint32_t freq[ASCII_SIZE];
+	enum huf_result r;
+	uint32_t max_len;
+	int i;
+
+	const uint8_t *origtext;	/* the non-compressed text */
+	uint8_t *origtext_buf;		/* holds it when it isn't mapped */
+	uint32_t total_chars;		/* the total number of chars */
+	uint16_t huftree_size;		/* temporary Huffman tree array size */
+	uint32_t tmp_huftree_mem;	/* allocated memory for tmp_huftree */
+
+	r = get_origtext(in, nthreads, fast, freq, &total_chars, &origtext,
+			&origtext_buf, stats);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	/* An empty text has no tree, nothing follows the sizes */
+	if (total_chars == 0) {
+		r = write_huf(out, 0, 0, NULL);
+		goto out_free;
+	}
+
+	stats_start(stats, &clock);
+	r = gen_leaves(freq, &tmp_huftree, &huftree_size, &tmp_huftree_mem);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	r = build_huftree(&tmp_huftree, &huftree_size, &tmp_huftree_mem,
+			&huftree);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+	r = gen_char_codes(huftree, huftree_size, char_codes);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+	stats_stop(stats, STATS_TREE, &clock);
+	if (stats != NULL) {
+		for (max_len = 0, i = 0; i < ASCII_SIZE; i++)
+			if (char_codes[i].len > max_len)
+				max_len = char_codes[i].len;
+		stats_tree(stats, huftree_size, max_len);
+	}
+
+	r = write_huf(out, total_chars, huftree_size, huftree);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	stats_start(stats, &clock);
+	r = compress(out, origtext, total_chars, char_codes);
+	stats_stop(stats, STATS_ENCODE, &clock);
+
+out_free:
+	free(origtext_buf);
+	free(tmp_huftree);
+	free(huftree);
+
+	return r;
+}
+
+/*
+ * Gets the ASCII text to be compressed, in place for a mapped input,
+ * otherwise read into *textbuf, and counts its chars on nthreads threads,
+ * or estimates them from a sample if fast
+ */
+static enum huf_result get_origtext(struct huf_input *in, int nthreads,
+		int fast, uint32_t freq[ASCII_SIZE], uint32_t *total,
+		const uint8_t **text, uint8_t **textbuf,
+		struct huf_stats *stats)
+{
+	struct stats_clock clock;
+	enum huf_result r;
+	const uint8_t *data;
+	uint64_t size;
+	size_t textmem, got;
+	uint8_t *tmp;
+
+	*textbuf = NULL;
+	size = io_in_size(in);
+	if (size > UINT32_MAX)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	if (size > 0) {
+		r = io_next(in, NULL, size, text, &got);
+		if (r != HUF_SUCCESS)
+			return r;
+		*total = got;
+	} else {
+		/* Streams are read in large chunks, doubling the buffer */
+		textmem = 0;
+		*total = 0;
+		do {
+			if (*total == textmem) {
+				textmem = textmem == 0 ? IO_BUF_SIZE : textmem * 2;
+				/* The char count is stored on 32 bits */
+				tmp = NULL;
+				if (textmem <= (uint64_t) UINT32_MAX + 1)
+					tmp = (uint8_t *) huf_realloc(*textbuf,
+							textmem * sizeof(uint8_t));
+				if (tmp == NULL) {
+					free(*textbuf);
+					*textbuf = NULL;
+					return textmem > UINT32_MAX ?
+						HUF_ERROR_INVALID_RESOURCE :
+						HUF_ERROR_MEMORY_ALLOC;
+				}
+				*textbuf = tmp;
+			}
+			r = io_next(in, *textbuf + *total, textmem - *total,
+					&data, &got);
+			if (r != HUF_SUCCESS) {
+				free(*textbuf);
+				*textbuf = NULL;
+				return r;
+			}
+			*total += got;
+		} while (got > 0);
+		*text = *textbuf;
+	}
+
+	/* Index is the character code, value is the number of occurences */
+	stats_start(stats, &clock);
+	if (fast)
+		hist_sample(*text, *total, freq);
+	else
+		hist_count_mt(*text, *total, nthreads, freq);
+	stats_stop(stats, STATS_HIST, &clock);
+
+	return HUF_SUCCESS;
+}
+
+/* Writes the codes of the text after the tree */
+static enum huf_result compress(struct huf_output *out, const uint8_t *text,
+		uint32_t total, struct huf_code char_codes[ASCII_SIZE])
+{
+	struct bit_writer bw;
+	enum huf_result r;
+
+	if (text == NULL)
+		return HUF_ERROR_INVALID_PARAMETER;
+
+	r = bw_init_output(&bw, out);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	/* 
+	 * The last byte is padded with zeros if the codes don't fill all of
+	 * its 8 bits. A text of a single char has no codes, nothing to write.
+	 */
+	if (total > 0 && char_codes[text[0]].len > 0)
+		huf_encode(&bw, char_codes, text, total);
+	r = bw_finish(&bw);
+	bw_close(&bw);
+
+	return r;
+}
+
+/* Writes the Huffman tree to file */
+static enum huf_result write_huf(struct huf_output *out, uint32_t total_chars,
+		uint16_t huftree_size, struct huf_node *huftree)
+{
+	enum huf_result r;
+
+	r = io_write(out, &total_chars, sizeof(uint32_t));
+	if (r == HUF_SUCCESS)
+		r = io_write(out, &huftree_size, sizeof(uint16_t));
+	if (r == HUF_SUCCESS)
+		r = io_write(out, huftree,
+				huftree_size * sizeof(struct huf_node));
+
+	return r;
+}
+
+/*
+ * Decodes n chars into dst. A text of a single char has no codes, its tree
+ * is a root without children followed by the leaf of run_char, which is
+ * negative for any other tree.
+ */
+static enum huf_result decode_text(struct huf_decoder *dec,
+		struct bit_reader *br, int run_char, uint8_t *dst, size_t n)
+{
+	if (run_char >= 0) {
+		memset(dst, run_char, n);
+		return HUF_SUCCESS;
+	}
+
+	return huf_decode(dec, br, dst, n);
+}
+
+/* Decompresses the original format, head holds its first HUF_MAGIC_CHECK bytes */
+enum huf_result decompress_huf(struct huf_input *in, struct huf_output *out,
+		uint8_t *head, struct huf_stats *stats)
+{
+	struct huf_node *huftree;	
+	struct huf_decoder *dec;
+	struct stats_clock clock;
+	struct bit_reader br;
+	enum huf_result r;
+	uint32_t total_chars;
+	uint16_t huftree_size;
+	uint32_t chars_decompressed;
+	uint8_t *outbuf = NULL, *dst;
+	size_t n;
+	int run_char;
+
+	memcpy(&total_chars, head, sizeof(uint32_t));
+	if (total_chars == 0)
+		return HUF_SUCCESS;
+
+	memcpy(&huftree_size, &head[sizeof(uint32_t)], sizeof(uint16_t));
+	if (huftree_size < 2)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	/* Reading the Huffman tree */
+	huftree = (struct huf_node *) huf_malloc(
+			huftree_size * sizeof(struct huf_node));
+	dec = (struct huf_decoder *) huf_malloc(sizeof(struct huf_decoder));
+	if (huftree == NULL || dec == NULL) {
+		r = HUF_ERROR_MEMORY_ALLOC;
+		goto out_free;
+	}
+
+	r = io_read(in, (uint8_t *) huftree,
+			huftree_size * sizeof(struct huf_node));
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	stats_start(stats, &clock);
+	run_char = -1;
+	if (huftree[0].left == NO_CHILD && huftree[0].right == NO_CHILD) {
+		if (huftree_size != 2) {
+			r = HUF_ERROR_INVALID_RESOURCE;
+			goto out_free;
+		}
+		run_char = huftree[1].val;
+	} else {
+		r = huf_decoder_init(dec, huftree, huftree_size);
+		if (r != HUF_SUCCESS)
+			goto out_free;
+	}
+	stats_stop(stats, STATS_TABLE, &clock);
+	stats_tree(stats, huftree_size, 0);
+
+	br_init_input(&br, in);
+
+	/* The total is known, so a regular output file is decoded in place */
+	r = io_reserve(out, total_chars);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+	dst = io_reserved(out, total_chars);
+	if (dst != NULL) {
+		stats_start(stats, &clock);
+		r = decode_text(dec, &br, run_char, dst, total_chars);
+		stats_stop(stats, STATS_DECODE, &clock);
+		goto out_free;
+	}
+
+	outbuf = (uint8_t *) huf_malloc(IO_BUF_SIZE * sizeof(uint8_t));
+	if (outbuf == NULL) {
+		r = HUF_ERROR_MEMORY_ALLOC;
+		goto out_free;
+	}
+
+	/* Decoding a buffer worth of chars at a time */
+	chars_decompressed = 0;
+	while (chars_decompressed < total_chars) {
+		n = total_chars - chars_decompressed;
+		if (n > IO_BUF_SIZE)
+			n = IO_BUF_SIZE;
+
+		stats_start(stats, &clock);
+		r = decode_text(dec, &br, run_char, outbuf, n);
+		stats_stop(stats, STATS_DECODE, &clock);
+		if (r != HUF_SUCCESS)
+			break;
+
+		r = io_write(out, outbuf, n);
+		if (r != HUF_SUCCESS)
+			break;
+		chars_decompressed += n;
+	}
+
+out_free:
+	free(outbuf);
+	free(dec);
+	free(huftree);
+
+	return r;
+}
@@ -0,0 +1,26 @@
+/*
+ * The original file format: the char count, the whole Huffman tree as it is
+ * held in memory, then the codes of all the text. The text is compressed in
+ * one go, so it all has to fit in memory.
+ */
+
+#ifndef LEGACY_H
+#define LEGACY_H
+
+#include "common.h"
+#include "io.h"
+#include "stats.h"
+
+/*
+ * Compresses the whole input, its chars are counted on nthreads threads, or
+ * estimated from a sample if fast. The stages are timed in stats unless it
+ * is NULL, the encoding includes writing its output.
+ */
+enum huf_result legacy_compress(struct huf_input *in, struct huf_output *out,
+		int nthreads, int fast, struct huf_stats *stats);
+
+/* Decompresses the original format, head holds its first HUF_MAGIC_CHECK bytes */
+enum huf_result decompress_huf(struct huf_input *in, struct huf_output *out,
+		uint8_t *head, struct huf_stats *stats);
+
+#endif	/* #ifndef LEGACY_H */
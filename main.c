@@ -1,397 +1,409 @@
 #include <string.h>
+#include <getopt.h>
 
 #include "common.h"
-#include "pqueue.h"
+#include "canon.h"
+#include "block.h"
+#include "stream.h"
+#include "legacy.h"
+#include "pool.h"
+#include "io.h"
+#include "stats.h"
+#include "adapt.h"
+#include "table.h"
+#include "batch.h"
+
+/* Long options without a short form */
+enum long_option {
+	OPT_STATS = 0x100,
+	OPT_RANGE,
+	OPT_TABLE,
+	OPT_MEMBER,
+	OPT_CHECKSUM,
+	OPT_TEST,
+	OPT_FAST,
+	OPT_SPLIT,
+};
 
 #define CHECK_RESULT(r)						\
 	do { 							\
 		if ((r) != HUF_SUCCESS) {			\
 			huf_print_result((r));			\
-			if (in != NULL)				\
-				fclose(in);			\
-			if (out != NULL)			\
-				fclose(out);			\
+			if (in.fd >= 0)				\
+				io_close_in(&in);		\
+			if (out.fd >= 0)			\
+				io_close_out(&out);		\
 			exit((r));				\
 		}						\
 	} while (0)		
 
-/* Stores the ASCII text to be compressed */
-enum huf_result get_origtext(FILE *in, struct tmp_huf_node **th, 
-		uint32_t *total, uint32_t *mem, 
-		char **text, uint32_t *textmem);
+/* Parses a size in bytes, with an optional K or M suffix */
+enum huf_result parse_size(const char *str, uint32_t *size);
 
-/* Decompressing, it's so simple, there's no need for more than one function */
-enum huf_result decompress(FILE *in, FILE *out);
+/* Parses START:LEN, two offsets in bytes */
+enum huf_result parse_range(const char *str, struct huf_range *range);
 
-/* Generates the codes for the caracters */
-void gen_char_codes(struct huf_node *huftree, 
-		uint16_t huftree_size, 
-		char char_codes[ASCII_SIZE][CODE_SIZE]);
-
-/* Generates the Huffman tree to be written to file */
-enum huf_result gen_huf(struct huf_node *huftree, 
-		struct tmp_huf_node *tmp_huftree, 
-		uint16_t huftree_size);
-
-/* Writes the Huffman tree to file */
-void write_huf(FILE *out, uint32_t total_chars, uint16_t huftree_size,
-		struct huf_node *huftree);
-
-void print_char_codes(char char_codes[ASCII_SIZE][CODE_SIZE]);
-
-enum huf_result compress(FILE *out, char *text, uint32_t total,
-		char char_codes[ASCII_SIZE][CODE_SIZE]);
+/* Reads the table file at path */
+enum huf_result load_table(const char *path, struct huf_table *t);
 
 int main(int argc, char **argv)
 {
-	/*
-	 * The temporary Huffman tree implemented as an array which contains 
-	 * at position 0 the root of the tree, then the characters read from
-	 * the file and towards the tail all the other interior nodes
-	 */
-	struct tmp_huf_node *tmp_huftree;
-	struct huf_node *huftree;
-	struct pqueue *pq;
+	static const struct option long_options[] = {
+		{"compress",	no_argument,		NULL, 'c'},
+		{"decompress",	no_argument,		NULL, 'd'},
+		{"legacy",	no_argument,		NULL, 'l'},
+		{"max-len",	required_argument,	NULL, 'L'},
+		{"block-size",	required_argument,	NULL, 'b'},
+		{"threads",	required_argument,	NULL, 'T'},
+		{"streams",	required_argument,	NULL, 'S'},
+		{"contexts",	required_argument,	NULL, 'x'},
+		{"stats",	optional_argument,	NULL, OPT_STATS},
+		{"index",	no_argument,		NULL, 'i'},
+		{"range",	required_argument,	NULL, OPT_RANGE},
+		{"adaptive",	no_argument,		NULL, 'a'},
+		{"table",	required_argument,	NULL, OPT_TABLE},
+		{"batch",	no_argument,		NULL, 'm'},
+		{"archive",	no_argument,		NULL, 'A'},
+		{"member",	required_argument,	NULL, OPT_MEMBER},
+		{"checksum",	no_argument,		NULL, OPT_CHECKSUM},
+		{"test",	no_argument,		NULL, OPT_TEST},
+		{"fast",	no_argument,		NULL, OPT_FAST},
+		{"split",	no_argument,		NULL, OPT_SPLIT},
+		{NULL,		0,			NULL, 0},
+	};
+
+	struct huf_input in = {.fd = -1};
+	struct huf_output out = {.fd = -1};
+	struct huf_stats stats, *sp = NULL;
+	struct huf_range range, *rp = NULL;
+	struct huf_table table;
+	struct stats_clock clock;
+	struct batch batch;
+	uint64_t freq[ASCII_SIZE];
+	char **paths = NULL;
+	int count = 0;
 	enum huf_result r;
 
-	FILE *in = NULL, *out = NULL;
-
-	char option;
-	char *origtext;			/* holds the non-compressed text */
-	char char_codes[ASCII_SIZE][CODE_SIZE] = {{0}};
-	uint32_t origtext_mem;		/* allocated memory for the text */
-	uint32_t total_chars;		/* the total number of chars */
-	uint16_t huftree_size;		/* temporary Huffman tree array size */
-	uint32_t tmp_huftree_mem;	/* allocated memory for tmp_huftree */		
-	int i;
-
-	if (argc < 4)
-		CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+	char option = 0;
+	int legacy = 0;			/* write the original format */
+	struct block_params bp;		/* max code length, substreams */
+	uint32_t block_size = DEFAULT_BLOCK_SIZE;
+	int nthreads = 1;		/* blocks processed in parallel */
+	int json = 0;			/* the stats as a JSON line */
+	int index = 0;			/* append the block index */
+	int adaptive = 0;		/* single pass, for streams */
+	const char *table_path = NULL;	/* shared code table */
+	uint64_t trained = 0;		/* bytes of the samples */
+	int many = 0;			/* a file per member */
+	int archive = 0;		/* the members in a single file */
+	const char *member = NULL;	/* the one to extract */
+	int test = 0;			/* decode and check, write nothing */
+	int max_len = 0;		/* -L, 0 for the default */
+	int c, i;
+
+	/* "train SAMPLE... TABLE" builds a table for --table */
+	block_params_init(&bp);
+	if (argc > 1 && strcmp(argv[1], "train") == 0) {
+		option = 't';
+		optind = 2;
+	}
+	while ((c = getopt_long(argc, argv, "cCdDliamAL:b:T:S:x:", long_options,
+					NULL)) != -1) {
+		if ((c == 'c' || c == 'C') && option != 't') {
+			option = 'c';
+		} else if ((c == 'd' || c == 'D') && option != 't') {
+			option = 'd';
+		} else if (c == 'l') {
+			legacy = 1;
+		} else if (c == 'i') {
+			index = 1;
+		} else if (c == 'a') {
+			adaptive = 1;
+		} else if (c == 'm') {
+			many = 1;
+		} else if (c == 'A') {
+			archive = 1;
+		} else if (c == OPT_MEMBER) {
+			member = optarg;
+		} else if (c == OPT_CHECKSUM) {
+			bp.checksum = 1;
+		} else if (c == OPT_TEST) {
+			test = 1;
+		} else if (c == OPT_FAST) {
+			bp.fast = 1;
+		} else if (c == OPT_SPLIT) {
+			bp.split = 1;
+		} else if (c == OPT_TABLE) {
+			table_path = optarg;
+		} else if (c == OPT_RANGE) {
+			r = parse_range(optarg, &range);
+			CHECK_RESULT(r);
+			rp = &range;
+		} else if (c == 'L') {
+			max_len = atoi(optarg);
+			if (max_len < MIN_CODE_LEN || max_len > MAX_CODE_LEN)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+			bp.max_len = max_len;
+		} else if (c == 'b') {
+			r = parse_size(optarg, &block_size);
+			CHECK_RESULT(r);
+			if (block_size < MIN_BLOCK_SIZE ||
+					block_size > MAX_BLOCK_SIZE)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+		} else if (c == 'T') {
+			/* Zero picks one thread per processor */
+			nthreads = atoi(optarg);
+			if (nthreads == 0)
+				nthreads = pool_cpu_count();
+			if (nthreads < 1 || nthreads > MAX_THREADS)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+		} else if (c == 'S') {
+			/* A power of two, interleaved by the decoder */
+			bp.streams = atoi(optarg);
+			if (bp.streams < 1 || bp.streams > MAX_STREAMS ||
+					(bp.streams & (bp.streams - 1)) != 0)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+		} else if (c == 'x') {
+			/* Tables picked by the preceding char, 1 for one */
+			bp.tables = atoi(optarg);
+			if (bp.tables < 1 || bp.tables > CTX_MAX_TABLES)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+		} else if (c == OPT_STATS) {
+			/* Printed on the standard error, the output may be "-" */
+			if (optarg != NULL && strcmp(optarg, "json") != 0)
+				CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+			json = optarg != NULL;
+			sp = &stats;
+		} else {
+			CHECK_RESULT(HUF_ERROR_UNKNOWN_OPTION);
+		}
+	}
 
-	if (strcmp(argv[1], "-c") == 0 || strcmp(argv[1], "-C") == 0)
-		option = 'c';
-	else if (strcmp(argv[1], "-d") == 0 || strcmp(argv[1], "-D") == 0)
-		option = 'd';
-	else
+	if (option == 0)
 		CHECK_RESULT(HUF_ERROR_UNKNOWN_OPTION);
+	/*
+	 * The index is only written in the framed format, and adaptive
+	 * blocks can't be decoded out of order
+	 */
+	if ((index && (option != 'c' || legacy || adaptive)) ||
+			(adaptive && (option != 'c' || legacy)) ||
+			(rp != NULL && option != 'd'))
+		CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+	/* A message is a single bit stream, no frame around it */
+	if (table_path != NULL && (option == 't' || legacy || adaptive ||
+				index || rp != NULL || bp.tables > 1))
+		CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+	/* The members are always framed, one after the other */
+	if ((many || archive) && (option == 't' || legacy || adaptive ||
+				index || rp != NULL || table_path != NULL ||
+				(many && archive)))
+		CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+	if (member != NULL && (!archive || option != 'd'))
+		CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+	/* Only the blocks of frames have checksums, tests need no output */
+	if ((bp.checksum && (option != 'c' || legacy || adaptive ||
+				table_path != NULL)) || (test && option != 'd'))
+		CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+	/* A sample only gives order 0 counts, adaptive blocks take none */
+	if (bp.fast && (option != 'c' || adaptive || table_path != NULL ||
+				bp.tables > 1))
+		CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+	/* Every char a sample missed gets a code, longer ones cost it less */
+	if (bp.fast && max_len == 0)
+		bp.max_len = FAST_CODE_LEN;
+	/*
+	 * Only frames have blocks of their own size, found from the counts of
+	 * every segment, which a sample doesn't have
+	 */
+	if (bp.split && (option != 'c' || legacy || adaptive ||
+				table_path != NULL || bp.fast))
+		CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
+	if (argc - optind < (test ? 1 : 2))
+		CHECK_RESULT(HUF_ERROR_INVALID_ARGUMENTS);
 
-	in = fopen(argv[2], "r");
-	if (in == NULL)
-		CHECK_RESULT(HUF_ERROR_FILE_ACCESS);
+	if (sp != NULL)
+		stats_init(sp);
+	bp.stats = sp;
 
-	out = fopen(argv[3], "wb");
-	if (out == NULL)
-		CHECK_RESULT(HUF_ERROR_FILE_ACCESS);
+	if (table_path != NULL) {
+		r = load_table(table_path, &table);
+		CHECK_RESULT(r);
+	}
 
-	if (option == 'c') {
-		origtext_mem = TEXT_SIZE;
-		origtext = (char *) malloc(origtext_mem * sizeof(char));
-		if (origtext == NULL)
-			CHECK_RESULT(HUF_ERROR_MEMORY_ALLOC);
+	/* Every sample is counted, the table goes to the last argument */
+	if (option == 't') {
+		memset(freq, 0, sizeof(freq));
+		for (i = optind; i < argc - 1; i++) {
+			r = io_open_in(&in, argv[i]);
+			CHECK_RESULT(r);
+			in.stats = sp;
+			stats_start(sp, &clock);
+			r = table_count(&in, freq);
+			CHECK_RESULT(r);
+			stats_stop(sp, STATS_HIST, &clock);
+			trained += in.pos;
+			io_close_in(&in);
+		}
+		in.pos = trained;
+		optind = argc - 2;
+	}
 
-		r = get_origtext(in, &tmp_huftree, &total_chars, 
-				&tmp_huftree_mem, 
-				&origtext, &origtext_mem);
+	/* The members are listed by a file or a directory */
+	batch.block_size = block_size;
+	batch.bp = &bp;
+	batch.nthreads = nthreads;
+	batch.test = test;
+	if (many || (archive && option == 'c')) {
+		r = batch_list(argv[optind], &paths, &count);
 		CHECK_RESULT(r);
-		huftree_size = tmp_huftree_mem;
+	}
 
-		/* The priority queue size is equal to all the distinct read chars */
-		r = pqueue_init(&pq, huftree_size - 1);
+	/* "-" stands for the standard input and output */
+	if (option != 't' && paths == NULL) {
+		r = io_open_in(&in, argv[optind]);
+		CHECK_RESULT(r);
+		in.stats = sp;
+	}
+	if (test) {
+		io_open_null(&out);
+	} else if (!many && !(archive && option == 'd' && member == NULL)) {
+		r = io_open_out(&out, argv[optind + 1]);
 		CHECK_RESULT(r);
+		out.stats = sp;
+	}
 
-		/* Linking the original array of chars to the priority queue */
-		for (i = 1; i < huftree_size; i++) {
-			r = pq->insert(&tmp_huftree[i], i);
+	/* The reads and writes overlap with the work, messages are too small */
+	if (option != 't' && table_path == NULL) {
+		if (in.fd >= 0) {
+			r = io_read_ahead(&in);
+			CHECK_RESULT(r);
+		}
+		if (out.fd >= 0) {
+			r = io_write_behind(&out);
 			CHECK_RESULT(r);
 		}
+	}
 
-		r = pq->gen_tmp_huf(&tmp_huftree, &huftree_size,
-				&tmp_huftree_mem);
+	if (many && option == 'c') {
+		r = batch_compress(paths, count, argv[optind + 1], &batch);
 		CHECK_RESULT(r);
-		pqueue_destroy(&pq);
-
-		/* Generating the Huffman tree to be written to disk */
-		huftree = (struct huf_node *) malloc(
-				huftree_size * sizeof(struct huf_node));
-		if (huftree == NULL)
-			CHECK_RESULT(HUF_ERROR_MEMORY_ALLOC);
-
-		r = gen_huf(huftree, tmp_huftree, huftree_size);
+	} else if (many) {
+		r = batch_decompress(paths, count, argv[optind + 1], &batch);
 		CHECK_RESULT(r);
-		write_huf(out, total_chars, huftree_size, huftree);
-
-		gen_char_codes(huftree, huftree_size, char_codes);
-		r = compress(out, origtext, total_chars, char_codes);
+	} else if (archive && option == 'c') {
+		r = archive_create(paths, count, &out, &batch);
+		CHECK_RESULT(r);
+	} else if (archive && member != NULL) {
+		r = archive_extract_member(&in, &out, member, &batch);
+		CHECK_RESULT(r);
+	} else if (archive) {
+		r = archive_extract(&in, argv[optind + 1], &batch);
+		CHECK_RESULT(r);
+	} else if (option == 't') {
+		stats_start(sp, &clock);
+		r = table_build(&table, freq, bp.max_len);
+		CHECK_RESULT(r);
+		stats_stop(sp, STATS_TREE, &clock);
+		r = table_write(&table, &out);
+		CHECK_RESULT(r);
+	} else if (table_path != NULL && option == 'c') {
+		r = table_compress(&in, &out, &table, sp);
+		CHECK_RESULT(r);
+	} else if (table_path != NULL) {
+		r = table_decompress(&in, &out, &table, sp);
+		CHECK_RESULT(r);
+	} else if (option == 'c' && adaptive) {
+		r = adapt_compress(&in, &out, sp);
+		CHECK_RESULT(r);
+	} else if (option == 'c' && !legacy) {
+		r = compress_frame(&in, &out, block_size, &bp, index,
+				nthreads);
+		CHECK_RESULT(r);
+	} else if (option == 'c') {
+		r = legacy_compress(&in, &out, nthreads, bp.fast, sp);
 		CHECK_RESULT(r);
-
-		/* Cleaning up */
-		free(origtext);
-		free(tmp_huftree);
-		free(huftree);
 	} else {
-		r = decompress(in, out);
+		r = decompress_file(&in, &out, rp, nthreads, sp);
 		CHECK_RESULT(r);
 	}
 
-	fclose(in);
-	fclose(out);
+	if (in.fd >= 0)
+		io_close_in(&in);
 
-	return EXIT_SUCCESS;
-}
-
-enum huf_result get_origtext(FILE *in, struct tmp_huf_node **th, 
-		uint32_t *total, uint32_t *mem, 
-		char **text, uint32_t *textmem)
-{
-	uint32_t v[ASCII_SIZE] = {0};
-	/* EOF is -1, int16_t is from -256 to 255 */
-	int16_t c;		
-	int i, j;
-
-	/* Index is the character code, value is the number of occurences */
-	*total = 0;
-	*mem = 0;
-	while ((c = fgetc(in)) != EOF) {
-		if (*total == *textmem) {
-			*textmem = *textmem * 2;
-			*text = (char *) realloc(
-					*text, *textmem * sizeof(char));
-		}
-		(*text)[*total] = c;
-
-		if (v[c] == 0)
-			(*mem)++;
-		v[c]++;
-		(*total)++;
+	/* Buffered output that can't be written is only reported here */
+	if (out.fd >= 0) {
+		r = io_close_out(&out);
+		CHECK_RESULT(r);
 	}
-	(*text)[*total] = '\0';
-
-	(*mem)++;
-	*th = (struct tmp_huf_node *) malloc(
-			(*mem) * sizeof(struct tmp_huf_node));
-	if (*th == NULL)
-		return HUF_ERROR_MEMORY_ALLOC;
-
-	/*
-	 * Creating the Huffman array by adding all the read chars starting
-	 * at index 1, after the root
-	 */
-	(*th)[0].freq = 0;
-	(*th)[0].val = 0;
-	(*th)[0].left = NO_CHILD;
-	(*th)[0].right = NO_CHILD;
-
-	i = 1;
-	for (j = 0; j < ASCII_SIZE; j++)
-		if (v[j] > 0) {
-			(*th)[i].freq = v[j];
-			(*th)[i].val = j;
-			(*th)[i].left = NO_CHILD;
-			(*th)[i].right = NO_CHILD;
-			i++;
-		}
-
-	return HUF_SUCCESS;
-}
-
-/* Using Depth-first search on the tmp_huftree to generate the codes */
-void gen_char_codes(struct huf_node *huftree, 
-		uint16_t huftree_size, 
-		char char_codes[ASCII_SIZE][CODE_SIZE])
-{
-	/* CODE_SIZE takes into account the null terminating character */
-	unsigned char codes[CODE_SIZE - 1];
-	unsigned char current_character;
-	int dfs_stack[CODE_SIZE - 1];
-	int seen_nodes[huftree_size];
-	int stack_index, tree_index, codes_index;
-	int i;
-
-	for (i = 0; i < huftree_size; i++)
-		seen_nodes[i] = NOT_VISITED;
-
-	/* Visiting the root */
-	tree_index = 0;
-	stack_index = 0;
-	dfs_stack[stack_index] = tree_index;
-	seen_nodes[tree_index] = IS_VISITED;
-
-	codes_index = 0;
-	while (stack_index >= 0) {
-		if ((huftree[tree_index].left == -1 ||
-			seen_nodes[huftree[tree_index].left] == IS_VISITED) &&
-			(huftree[tree_index].right == -1 || 
-			seen_nodes[huftree[tree_index].right] == IS_VISITED)) {
-				/* 
-				 * If we are at a leaf, we generate the
-				 * character code
-				 */
-				if (huftree[tree_index].left == -1 &&
-						huftree[tree_index].right == -1) {
-					current_character = huftree[tree_index].val;
-					for (i = 0; i < codes_index; i++)
-						char_codes[current_character][i] = codes[i];
-
-					char_codes[current_character][i] = '\0';
-				}
-				codes_index--;
-
-				tree_index = dfs_stack[--stack_index];
-		} else {
-			/* Going left */
-			if (huftree[tree_index].left != -1 &&
-			seen_nodes[huftree[tree_index].left] == NOT_VISITED) {
-				tree_index = huftree[tree_index].left;
-				codes[codes_index++] = LEFT_CHILD_CODE;
-			/* Going right */
-			} else {
-				tree_index = huftree[tree_index].right;
-				codes[codes_index++] = RIGHT_CHILD_CODE;
-			}
-			dfs_stack[++stack_index] = tree_index;
-			seen_nodes[tree_index] = IS_VISITED;
+	batch_list_free(paths, count);
+
+	if (sp != NULL) {
+		stats.in_bytes = in.pos;
+		stats.out_bytes = out.pos;
+		if (many || archive) {
+			stats.in_bytes = batch.in_bytes;
+			stats.out_bytes = batch.out_bytes;
 		}
+		stats.allocs = huf_alloc_count();
+		stats_finish(&stats);
+		stats_print(stderr, &stats, option == 'c', json);
 	}
-}
 
-void print_char_codes(char char_codes[ASCII_SIZE][CODE_SIZE])
-{
-	int i;
-
-	for (i = 0; i < ASCII_SIZE; i++)
-		if (char_codes[i][0] != '\0')
-			printf("%c - %s\n", i, char_codes[i]);
-	printf("\n");
+	return EXIT_SUCCESS;
 }
 
-enum huf_result compress(FILE *out, char *text, uint32_t total,
-		char char_codes[ASCII_SIZE][CODE_SIZE])
+/* Parses a size in bytes, with an optional K or M suffix */
+enum huf_result parse_size(const char *str, uint32_t *size)
 {
-	int i, j;
-	uint8_t bitcount;
-	uint8_t num_to_write;
-	uint16_t code_len;
-	char *current_code;
-
-	if (text == NULL)
-		return HUF_ERROR_INVALID_PARAMETER;
-
-	bitcount = 0;
-	num_to_write = 0;
-	for (i = 0; i < total; i++) {
-		current_code = char_codes[(uint8_t) text[i]];
-		code_len = strlen(current_code);
-		/* 
-		 * Calculating the decimal number corresponding to the code, 8
-		 * bits at a time
-		 * */
-		for (j = 0; j < code_len; j++) {
-			num_to_write = (num_to_write << 1) + (current_code[j] - '0');
-			bitcount++;
-			if (bitcount == WRITE_SIZE) {
-				bitcount = 0;
-				fwrite(&num_to_write, sizeof(uint8_t), 1, out);
-				num_to_write = 0;
-			}
-		}
-	}
-	/* 
-	 * If I haven't written a full set of 8 bits after I compressed the
-	 * message, I write zeros at the end until writing 8 bits
-	 */
-	if (bitcount > 0) {
-		for (i = bitcount + 1; i <= WRITE_SIZE; i++)
-			num_to_write = num_to_write << 1;
-		fwrite(&num_to_write, sizeof(uint8_t), 1, out);
+	unsigned long long v;
+	char *end;
+
+	v = strtoull(str, &end, 10);
+	if (end == str)
+		return HUF_ERROR_INVALID_ARGUMENTS;
+
+	if (*end == 'k' || *end == 'K') {
+		v <<= 10;
+		end++;
+	} else if (*end == 'm' || *end == 'M') {
+		v <<= 20;
+		end++;
 	}
+	if (*end != '\0' || v > UINT32_MAX)
+		return HUF_ERROR_INVALID_ARGUMENTS;
+	*size = v;
 
 	return HUF_SUCCESS;
 }
 
-/* Generates the Huffman tree to be written to file */
-enum huf_result gen_huf(struct huf_node *huftree, 
-		struct tmp_huf_node *tmp_huftree, 
-		uint16_t huftree_size)
+/* Parses START:LEN, two offsets in bytes */
+enum huf_result parse_range(const char *str, struct huf_range *range)
 {
-	int i;
+	char *end;
 
-	if (huftree_size == 0)
-		return HUF_ERROR_INVALID_RESOURCE;
+	range->start = strtoull(str, &end, 10);
+	if (end == str || *end != ':')
+		return HUF_ERROR_INVALID_ARGUMENTS;
 
-	for (i = 0; i < huftree_size; i++) {
-		huftree[i].val = tmp_huftree[i].val;
-		huftree[i].left = tmp_huftree[i].left;
-		huftree[i].right = tmp_huftree[i].right;
-	}
+	str = end + 1;
+	range->len = strtoull(str, &end, 10);
+	if (end == str || *end != '\0')
+		return HUF_ERROR_INVALID_ARGUMENTS;
 
 	return HUF_SUCCESS;
 }
 
-/* Writes the Huffman tree to file */
-void write_huf(FILE *out, uint32_t total_chars, uint16_t huftree_size,
-		struct huf_node *huftree)
+/* Reads the table file at path */
+enum huf_result load_table(const char *path, struct huf_table *t)
 {
-	fwrite(&total_chars, sizeof(uint32_t), 1, out);
-	fwrite(&huftree_size, sizeof(uint16_t), 1, out);
-	fwrite(huftree, sizeof(struct huf_node), huftree_size, out);
-}
+	struct huf_input in = {.fd = -1};
+	enum huf_result r;
 
-/* Decompressing, it's so simple, there's no need for more than one function */
-enum huf_result decompress(FILE *in, FILE *out)
-{
-	struct huf_node *huftree;	
-	uint32_t total_chars;
-	uint16_t huftree_size;
-	uint8_t block, mask;
-	int16_t bitcount;
-	uint32_t chars_decompressed;
-	int i;
-
-	fread(&total_chars, sizeof(uint32_t), 1, in);
-	if (total_chars < 2)
-		return HUF_ERROR_INVALID_RESOURCE;
-
-	fread(&huftree_size, sizeof(uint16_t), 1, in);
-	if (huftree_size < 2)
-		return HUF_ERROR_INVALID_RESOURCE;
-
-	/* Reading the Huffman tree */
-	huftree = (struct huf_node *) malloc(
-			huftree_size * sizeof(struct huf_node));
-	fread(huftree, sizeof(struct huf_node), huftree_size, in);
-
-	i = 0;
-	chars_decompressed = 0;
-	while (chars_decompressed < total_chars) {
-		fread(&block, sizeof(uint8_t), 1, in);
-
-		for (bitcount = WRITE_SIZE - 1; bitcount >= 0; bitcount--) {
-			mask = 0;
-			mask = 1 << bitcount;
-
-			/* Daca am 0 pe pozitia curenta merg la stanga */
-			if ((block & mask) == 0)
-				i = (huftree[i].left);
-			/* Altfel merg la dreapta */
-			else
-				i = (huftree[i].right);
-
-			/* 
-			 * Daca sunt la un nod frunza, il printez si incep
-			 * calcularea unui nou drum de la radacina
-			 */
-			if (huftree[i].left == NO_CHILD && 
-					huftree[i].right == NO_CHILD) {
-				fputc(huftree[i].val, out);
-				chars_decompressed++;
-
-				if (chars_decompressed == total_chars)
-					break;
-				i = 0;
-			}
-		}
-	}
-	free(huftree);
+	r = io_open_in(&in, path);
+	if (r != HUF_SUCCESS)
+		return r;
+	r = table_read(t, &in);
+	io_close_in(&in);
 
-	return HUF_SUCCESS;
+	return r;
 }
@@ -0,0 +1,160 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+struct pool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;		/* a job was queued, or stopping */
+	pthread_cond_t done;		/* a job has finished */
+	struct pool_job *head;
+	struct pool_job *tail;
+	pthread_t *threads;
+	int nthreads;
+	int stop;
+};
+
+static void *worker(void *arg)
+{
+	struct pool *p = (struct pool *) arg;
+	struct pool_job *job;
+
+	pthread_mutex_lock(&p->lock);
+	while (1) {
+		while (p->head == NULL && !p->stop)
+			pthread_cond_wait(&p->work, &p->lock);
+		if (p->head == NULL)
+			break;
+
+		job = p->head;
+		p->head = job->next;
+		if (p->head == NULL)
+			p->tail = NULL;
+		pthread_mutex_unlock(&p->lock);
+
+		job->fn(job->arg);
+
+		pthread_mutex_lock(&p->lock);
+		job->done = 1;
+		pthread_cond_broadcast(&p->done);
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	return NULL;
+}
+
+/* Starts nthreads workers, no pool is created for a single thread */
+enum huf_result pool_init(struct pool **p, int nthreads)
+{
+	int i;
+
+	*p = NULL;
+	if (nthreads < 1 || nthreads > MAX_THREADS)
+		return HUF_ERROR_INVALID_PARAMETER;
+	if (nthreads == 1)
+		return HUF_SUCCESS;
+
+	*p = (struct pool *) huf_malloc(sizeof(struct pool));
+	if (*p == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+	(*p)->threads = (pthread_t *) huf_malloc(nthreads * sizeof(pthread_t));
+	if ((*p)->threads == NULL) {
+		free(*p);
+		*p = NULL;
+		return HUF_ERROR_MEMORY_ALLOC;
+	}
+
+	pthread_mutex_init(&(*p)->lock, NULL);
+	pthread_cond_init(&(*p)->work, NULL);
+	pthread_cond_init(&(*p)->done, NULL);
+	(*p)->head = NULL;
+	(*p)->tail = NULL;
+	(*p)->stop = 0;
+
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&(*p)->threads[i], NULL, worker, *p) != 0)
+			break;
+	(*p)->nthreads = i;
+
+	/* Running with fewer workers is fine, running with none is not */
+	if (i == 0) {
+		pool_destroy(p);
+		return HUF_ERROR_UNKNOWN_ERROR;
+	}
+
+	return HUF_SUCCESS;
+}
+
+/* Queues the job, or runs it right away without a pool */
+void pool_submit(struct pool *p, struct pool_job *job)
+{
+	job->done = 0;
+	job->next = NULL;
+
+	if (p == NULL) {
+		job->fn(job->arg);
+		job->done = 1;
+		return;
+	}
+
+	pthread_mutex_lock(&p->lock);
+	if (p->tail == NULL)
+		p->head = job;
+	else
+		p->tail->next = job;
+	p->tail = job;
+	pthread_cond_signal(&p->work);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/* Waits until the job has run */
+void pool_wait(struct pool *p, struct pool_job *job)
+{
+	if (p == NULL)
+		return;
+
+	pthread_mutex_lock(&p->lock);
+	while (!job->done)
+		pthread_cond_wait(&p->done, &p->lock);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/* Stops the workers once the queue is empty and frees the pool */
+enum huf_result pool_destroy(struct pool **p)
+{
+	int i;
+
+	if (*p == NULL)
+		return HUF_SUCCESS;
+
+	pthread_mutex_lock(&(*p)->lock);
+	(*p)->stop = 1;
+	pthread_cond_broadcast(&(*p)->work);
+	pthread_mutex_unlock(&(*p)->lock);
+
+	for (i = 0; i < (*p)->nthreads; i++)
+		pthread_join((*p)->threads[i], NULL);
+
+	pthread_cond_destroy(&(*p)->done);
+	pthread_cond_destroy(&(*p)->work);
+	pthread_mutex_destroy(&(*p)->lock);
+	free((*p)->threads);
+	free(*p);
+	*p = NULL;
+
+	return HUF_SUCCESS;
+}
+
+/* Number of online processors, used for -T 0 */
+int pool_cpu_count(void)
+{
+	long n;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		return 1;
+	if (n > MAX_THREADS)
+		return MAX_THREADS;
+
+	return n;
+}
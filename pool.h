@@ -0,0 +1,38 @@
+/*
+ * Fixed pool of worker threads running the jobs in the order they were
+ * submitted. Jobs are owned by the caller, which waits on every one of them
+ * before reusing it.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "common.h"
+
+#define MAX_THREADS		(256)
+
+struct pool_job {
+	void (*fn) (void *arg);
+	void *arg;
+	int done;
+	struct pool_job *next;
+};
+
+struct pool;
+
+/* Starts nthreads workers, no pool is created for a single thread */
+enum huf_result pool_init(struct pool **p, int nthreads);
+
+/* Queues the job, or runs it right away without a pool */
+void pool_submit(struct pool *p, struct pool_job *job);
+
+/* Waits until the job has run */
+void pool_wait(struct pool *p, struct pool_job *job);
+
+/* Stops the workers once the queue is empty and frees the pool */
+enum huf_result pool_destroy(struct pool **p);
+
+/* Number of online processors, used for -T 0 */
+int pool_cpu_count(void);
+
+#endif	/* #ifndef POOL_H */
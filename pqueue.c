@@ -1,11 +1,11 @@
 #include "pqueue.h"
 
-static struct heap_huf_node {
+struct heap_huf_node {
 	uint16_t index;			/* index in the tmp_huftree */
 	unsigned int freq;
 };
 
-static struct heap {
+struct heap {
 	/* 
 	 * Array of pointers to the temporary Huffman tree which is stored in 
 	 * memory as an array
@@ -16,27 +16,26 @@ static struct heap {
 };
 
 /* Inserts a new element into the heap */
-static enum huf_result insert(struct tmp_huf_node *c, uint16_t index);
+static enum huf_result insert(struct pqueue *pq, struct tmp_huf_node *c,
+		uint16_t index);
 
 /* Rearranges the heap from the bottom up so the heap conditions are met */
-static enum huf_result sift_up();
+static enum huf_result sift_up(struct heap *h);
 
 /* Rearranges the heap from the top down so the heap conditions are met */
-static enum huf_result sift_down(uint16_t root);
+static enum huf_result sift_down(struct heap *h, uint16_t root);
 
 /* Prints the heap */
-static enum huf_result print();
+static enum huf_result print(struct pqueue *pq);
 
 /* Creates the temporary Huffman tree in memory from the heap */
-static enum huf_result gen_tmp_huf (struct tmp_huf_node **tmp_huftree,
+static enum huf_result gen_tmp_huf(struct pqueue *pq,
+		struct tmp_huf_node **tmp_huftree,
 		uint16_t *tmp_huftree_size,
 		uint32_t *tmp_huftree_mem);
 
 /* Creates a new tmp_huf_node as the parent of the two children */
-static struct tmp_huf_node *merge_into_one();
-
-/* The priority queue is stored internally as a heap */
-static struct heap *h = NULL;	
+static struct tmp_huf_node merge_into_one(struct heap *h);
 
 /* Returns the parent of element at position index */
 static inline int get_parent(int index)
@@ -50,32 +49,38 @@ static inline int get_parent(int index)
 		return index / 2;
 }
 
-static inline void delete_node(uint16_t node)
+static inline void delete_node(struct heap *h, uint16_t node)
 {
 	h->huf_nodes[node] = h->huf_nodes[h->size - 1];
 	h->size--;
-	sift_down(node);
+	sift_down(h, node);
 }
 
 /* Assigns struct functions and initializes internal variables */
 enum huf_result pqueue_init(struct pqueue **pq, uint16_t n)
 {
-	*pq = (struct pqueue *) malloc(sizeof(struct pqueue));
+	struct heap *h;
+
+	*pq = (struct pqueue *) huf_malloc(sizeof(struct pqueue));
+	if (*pq == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
 	(*pq)->insert = insert;
 	(*pq)->print = print;
 	(*pq)->gen_tmp_huf = gen_tmp_huf;
 
-	h = (struct heap *) malloc(sizeof(struct heap));
+	/* Every queue owns its heap, so they can be used from many threads */
+	h = (struct heap *) huf_malloc(sizeof(struct heap));
+	(*pq)->h = h;
 	if (h == NULL)
 		return HUF_ERROR_MEMORY_ALLOC;
 
 	/* Allocating memory for the heap elements */
 	h->max_size = n;
-	h->huf_nodes = (struct heap_huf_node *) malloc(
+	h->huf_nodes = (struct heap_huf_node *) huf_malloc(
 			h->max_size * sizeof(struct heap_huf_node));
+	h->size = 0;
 	if (h->huf_nodes == NULL)
 		return HUF_ERROR_MEMORY_ALLOC;
-	h->size = 0;
 
 	return HUF_SUCCESS;
 }
@@ -83,9 +88,12 @@ enum huf_result pqueue_init(struct pqueue **pq, uint16_t n)
 /* Removes struct functions and frees memory */
 enum huf_result pqueue_destroy(struct pqueue **pq)
 {
-	free(h->huf_nodes);
-	free(h);
-	h = NULL;
+	if (*pq == NULL)
+		return HUF_SUCCESS;
+
+	if ((*pq)->h != NULL)
+		free((*pq)->h->huf_nodes);
+	free((*pq)->h);
 	free(*pq);
 	*pq = NULL;
 
@@ -93,8 +101,9 @@ enum huf_result pqueue_destroy(struct pqueue **pq)
 }
 
 /* Prints the heap */
-static enum huf_result print()
+static enum huf_result print(struct pqueue *pq)
 {
+	struct heap *h = pq->h;
 	int i;
 
 	if (h == NULL)
@@ -113,8 +122,10 @@ static enum huf_result print()
 	return HUF_SUCCESS;
 }
 
-static enum huf_result insert(struct tmp_huf_node *c, uint16_t index)
+static enum huf_result insert(struct pqueue *pq, struct tmp_huf_node *c,
+		uint16_t index)
 {
+	struct heap *h = pq->h;
 	enum huf_result r;
 	uint16_t pos;
 
@@ -129,17 +140,19 @@ static enum huf_result insert(struct tmp_huf_node *c, uint16_t index)
 	h->huf_nodes[pos].index = index;
 	h->size++;
 
-	r = sift_up();
+	r = sift_up(h);
 
 	return r;
 }
 
 /* Creates the temporary Huffman tree in memory from the heap */
-static enum huf_result gen_tmp_huf (struct tmp_huf_node **tmp_huftree,
+static enum huf_result gen_tmp_huf(struct pqueue *pq,
+		struct tmp_huf_node **tmp_huftree,
 		uint16_t *tmp_huftree_size,
 		uint32_t *tmp_huftree_mem)
 {
-	struct tmp_huf_node *new;
+	struct heap *h = pq->h;
+	struct tmp_huf_node new;
 	uint16_t insert_pos;
 
 	if (h == NULL || h->size == 0)
@@ -149,11 +162,11 @@ static enum huf_result gen_tmp_huf (struct tmp_huf_node **tmp_huftree,
 		return HUF_ERROR_INVALID_ARGUMENTS;
 
 	while (h->size > 1) {
-		new = merge_into_one();
+		new = merge_into_one(h);
 		/* Reallocating memory for the Huffman tree, if necessary */
 		if (*tmp_huftree_mem == *tmp_huftree_size) {
 			*tmp_huftree_mem = *tmp_huftree_mem * 2;
-			*tmp_huftree = (struct tmp_huf_node *) realloc(
+			*tmp_huftree = (struct tmp_huf_node *) huf_realloc(
 					*tmp_huftree, 
 					*tmp_huftree_mem * sizeof(struct tmp_huf_node));
 		}
@@ -163,46 +176,43 @@ static enum huf_result gen_tmp_huf (struct tmp_huf_node **tmp_huftree,
 		 * tree array
 		 */
 		if (h->size == 0) {
-			(*tmp_huftree)[0] = *new;
+			(*tmp_huftree)[0] = new;
 		} else {
 			insert_pos = *tmp_huftree_size;
-			(*tmp_huftree)[insert_pos] = *new;
+			(*tmp_huftree)[insert_pos] = new;
 			(*tmp_huftree_size)++;
-			insert(&((*tmp_huftree)[insert_pos]), insert_pos);
+			insert(pq, &((*tmp_huftree)[insert_pos]), insert_pos);
 		}
-
-		free(new);
 	}
 
 	return HUF_SUCCESS;
 }
 
 /* Creates a new tmp_huf_node as the parent of the two children */
-static struct tmp_huf_node *merge_into_one()
+static struct tmp_huf_node merge_into_one(struct heap *h)
 {
-	struct tmp_huf_node *new;
+	struct tmp_huf_node new;
 	struct heap_huf_node left_child, right_child;
 
 	left_child = h->huf_nodes[0];
-	delete_node(0);
+	delete_node(h, 0);
 	right_child = h->huf_nodes[0];
-	delete_node(0);
+	delete_node(h, 0);
 
 	/* 
 	 * Creating new tmp_huftree node as the sum of the occurences of the two
 	 * children nodes
 	 */
-	new = (struct tmp_huf_node *) malloc(sizeof(struct tmp_huf_node));
-	new->val = 0;
-	new->freq = left_child.freq + right_child.freq;
-	new->left = left_child.index;
-	new->right = right_child.index;
+	new.val = 0;
+	new.freq = left_child.freq + right_child.freq;
+	new.left = left_child.index;
+	new.right = right_child.index;
 
 	return new;
 }
 
 /* Rearranges the heap from the bottom up so the heap conditions are met */
-static enum huf_result sift_up()
+static enum huf_result sift_up(struct heap *h)
 {
 	struct heap_huf_node tmp;
 	int index, parent;
@@ -231,7 +241,7 @@ static enum huf_result sift_up()
 }
 
 /* Rearranges the heap from the top down so the heap conditions are met */
-static enum huf_result sift_down(uint16_t root)
+static enum huf_result sift_down(struct heap *h, uint16_t root)
 {
 	struct heap_huf_node tmp;
 	int index, left_child, right_child;
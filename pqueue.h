@@ -7,12 +7,18 @@
 
 #include "common.h"
 
+struct heap;
+
+/* Every function works on the heap of the queue it is given */
 struct pqueue {
-	enum huf_result (*insert) (struct tmp_huf_node *c, uint16_t index);
-	enum huf_result (*print) ();
-	enum huf_result (*gen_tmp_huf) (struct tmp_huf_node **tmp_huftree,
+	enum huf_result (*insert) (struct pqueue *pq, struct tmp_huf_node *c,
+			uint16_t index);
+	enum huf_result (*print) (struct pqueue *pq);
+	enum huf_result (*gen_tmp_huf) (struct pqueue *pq,
+			struct tmp_huf_node **tmp_huftree,
 			uint16_t *tmp_huftree_size,
 			uint32_t *tmp_huftree_mem);
+	struct heap *h;
 };
 
 /* Assigns struct functions and initializes internal variables */
@@ -0,0 +1,269 @@
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "ring.h"
+#include "io.h"
+
+struct io_ring {
+	pthread_mutex_t lock;
+	pthread_cond_t thread_cond;	/* the thread can go on, or stopping */
+	pthread_cond_t caller_cond;	/* the program can go on */
+	pthread_t thread;
+	int fd;
+	uint8_t *bufs[RING_BUFS];
+	size_t len[RING_BUFS];
+	uint64_t filled;		/* buffers read, or queued to write */
+	uint64_t taken;			/* buffers handed back, or written */
+	int holding;			/* the program reads the oldest buffer */
+	int is_reader;
+	int done;			/* the reader is at the end or failed */
+	int stop;
+	enum huf_result r;
+};
+
+static void *reader(void *arg)
+{
+	struct io_ring *ring = (struct io_ring *) arg;
+	uint8_t *p;
+	ssize_t k;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	pthread_mutex_lock(&ring->lock);
+	while (1) {
+		while (ring->filled - ring->taken == RING_BUFS && !ring->stop)
+			pthread_cond_wait(&ring->thread_cond, &ring->lock);
+		if (ring->stop)
+			break;
+		p = ring->bufs[ring->filled % RING_BUFS];
+		pthread_mutex_unlock(&ring->lock);
+
+		/* Only a read without the lock held can be interrupted */
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		do {
+			k = read(ring->fd, p, IO_BUF_SIZE);
+		} while (k < 0 && errno == EINTR);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+		pthread_mutex_lock(&ring->lock);
+		if (k <= 0) {
+			if (k < 0)
+				ring->r = HUF_ERROR_FILE_ACCESS;
+			break;
+		}
+		ring->len[ring->filled % RING_BUFS] = k;
+		ring->filled++;
+		pthread_cond_signal(&ring->caller_cond);
+	}
+	ring->done = 1;
+	pthread_cond_signal(&ring->caller_cond);
+	pthread_mutex_unlock(&ring->lock);
+
+	return NULL;
+}
+
+static void *writer(void *arg)
+{
+	struct io_ring *ring = (struct io_ring *) arg;
+	enum huf_result r = HUF_SUCCESS;
+	const uint8_t *p;
+	size_t n;
+	ssize_t k;
+
+	pthread_mutex_lock(&ring->lock);
+	while (1) {
+		while (ring->taken == ring->filled && !ring->stop)
+			pthread_cond_wait(&ring->thread_cond, &ring->lock);
+		if (ring->taken == ring->filled)
+			break;
+		p = ring->bufs[ring->taken % RING_BUFS];
+		n = ring->len[ring->taken % RING_BUFS];
+		pthread_mutex_unlock(&ring->lock);
+
+		/* After an error the buffers are only handed back */
+		while (n > 0 && r == HUF_SUCCESS) {
+			k = write(ring->fd, p, n);
+			if (k < 0 && errno == EINTR)
+				continue;
+			if (k <= 0) {
+				r = HUF_ERROR_FILE_ACCESS;
+				break;
+			}
+			p += k;
+			n -= k;
+		}
+
+		pthread_mutex_lock(&ring->lock);
+		ring->r = r;
+		ring->taken++;
+		pthread_cond_signal(&ring->caller_cond);
+	}
+	pthread_mutex_unlock(&ring->lock);
+
+	return NULL;
+}
+
+static void free_ring(struct io_ring *ring)
+{
+	int i;
+
+	for (i = 0; i < RING_BUFS; i++)
+		free(ring->bufs[i]);
+	free(ring);
+}
+
+/* Allocates the ring and starts its thread */
+static enum huf_result start_ring(struct io_ring **rp, int fd,
+		int is_reader)
+{
+	struct io_ring *ring;
+	int i;
+
+	*rp = NULL;
+	ring = (struct io_ring *) huf_calloc(1, sizeof(struct io_ring));
+	if (ring == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+	for (i = 0; i < RING_BUFS; i++) {
+		if (huf_memalign((void **) &ring->bufs[i], IO_ALIGN,
+					IO_BUF_SIZE) != 0) {
+			ring->bufs[i] = NULL;
+			free_ring(ring);
+			return HUF_ERROR_MEMORY_ALLOC;
+		}
+	}
+
+	pthread_mutex_init(&ring->lock, NULL);
+	pthread_cond_init(&ring->thread_cond, NULL);
+	pthread_cond_init(&ring->caller_cond, NULL);
+	ring->fd = fd;
+	ring->is_reader = is_reader;
+	ring->r = HUF_SUCCESS;
+
+	if (pthread_create(&ring->thread, NULL, is_reader ? reader : writer,
+				ring) != 0) {
+		pthread_cond_destroy(&ring->caller_cond);
+		pthread_cond_destroy(&ring->thread_cond);
+		pthread_mutex_destroy(&ring->lock);
+		free_ring(ring);
+		return HUF_ERROR_UNKNOWN_ERROR;
+	}
+	*rp = ring;
+
+	return HUF_SUCCESS;
+}
+
+/* Starts a thread reading fd ahead into the ring */
+enum huf_result ring_start_reader(struct io_ring **rp, int fd)
+{
+	return start_ring(rp, fd, 1);
+}
+
+/*
+ * Hands out the bytes of the next read, *len being 0 at the end of the
+ * input. They stay valid until the next call.
+ */
+enum huf_result ring_get(struct io_ring *r, const uint8_t **data,
+		size_t *len)
+{
+	enum huf_result res = HUF_SUCCESS;
+
+	pthread_mutex_lock(&r->lock);
+	if (r->holding) {
+		r->holding = 0;
+		r->taken++;
+		pthread_cond_signal(&r->thread_cond);
+	}
+	while (r->filled == r->taken && !r->done)
+		pthread_cond_wait(&r->caller_cond, &r->lock);
+
+	*len = 0;
+	if (r->filled > r->taken) {
+		*data = r->bufs[r->taken % RING_BUFS];
+		*len = r->len[r->taken % RING_BUFS];
+		r->holding = 1;
+	} else {
+		res = r->r;
+	}
+	pthread_mutex_unlock(&r->lock);
+
+	return res;
+}
+
+/* Starts a thread writing the ring to fd, *buf is the first one to fill */
+enum huf_result ring_start_writer(struct io_ring **rp, int fd, uint8_t **buf)
+{
+	enum huf_result r;
+
+	r = start_ring(rp, fd, 0);
+	if (r == HUF_SUCCESS)
+		*buf = (*rp)->bufs[0];
+
+	return r;
+}
+
+/*
+ * Queues the len bytes of *buf for writing and sets *buf to the next buffer
+ * to fill, waiting for one if they are all queued
+ */
+enum huf_result ring_put(struct io_ring *r, size_t len, uint8_t **buf)
+{
+	enum huf_result res;
+
+	pthread_mutex_lock(&r->lock);
+	r->len[r->filled % RING_BUFS] = len;
+	r->filled++;
+	pthread_cond_signal(&r->thread_cond);
+	while (r->filled - r->taken == RING_BUFS)
+		pthread_cond_wait(&r->caller_cond, &r->lock);
+	*buf = r->bufs[r->filled % RING_BUFS];
+	res = r->r;
+	pthread_mutex_unlock(&r->lock);
+
+	return res;
+}
+
+/* Waits until everything queued has been written */
+enum huf_result ring_drain(struct io_ring *r)
+{
+	enum huf_result res;
+
+	pthread_mutex_lock(&r->lock);
+	while (r->taken != r->filled)
+		pthread_cond_wait(&r->caller_cond, &r->lock);
+	res = r->r;
+	pthread_mutex_unlock(&r->lock);
+
+	return res;
+}
+
+/*
+ * Stops the thread and frees the ring with all its buffers. A writer
+ * writes everything queued first, a reader is interrupted.
+ */
+enum huf_result ring_stop(struct io_ring **rp)
+{
+	struct io_ring *ring = *rp;
+	enum huf_result r;
+
+	if (ring == NULL)
+		return HUF_SUCCESS;
+
+	pthread_mutex_lock(&ring->lock);
+	ring->stop = 1;
+	pthread_cond_signal(&ring->thread_cond);
+	pthread_mutex_unlock(&ring->lock);
+
+	/* A reader may be blocked on a pipe nobody writes to anymore */
+	if (ring->is_reader)
+		pthread_cancel(ring->thread);
+	pthread_join(ring->thread, NULL);
+	r = ring->r;
+
+	pthread_cond_destroy(&ring->caller_cond);
+	pthread_cond_destroy(&ring->thread_cond);
+	pthread_mutex_destroy(&ring->lock);
+	free_ring(ring);
+	*rp = NULL;
+
+	return r;
+}
@@ -0,0 +1,47 @@
+/*
+ * Bounded ring of IO_BUF_SIZE buffers between the program and a thread
+ * making its system calls, so reading ahead of the input and writing behind
+ * the output overlap with the work done on the data. The reader thread hands
+ * over every read as soon as it returns, so a pipe is not kept waiting for a
+ * whole buffer. Either thread stops once RING_BUFS buffers are waiting on
+ * the other side.
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include "common.h"
+
+#define RING_BUFS		(4)
+
+struct io_ring;
+
+/* Starts a thread reading fd ahead into the ring */
+enum huf_result ring_start_reader(struct io_ring **rp, int fd);
+
+/*
+ * Hands out the bytes of the next read, *len being 0 at the end of the
+ * input. They stay valid until the next call.
+ */
+enum huf_result ring_get(struct io_ring *r, const uint8_t **data,
+		size_t *len);
+
+/* Starts a thread writing the ring to fd, *buf is the first one to fill */
+enum huf_result ring_start_writer(struct io_ring **rp, int fd, uint8_t **buf);
+
+/*
+ * Queues the len bytes of *buf for writing and sets *buf to the next buffer
+ * to fill, waiting for one if they are all queued
+ */
+enum huf_result ring_put(struct io_ring *r, size_t len, uint8_t **buf);
+
+/* Waits until everything queued has been written */
+enum huf_result ring_drain(struct io_ring *r);
+
+/*
+ * Stops the thread and frees the ring with all its buffers. A writer
+ * writes everything queued first, a reader is interrupted.
+ */
+enum huf_result ring_stop(struct io_ring **rp);
+
+#endif	/* #ifndef RING_H */
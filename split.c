@@ -0,0 +1,172 @@
+#include <string.h>
+
+#include "split.h"
+#include "hist.h"
+#include "canon.h"
+#include "frame.h"
+
+/* Adds the counts in part to freq */
+static void add_counts(uint32_t freq[ASCII_SIZE],
+		const uint32_t part[ASCII_SIZE])
+{
+	int i;
+
+	for (i = 0; i < ASCII_SIZE; i++)
+		freq[i] += part[i];
+}
+
+/* Takes the counts in part away from freq */
+static void sub_counts(uint32_t freq[ASCII_SIZE],
+		const uint32_t part[ASCII_SIZE])
+{
+	int i;
+
+	for (i = 0; i < ASCII_SIZE; i++)
+		freq[i] -= part[i];
+}
+
+/* Sums the counts of the segments from first up to end */
+static void sum_counts(uint32_t (*seg)[ASCII_SIZE], uint32_t first,
+		uint32_t end, uint32_t freq[ASCII_SIZE])
+{
+	memset(freq, 0, ASCII_SIZE * sizeof(uint32_t));
+	for (; first < end; first++)
+		add_counts(freq, seg[first]);
+}
+
+/*
+ * Bits saved, as told by the entropy, by coding the chars counted in a and
+ * in b apart rather than together, past the margin a split has to clear
+ */
+static uint64_t entropy_gain(const uint32_t a[ASCII_SIZE],
+		const uint32_t b[ASCII_SIZE])
+{
+	uint32_t both[ASCII_SIZE];
+	uint64_t apart, together;
+	int i;
+
+	for (i = 0; i < ASCII_SIZE; i++)
+		both[i] = a[i] + b[i];
+	apart = hist_entropy(a) + hist_entropy(b);
+	together = hist_entropy(both);
+	together -= together >> SPLIT_MARGIN;
+
+	return together > apart ? together - apart : 0;
+}
+
+/* Bits of the chars counted in freq with a table of their own, included */
+static uint64_t table_bits(uint32_t freq[ASCII_SIZE], int max_len)
+{
+	uint8_t lens[ASCII_SIZE];
+	uint8_t buf[CANON_TABLE_MAX];
+	uint64_t bits;
+	int i;
+
+	if (canon_lengths(freq, max_len, lens) != HUF_SUCCESS)
+		return UINT64_MAX / 4;
+	bits = (uint64_t) canon_write(lens, buf) * WRITE_SIZE;
+	for (i = 0; i < ASCII_SIZE; i++)
+		bits += (uint64_t) freq[i] * lens[i];
+
+	return bits;
+}
+
+/*
+ * Tells if the block of the nseg segments is better split before segment
+ * at, as coded with the tables the blocks would build, against the window
+ * that follows. The split has to save a share of the bits, a few saved
+ * don't make up for smaller blocks.
+ */
+static int split_pays(uint32_t (*seg)[ASCII_SIZE], uint32_t nseg,
+		uint32_t at, int max_len)
+{
+	uint32_t a[ASCII_SIZE], b[ASCII_SIZE];
+	uint64_t apart, together;
+
+	sum_counts(seg, 0, at, a);
+	sum_counts(seg, at, at + SPLIT_WINDOW < nseg ? at + SPLIT_WINDOW :
+			nseg, b);
+	apart = table_bits(a, max_len) + table_bits(b, max_len) +
+		BLOCK_HEADER_SIZE * WRITE_SIZE;
+	add_counts(a, b);
+	together = table_bits(a, max_len);
+
+	return apart + (together >> SPLIT_MARGIN) < together;
+}
+
+/*
+ * Counts the n chars at src in segments of SPLIT_SEGMENT chars, the last
+ * one holding what is left, and returns the number of segments
+ */
+uint32_t split_count(const uint8_t *src, uint32_t n,
+		uint32_t (*seg)[ASCII_SIZE])
+{
+	uint32_t nseg, i, size;
+
+	nseg = (n + SPLIT_SEGMENT - 1) / SPLIT_SEGMENT;
+	for (i = 0; i < nseg; i++) {
+		size = n - i * SPLIT_SEGMENT < SPLIT_SEGMENT ?
+			n - i * SPLIT_SEGMENT : SPLIT_SEGMENT;
+		hist_count(&src[i * SPLIT_SEGMENT], size, seg[i]);
+	}
+
+	return nseg;
+}
+
+/*
+ * Returns the number of segments of the first block out of the nseg
+ * counted in seg, all of them unless ending it earlier saves bits with
+ * codes of at most max_len bits
+ */
+uint32_t split_next(uint32_t (*seg)[ASCII_SIZE], uint32_t nseg, int max_len)
+{
+	uint32_t a[ASCII_SIZE], b[ASCII_SIZE];
+	uint32_t i, end, best;
+	uint64_t gain, best_gain;
+
+	if (nseg < 2 * SPLIT_MIN)
+		return nseg;
+
+	/*
+	 * The gain grows as the window slides over a change, the split goes
+	 * where it peaks. a is the block so far, b the window after it.
+	 */
+	sum_counts(seg, 0, SPLIT_MIN, a);
+	memset(b, 0, sizeof(b));
+	end = SPLIT_MIN;
+	best = 0;
+	best_gain = 0;
+	for (i = SPLIT_MIN; i + SPLIT_MIN <= nseg; i++) {
+		for (; end < nseg && end < i + SPLIT_WINDOW; end++)
+			add_counts(b, seg[end]);
+
+		gain = entropy_gain(a, b);
+		if (gain > BLOCK_HEADER_SIZE * WRITE_SIZE && gain > best_gain) {
+			best = i;
+			best_gain = gain;
+		} else if (best > 0) {
+			if (split_pays(seg, nseg, best, max_len))
+				return best;
+			best = 0;
+			best_gain = 0;
+		}
+
+		add_counts(a, seg[i]);
+		sub_counts(b, seg[i]);
+	}
+	if (best > 0 && split_pays(seg, nseg, best, max_len))
+		return best;
+
+	return nseg;
+}
+
+/* Largest output of block_compress for n chars when bp->split is set */
+size_t split_bound(uint32_t n)
+{
+	/*
+	 * Every block but the last holds SPLIT_MIN segments or more, and
+	 * may round its codes up to one more byte
+	 */
+	return block_bound(n) + n / (SPLIT_MIN * SPLIT_SEGMENT) *
+		(block_bound(0) + 1);
+}
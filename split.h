@@ -0,0 +1,47 @@
+/*
+ * Block boundaries following the content. A block read in full may hold
+ * text of different kinds, say a binary section inside a log, which a single
+ * table codes badly. Its chars are counted once, in segments of
+ * SPLIT_SEGMENT chars, and the block is coded as several blocks, each ending
+ * before the first segment where the block so far and the SPLIT_WINDOW
+ * segments that follow, each coded with a table of its own, take clearly
+ * fewer bits than both coded with a single table, headers and tables
+ * included.
+ *
+ * The entropy of the counts tells quickly if a split could pay. Only then
+ * are the code lengths of the three tables built, as the blocks would build
+ * them, and the split is made if they save more than one bit in
+ * 2^SPLIT_MARGIN. The counts of the segments then stand for those of the
+ * blocks, which aren't counted again. All of it is done by the worker coding
+ * the block, the reader only hands out whole blocks.
+ */
+
+#ifndef SPLIT_H
+#define SPLIT_H
+
+#include "common.h"
+#include "block.h"
+
+#define SPLIT_SEGMENT		(1 << 14)	/* chars counted together */
+#define SPLIT_WINDOW		(4)		/* segments looked ahead */
+#define SPLIT_MIN		(4)		/* segments of the smallest block */
+#define SPLIT_MARGIN		(6)		/* log2 of the bits per bit saved */
+
+/*
+ * Counts the n chars at src in segments of SPLIT_SEGMENT chars, the last
+ * one holding what is left, and returns the number of segments
+ */
+uint32_t split_count(const uint8_t *src, uint32_t n,
+		uint32_t (*seg)[ASCII_SIZE]);
+
+/*
+ * Returns the number of segments of the first block out of the nseg
+ * counted in seg, all of them unless ending it earlier saves bits with
+ * codes of at most max_len bits
+ */
+uint32_t split_next(uint32_t (*seg)[ASCII_SIZE], uint32_t nseg, int max_len);
+
+/* Largest output of block_compress for n chars when bp->split is set */
+size_t split_bound(uint32_t n);
+
+#endif	/* #ifndef SPLIT_H */
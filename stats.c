@@ -0,0 +1,193 @@
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+#include "cpu.h"
+
+static const char *const stage_names[STATS_STAGES] = {
+	"read", "hist", "tree", "encode", "table", "decode", "check",
+	"write",
+};
+
+static uint64_t clock_ns(clockid_t id)
+{
+	struct timespec ts;
+
+	clock_gettime(id, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline void atomic_add(uint64_t *counter, uint64_t v)
+{
+	__atomic_fetch_add(counter, v, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_max(uint32_t *counter, uint32_t v)
+{
+	uint32_t old = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+	while (old < v && !__atomic_compare_exchange_n(counter, &old, v, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/* Clears the counters and starts the total time */
+void stats_init(struct huf_stats *s)
+{
+	memset(s, 0, sizeof(struct huf_stats));
+	s->allocs = STATS_UNKNOWN;
+	s->start.wall_ns = clock_ns(CLOCK_MONOTONIC);
+	s->start.cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+/* Starts timing a stage, if s isn't NULL */
+void stats_start(struct huf_stats *s, struct stats_clock *c)
+{
+	if (s == NULL)
+		return;
+
+	c->wall_ns = clock_ns(CLOCK_MONOTONIC);
+	c->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+/* Adds the time since stats_start to the stage */
+void stats_stop(struct huf_stats *s, enum stats_stage stage,
+		struct stats_clock *c)
+{
+	if (s == NULL)
+		return;
+
+	atomic_add(&s->stage[stage].wall_ns,
+			clock_ns(CLOCK_MONOTONIC) - c->wall_ns);
+	atomic_add(&s->stage[stage].cpu_ns,
+			clock_ns(CLOCK_THREAD_CPUTIME_ID) - c->cpu_ns);
+	atomic_add(&s->stage[stage].calls, 1);
+}
+
+/* Records a block and the tree its chars were coded with */
+void stats_tree(struct huf_stats *s, uint32_t tree_size, uint32_t max_len)
+{
+	if (s == NULL)
+		return;
+
+	atomic_add(&s->blocks, 1);
+	atomic_max(&s->tree_size, tree_size);
+	atomic_max(&s->max_code_len, max_len);
+}
+
+/* Records a block coded with the table of a block before it */
+void stats_reuse(struct huf_stats *s)
+{
+	if (s == NULL)
+		return;
+
+	atomic_add(&s->reused, 1);
+}
+
+/* Records a block stored without codes */
+void stats_store(struct huf_stats *s)
+{
+	if (s == NULL)
+		return;
+
+	atomic_add(&s->blocks, 1);
+	atomic_add(&s->stored, 1);
+}
+
+/* Stops the total time and reads the peak memory of the process */
+void stats_finish(struct huf_stats *s)
+{
+	struct rusage ru;
+
+	s->total.wall_ns = clock_ns(CLOCK_MONOTONIC) - s->start.wall_ns;
+	s->total.cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - s->start.cpu_ns;
+	s->total.calls = 1;
+
+	/* Linux counts it in KiB */
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		s->peak_rss = (uint64_t) ru.ru_maxrss * 1024;
+}
+
+static inline double ms(uint64_t ns)
+{
+	return ns / 1e6;
+}
+
+/*
+ * Prints the counters to f, in lines for people or as a single JSON line.
+ * The ratio is the compressed size over the original one.
+ */
+void stats_print(FILE *f, const struct huf_stats *s, int compressing,
+		int json)
+{
+	uint64_t orig, comp;
+	double ratio;
+	int i;
+
+	orig = compressing ? s->in_bytes : s->out_bytes;
+	comp = compressing ? s->out_bytes : s->in_bytes;
+	ratio = orig > 0 ? (double) comp / orig : 0;
+
+	if (json) {
+		fprintf(f, "{\"mode\": \"%s\", \"input_bytes\": %" PRIu64
+				", \"output_bytes\": %" PRIu64
+				", \"ratio\": %.6f, \"blocks\": %" PRIu64
+				", \"reused_tables\": %" PRIu64
+				", \"stored_blocks\": %" PRIu64
+				", \"tree_size\": %" PRIu32
+				", \"max_code_len\": %" PRIu32
+				", \"kernels\": \"%s\""
+				", \"wall_ms\": %.3f, \"cpu_ms\": %.3f"
+				", \"stages\": {",
+				compressing ? "compress" : "decompress",
+				s->in_bytes, s->out_bytes, ratio, s->blocks,
+				s->reused, s->stored, s->tree_size,
+				s->max_code_len,
+				cpu_name(), ms(s->total.wall_ns),
+				ms(s->total.cpu_ns));
+		for (i = 0; i < STATS_STAGES; i++)
+			fprintf(f, "%s\"%s\": {\"wall_ms\": %.3f, "
+					"\"cpu_ms\": %.3f, \"calls\": %" PRIu64
+					"}", i ? ", " : "", stage_names[i],
+					ms(s->stage[i].wall_ns),
+					ms(s->stage[i].cpu_ns),
+					s->stage[i].calls);
+		fprintf(f, "}, ");
+		if (s->allocs != STATS_UNKNOWN)
+			fprintf(f, "\"allocs\": %" PRIu64 ", ", s->allocs);
+		fprintf(f, "\"peak_rss_bytes\": %" PRIu64 "}\n", s->peak_rss);
+		return;
+	}
+
+	fprintf(f, "%-12s %" PRIu64 " bytes\n", "input", s->in_bytes);
+	fprintf(f, "%-12s %" PRIu64 " bytes, ratio %.4f\n", "output",
+			s->out_bytes, ratio);
+	fprintf(f, "%-12s %" PRIu64 ", largest tree %" PRIu32 " nodes",
+			"blocks", s->blocks, s->tree_size);
+	if (s->reused > 0)
+		fprintf(f, ", %" PRIu64 " with the table before", s->reused);
+	if (s->stored > 0)
+		fprintf(f, ", %" PRIu64 " stored", s->stored);
+	if (s->max_code_len > 0)
+		fprintf(f, ", codes up to %" PRIu32 " bits", s->max_code_len);
+	fprintf(f, "\n");
+	fprintf(f, "%-12s %s\n", "kernels", cpu_name());
+	fprintf(f, "%-12s %12s %12s %8s\n", "stage", "wall ms", "cpu ms",
+			"calls");
+	for (i = 0; i < STATS_STAGES; i++) {
+		if (s->stage[i].calls == 0)
+			continue;
+		fprintf(f, "%-12s %12.3f %12.3f %8" PRIu64 "\n",
+				stage_names[i], ms(s->stage[i].wall_ns),
+				ms(s->stage[i].cpu_ns), s->stage[i].calls);
+	}
+	fprintf(f, "%-12s %12.3f %12.3f\n", "total", ms(s->total.wall_ns),
+			ms(s->total.cpu_ns));
+	if (s->allocs != STATS_UNKNOWN)
+		fprintf(f, "%-12s %" PRIu64 "\n", "allocations", s->allocs);
+	fprintf(f, "%-12s %" PRIu64 " KiB\n", "peak memory",
+			s->peak_rss / 1024);
+}
@@ -0,0 +1,84 @@
+/*
+ * Run time counters, printed by the program with --stats. Only the stages
+ * given a struct huf_stats fill them, every other caller passes NULL and
+ * pays nothing but the test. Stages run by the worker threads add to the
+ * counters atomically, so their times are summed over the threads and can
+ * add up to more than the total wall time.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "common.h"
+
+#define STATS_UNKNOWN		(UINT64_MAX)	/* a counter that isn't kept */
+
+enum stats_stage {
+	STATS_READ,			/* reading the input, mapped files excluded */
+	STATS_HIST,			/* counting the chars */
+	STATS_TREE,			/* code lengths or tree, codes */
+	STATS_ENCODE,			/* bit streams */
+	STATS_TABLE,			/* decoder tables */
+	STATS_DECODE,			/* bit streams */
+	STATS_CHECK,			/* checksums of the blocks */
+	STATS_WRITE,			/* writing the output */
+	STATS_STAGES,
+};
+
+struct stats_time {
+	uint64_t wall_ns;
+	uint64_t cpu_ns;		/* of the thread running the stage */
+	uint64_t calls;
+};
+
+/* The start of a timed stage */
+struct stats_clock {
+	uint64_t wall_ns;
+	uint64_t cpu_ns;
+};
+
+struct huf_stats {
+	struct stats_clock start;	/* of the whole run */
+	struct stats_time stage[STATS_STAGES];
+	struct stats_time total;	/* process cpu time, all threads */
+	uint64_t in_bytes;
+	uint64_t out_bytes;
+	uint64_t blocks;
+	uint64_t reused;		/* blocks coded with the table before */
+	uint64_t stored;		/* raw and run blocks, without codes */
+	uint32_t tree_size;		/* nodes of the largest tree */
+	uint32_t max_code_len;		/* longest code of all the trees, or 0 */
+	uint64_t allocs;		/* STATS_UNKNOWN unless the program counts them */
+	uint64_t peak_rss;		/* bytes */
+};
+
+/* Clears the counters and starts the total time */
+void stats_init(struct huf_stats *s);
+
+/* Starts timing a stage, if s isn't NULL */
+void stats_start(struct huf_stats *s, struct stats_clock *c);
+
+/* Adds the time since stats_start to the stage */
+void stats_stop(struct huf_stats *s, enum stats_stage stage,
+		struct stats_clock *c);
+
+/* Records a block and the tree its chars were coded with */
+void stats_tree(struct huf_stats *s, uint32_t tree_size, uint32_t max_len);
+
+/* Records a block coded with the table of a block before it */
+void stats_reuse(struct huf_stats *s);
+
+/* Records a block stored without codes */
+void stats_store(struct huf_stats *s);
+
+/* Stops the total time and reads the peak memory of the process */
+void stats_finish(struct huf_stats *s);
+
+/*
+ * Prints the counters to f, in lines for people or as a single JSON line.
+ * The ratio is the compressed size over the original one.
+ */
+void stats_print(FILE *f, const struct huf_stats *s, int compressing,
+		int json);
+
+#endif	/* #ifndef STATS_H */
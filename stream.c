@@ -0,0 +1,565 @@
+#include <string.h>
+#include <sys/stat.h>
+
+#include "stream.h"
+#include "frame.h"
+#include "block.h"
+#include "pool.h"
+#include "legacy.h"
+#include "adapt.h"
+#include "split.h"
+
+/* Blocks in flight per worker, one being processed and one waiting */
+#define SLOTS_PER_THREAD	(2)
+
+/* A block on its way through the worker pool */
+struct block_slot {
+	struct pool_job job;
+	struct block_header bh;
+	struct block_decoder *dec;	/* decompression only */
+	struct block_table table;	/* the block went through, likewise */
+	uint8_t *text;			/* NULL if the file mapping is used */
+	uint8_t *comp;
+	const uint8_t *src;		/* text to compress or payload */
+	uint8_t *dst;			/* decompressed text */
+	size_t text_size;
+	size_t comp_size;
+	size_t skip;			/* decompressed chars left out */
+	size_t keep;			/* decompressed chars written after them */
+	const struct block_params *bp;	/* compression only */
+	struct block_chain *chain;	/* likewise */
+	uint64_t seq;			/* of the block in the chain */
+	struct huf_stats *stats;	/* decompression only */
+	enum huf_result r;
+};
+
+static void compress_slot(void *arg)
+{
+	struct block_slot *s = (struct block_slot *) arg;
+
+	s->r = block_compress(s->src, s->text_size, s->bp, s->chain, s->seq,
+			s->comp, &s->comp_size);
+}
+
+static void decompress_slot(void *arg)
+{
+	struct block_slot *s = (struct block_slot *) arg;
+
+	s->r = block_decompress(&s->bh, s->src, s->dst, s->dec, &s->table,
+			s->stats);
+}
+
+static void free_slots(struct block_slot *slots, int nslots)
+{
+	int i;
+
+	if (slots == NULL)
+		return;
+
+	for (i = 0; i < nslots; i++) {
+		free(slots[i].dec);
+		free(slots[i].comp);
+		free(slots[i].text);
+	}
+	free(slots);
+}
+
+/*
+ * Allocates the buffers of every slot, those with a zero size are not needed,
+ * and a decoder when decompressing
+ */
+static enum huf_result alloc_slots(struct block_slot **slots, int nslots,
+		size_t text_size, size_t comp_size, int decoder)
+{
+	struct block_slot *s;
+	int i;
+
+	*slots = (struct block_slot *) huf_calloc(nslots, sizeof(struct block_slot));
+	if (*slots == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+
+	for (i = 0; i < nslots; i++) {
+		s = &(*slots)[i];
+		s->job.arg = s;
+		if (text_size > 0)
+			s->text = (uint8_t *) huf_malloc(text_size * sizeof(uint8_t));
+		if (comp_size > 0)
+			s->comp = (uint8_t *) huf_malloc(comp_size * sizeof(uint8_t));
+		if (decoder)
+			s->dec = (struct block_decoder *) huf_malloc(
+					sizeof(struct block_decoder));
+		if ((text_size > 0 && s->text == NULL) ||
+				(comp_size > 0 && s->comp == NULL) ||
+				(decoder && s->dec == NULL)) {
+			free_slots(*slots, nslots);
+			*slots = NULL;
+			return HUF_ERROR_MEMORY_ALLOC;
+		}
+		if (decoder)
+			s->dec->id = 0;
+	}
+
+	return HUF_SUCCESS;
+}
+
+/* Appends the entry of the next block to the index, growing it */
+static enum huf_result index_add(uint8_t **index, size_t *mem,
+		uint64_t blocks, struct index_entry *e)
+{
+	uint8_t *tmp;
+	size_t k;
+
+	k = blocks * INDEX_ENTRY_SIZE;
+	if (k + INDEX_ENTRY_SIZE + INDEX_FOOTER_SIZE > *mem) {
+		*mem = *mem > 0 ? 2 * *mem : 64 * INDEX_ENTRY_SIZE;
+		tmp = (uint8_t *) huf_realloc(*index, *mem * sizeof(uint8_t));
+		if (tmp == NULL)
+			return HUF_ERROR_MEMORY_ALLOC;
+		*index = tmp;
+	}
+	frame_put_entry(&(*index)[k], e);
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Compresses the input one block at a time, in the framed format, followed
+ * by the block index if index is set. The blocks hold block_size chars, or
+ * fewer where bp->split ends them. The stats, like the other parameters,
+ * come with bp. The decompression takes them directly, NULL if they aren't
+ * kept.
+ */
+enum huf_result compress_frame(struct huf_input *in, struct huf_output *out,
+		uint32_t block_size, const struct block_params *bp, int index,
+		int nthreads)
+{
+	uint8_t head[FRAME_HEADER_SIZE];
+	struct block_slot *slots = NULL, *s;
+	struct block_chain chain;
+	struct frame_header fh;
+	struct block_header bh;
+	struct index_entry e;
+	struct index_footer ft;
+	struct pool *pool = NULL;
+	struct stat st;
+	enum huf_result r;
+	uint64_t next_read, next_write, blocks, start;
+	uint8_t *index_buf = NULL;
+	size_t index_mem = 0, pos;
+	int nslots, eof;
+	size_t n;
+
+	/* A mapped input is compressed in place, without copying the text */
+	nslots = nthreads > 1 ? SLOTS_PER_THREAD * nthreads : 1;
+	r = alloc_slots(&slots, nslots, in->map != NULL ? 0 : block_size,
+			bp->split ? split_bound(block_size) :
+			block_bound(block_size), 0);
+	if (r != HUF_SUCCESS)
+		return r;
+	block_chain_init(&chain);
+	r = pool_init(&pool, nthreads);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	/* The total is only known upfront for regular files */
+	fh.version = FRAME_VERSION;
+	fh.flags = index ? FRAME_INDEX : 0;
+	fh.block_size = block_size;
+	fh.content_size = 0;
+	if (fstat(in->fd, &st) == 0 && S_ISREG(st.st_mode) &&
+			(uint64_t) st.st_size >= in->pos) {
+		fh.flags |= FRAME_CONTENT_SIZE;
+		fh.content_size = st.st_size - in->pos;
+	}
+	frame_put_header(head, &fh);
+	start = out->pos;
+	r = io_write(out, head, FRAME_HEADER_SIZE);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	e.raw_offset = 0;
+	next_read = 0;
+	next_write = 0;
+	blocks = 0;
+	eof = 0;
+	while (1) {
+		/* Handing blocks to the workers while there are free slots */
+		while (!eof && next_read - next_write < nslots) {
+			s = &slots[next_read % nslots];
+			r = io_next(in, s->text, block_size, &s->src, &n);
+			if (r != HUF_SUCCESS)
+				goto out_free;
+			if (n == 0) {
+				eof = 1;
+				break;
+			}
+
+			s->text_size = n;
+			s->bp = bp;
+			s->chain = &chain;
+			s->seq = next_read;
+			s->job.fn = compress_slot;
+			pool_submit(pool, &s->job);
+			next_read++;
+		}
+		if (next_write == next_read)
+			break;
+
+		/* Writing the oldest block, the output keeps the input order */
+		s = &slots[next_write % nslots];
+		pool_wait(pool, &s->job);
+		r = s->r;
+		if (r != HUF_SUCCESS)
+			goto out_free;
+
+		/* A slot holds several blocks where bp->split ended them */
+		for (pos = 0; index && pos < s->comp_size;
+				pos += BLOCK_HEADER_SIZE + bh.comp_size) {
+			frame_get_block(&s->comp[pos], &bh);
+			e.comp_offset = out->pos - start + pos;
+			r = index_add(&index_buf, &index_mem, blocks++, &e);
+			if (r != HUF_SUCCESS)
+				goto out_free;
+			e.raw_offset += bh.raw_size;
+		}
+		r = io_write(out, s->comp, s->comp_size);
+		if (r != HUF_SUCCESS)
+			goto out_free;
+		next_write++;
+	}
+
+	bh.type = BLOCK_END;
+	n = frame_put_block(head, &bh);
+	r = io_write(out, head, n);
+	if (r != HUF_SUCCESS || !index)
+		goto out_free;
+
+	/*
+	 * index_add leaves room for the footer after the entry, a dummy one
+	 * gets the buffer allocated even without blocks
+	 */
+	e.comp_offset = 0;
+	r = index_add(&index_buf, &index_mem, blocks, &e);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+	ft.raw_size = e.raw_offset;
+	ft.blocks = blocks;
+	frame_put_footer(&index_buf[blocks * INDEX_ENTRY_SIZE], &ft);
+	r = io_write(out, index_buf, blocks * INDEX_ENTRY_SIZE +
+			INDEX_FOOTER_SIZE);
+
+out_free:
+	/* The workers finish the queued jobs before the buffers go away */
+	pool_destroy(&pool);
+	block_chain_destroy(&chain);
+	free_slots(slots, nslots);
+	free(index_buf);
+
+	return r;
+}
+
+/*
+ * Reads the next block into the slot, sets eof at the end of the frame. The
+ * payload is left in the input mapping if there is one.
+ */
+static enum huf_result read_block(struct huf_input *in,
+		struct frame_header *fh, struct block_slot *s, int *eof)
+{
+	uint8_t bhead[BLOCK_HEADER_SIZE];
+	enum huf_result r;
+	size_t n;
+
+	r = io_read(in, bhead, 1);
+	if (r != HUF_SUCCESS)
+		return r;
+	if (bhead[0] == BLOCK_END) {
+		*eof = 1;
+		return HUF_SUCCESS;
+	}
+
+	r = io_read(in, &bhead[1], BLOCK_HEADER_SIZE - 1);
+	if (r != HUF_SUCCESS)
+		return r;
+	r = frame_get_block(bhead, &s->bh);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	r = block_check(fh, &s->bh);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	r = io_next(in, s->comp, s->bh.comp_size, &s->src, &n);
+	if (r != HUF_SUCCESS)
+		return r;
+	if (n != s->bh.comp_size)
+		return HUF_ERROR_END_OF_FILE;
+
+	return HUF_SUCCESS;
+}
+
+/* Reads the index entry k, the entries start at first */
+static enum huf_result read_entry(struct huf_input *in, uint64_t first,
+		uint64_t k, struct index_entry *e)
+{
+	uint8_t buf[INDEX_ENTRY_SIZE];
+	enum huf_result r;
+
+	r = io_seek(in, first + k * INDEX_ENTRY_SIZE);
+	if (r != HUF_SUCCESS)
+		return r;
+	r = io_read(in, buf, INDEX_ENTRY_SIZE);
+	if (r != HUF_SUCCESS)
+		return r;
+	frame_get_entry(buf, e);
+
+	return HUF_SUCCESS;
+}
+
+/*
+ * Moves a mapped input to the last BLOCK_HUF block starting at or before
+ * offset, as found in the index ending the file, or to the last block doing
+ * so if none is a BLOCK_HUF block, and sets *raw_pos to the text offset of
+ * that block. The input is left where it was, at the first block of the
+ * frame starting at frame_start, if there is no usable index.
+ */
+static void seek_index(struct huf_input *in, uint64_t frame_start,
+		uint64_t offset, uint64_t *raw_pos)
+{
+	uint8_t buf[INDEX_FOOTER_SIZE];
+	struct index_footer ft;
+	struct index_entry e;
+	uint64_t pos, end, first, start, lo, hi, mid;
+	uint8_t type;
+
+	pos = io_tell(in);
+	end = pos + io_in_size(in);
+	if (end - pos < INDEX_FOOTER_SIZE)
+		return;
+
+	if (io_seek(in, end - INDEX_FOOTER_SIZE) != HUF_SUCCESS ||
+			io_read(in, buf, INDEX_FOOTER_SIZE) != HUF_SUCCESS ||
+			frame_get_footer(buf, &ft) != HUF_SUCCESS)
+		goto out_restore;
+	if (ft.blocks == 0 || ft.blocks > (end - pos - INDEX_FOOTER_SIZE) /
+			INDEX_ENTRY_SIZE)
+		goto out_restore;
+	first = end - INDEX_FOOTER_SIZE - ft.blocks * INDEX_ENTRY_SIZE;
+
+	/* The entries are sorted by offset */
+	lo = 0;
+	hi = ft.blocks - 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		if (read_entry(in, first, mid, &e) != HUF_SUCCESS)
+			goto out_restore;
+		if (e.raw_offset <= offset)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	/*
+	 * A BLOCK_REPEAT block in the range, even past stored or context
+	 * blocks, is decoded with the table of the last BLOCK_HUF block before
+	 * it, the reading starts at the last one before the range. Without
+	 * one, no block of the range can refer to a table from before it.
+	 */
+	start = lo;
+	while (1) {
+		if (read_entry(in, first, lo, &e) != HUF_SUCCESS ||
+				e.raw_offset > offset ||
+				e.comp_offset < FRAME_HEADER_SIZE ||
+				e.comp_offset >= first - frame_start)
+			goto out_restore;
+		if (io_seek(in, frame_start + e.comp_offset) != HUF_SUCCESS ||
+				io_read(in, &type, 1) != HUF_SUCCESS)
+			goto out_restore;
+		if (type == BLOCK_HUF)
+			break;
+		if (lo == 0) {
+			if (read_entry(in, first, start, &e) != HUF_SUCCESS)
+				goto out_restore;
+			break;
+		}
+		lo--;
+	}
+
+	if (io_seek(in, frame_start + e.comp_offset) != HUF_SUCCESS)
+		goto out_restore;
+	*raw_pos = e.raw_offset;
+	return;
+
+out_restore:
+	io_seek(in, pos);
+}
+
+/*
+ * Decompresses the blocks following the frame header stored in head, only
+ * the chars in range unless it is NULL. When the frame holds its content
+ * size and the whole text goes to a regular file, the output is mapped and
+ * the workers decode straight into it.
+ *
+ * The blocks before the range are skipped without being decoded, through
+ * the index when the frame has one and the input is mapped, otherwise
+ * going from one block header to the next. Their code lengths are still
+ * read, for the BLOCK_REPEAT blocks in the range.
+ */
+enum huf_result decompress_frame(struct huf_input *in, struct huf_output *out,
+		uint8_t *head, const struct huf_range *range, int nthreads,
+		struct huf_stats *stats)
+{
+	struct block_slot *slots = NULL, *s;
+	struct block_table table;
+	struct frame_header fh;
+	struct pool *pool = NULL;
+	enum huf_result r;
+	uint64_t next_read, next_write, total, raw_pos, start, end;
+	int nslots, eof;
+
+	r = frame_get_header(head, &fh);
+	if (r != HUF_SUCCESS)
+		return r;
+	if (fh.block_size > MAX_BLOCK_SIZE)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	start = 0;
+	end = UINT64_MAX;
+	raw_pos = 0;
+	if (range != NULL) {
+		start = range->start;
+		if (range->len < end - start)
+			end = start + range->len;
+	}
+
+	/* Adaptive blocks depend on each other, no worker can take one */
+	if (fh.flags & FRAME_ADAPTIVE)
+		return adapt_decompress(in, out, &fh, start, end, stats);
+
+	if (range != NULL) {
+		if (fh.flags & FRAME_INDEX)
+			seek_index(in, io_tell(in) - FRAME_HEADER_SIZE, start,
+					&raw_pos);
+	} else if (fh.flags & FRAME_CONTENT_SIZE) {
+		r = io_reserve(out, fh.content_size);
+		if (r != HUF_SUCCESS)
+			return r;
+	}
+
+	/* Nothing bigger than a block and its compressed form per slot */
+	nslots = nthreads > 1 ? SLOTS_PER_THREAD * nthreads : 1;
+	r = alloc_slots(&slots, nslots, out->map != NULL ? 0 : fh.block_size,
+			in->map != NULL ? 0 : block_bound(fh.block_size), 1);
+	if (r != HUF_SUCCESS)
+		return r;
+	r = pool_init(&pool, nthreads);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	/*
+	 * Every block header holds the size of its payload, so the next block
+	 * is found without decoding the current one
+	 */
+	next_read = 0;
+	next_write = 0;
+	total = 0;
+	table.id = 0;
+	eof = start >= end;
+	while (1) {
+		while (!eof && next_read - next_write < nslots) {
+			s = &slots[next_read % nslots];
+			r = read_block(in, &fh, s, &eof);
+			if (r != HUF_SUCCESS)
+				goto out_free;
+			if (eof)
+				break;
+
+			/* Even the skipped blocks may hold a table */
+			r = block_table_update(&table, &s->bh, s->src);
+			if (r != HUF_SUCCESS)
+				goto out_free;
+			s->table = table;
+
+			/* Only the blocks overlapping the range are decoded */
+			raw_pos += s->bh.raw_size;
+			if (raw_pos <= start)
+				continue;
+			s->skip = 0;
+			if (raw_pos - s->bh.raw_size < start)
+				s->skip = start - (raw_pos - s->bh.raw_size);
+			s->keep = s->bh.raw_size - s->skip;
+			if (raw_pos >= end) {
+				s->keep -= raw_pos - end;
+				eof = 1;
+			}
+
+			/* The blocks can't go past the reserved output */
+			s->dst = s->text;
+			if (out->map != NULL) {
+				s->dst = io_reserved(out, s->bh.raw_size);
+				if (s->dst == NULL) {
+					r = HUF_ERROR_INVALID_RESOURCE;
+					goto out_free;
+				}
+			}
+
+			s->stats = stats;
+			s->job.fn = decompress_slot;
+			pool_submit(pool, &s->job);
+			next_read++;
+		}
+		if (next_write == next_read)
+			break;
+
+		s = &slots[next_write % nslots];
+		pool_wait(pool, &s->job);
+		r = s->r;
+		if (r != HUF_SUCCESS)
+			goto out_free;
+		if (s->dst == s->text) {
+			r = io_write(out, &s->text[s->skip], s->keep);
+			if (r != HUF_SUCCESS)
+				goto out_free;
+		}
+		total += s->bh.raw_size;
+		next_write++;
+	}
+
+	if (range == NULL && (fh.flags & FRAME_CONTENT_SIZE) &&
+			total != fh.content_size)
+		r = HUF_ERROR_INVALID_RESOURCE;
+
+out_free:
+	pool_destroy(&pool);
+	free_slots(slots, nslots);
+
+	return r;
+}
+
+/*
+ * Detects the format from the first bytes of the file and decompresses it,
+ * only the chars in range unless it is NULL. The original format can't be
+ * decompressed in part.
+ */
+enum huf_result decompress_file(struct huf_input *in, struct huf_output *out,
+		const struct huf_range *range, int nthreads,
+		struct huf_stats *stats)
+{
+	uint8_t head[FRAME_HEADER_SIZE];
+	enum huf_result r;
+
+	r = io_read(in, head, HUF_MAGIC_CHECK);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	if (memcmp(head, HUF_MAGIC, HUF_MAGIC_CHECK) != 0) {
+		if (range != NULL)
+			return HUF_ERROR_INVALID_PARAMETER;
+		return decompress_huf(in, out, head, stats);
+	}
+
+	r = io_read(in, &head[HUF_MAGIC_CHECK],
+			FRAME_HEADER_SIZE - HUF_MAGIC_CHECK);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	return decompress_frame(in, out, head, range, nthreads, stats);
+}
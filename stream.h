@@ -0,0 +1,56 @@
+/*
+ * Framed compression and decompression between two files. The blocks are
+ * processed by a pool of worker threads while the calling thread reads the
+ * input and writes the results back in order. Mapped files are read and
+ * written in place, without going through the slot buffers.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "common.h"
+#include "io.h"
+#include "block.h"
+
+/* Part of the text to decompress */
+struct huf_range {
+	uint64_t start;
+	uint64_t len;			/* may go past the end */
+};
+
+/*
+ * Compresses the input one block at a time, in the framed format, followed
+ * by the block index if index is set. The blocks hold block_size chars, or
+ * fewer where bp->split ends them. The stats, like the other parameters,
+ * come with bp. The decompression takes them directly, NULL if they aren't
+ * kept.
+ */
+enum huf_result compress_frame(struct huf_input *in, struct huf_output *out,
+		uint32_t block_size, const struct block_params *bp, int index,
+		int nthreads);
+
+/*
+ * Decompresses the blocks following the frame header stored in head, only
+ * the chars in range unless it is NULL. When the frame holds its content
+ * size and the whole text goes to a regular file, the output is mapped and
+ * the workers decode straight into it.
+ *
+ * The blocks before the range are skipped without being decoded, through
+ * the index when the frame has one and the input is mapped, otherwise
+ * going from one block header to the next. Their code lengths are still
+ * read, for the BLOCK_REPEAT blocks in the range.
+ */
+enum huf_result decompress_frame(struct huf_input *in, struct huf_output *out,
+		uint8_t *head, const struct huf_range *range, int nthreads,
+		struct huf_stats *stats);
+
+/*
+ * Detects the format from the first bytes of the file and decompresses it,
+ * only the chars in range unless it is NULL. The original format can't be
+ * decompressed in part.
+ */
+enum huf_result decompress_file(struct huf_input *in, struct huf_output *out,
+		const struct huf_range *range, int nthreads,
+		struct huf_stats *stats);
+
+#endif	/* #ifndef STREAM_H */
@@ -0,0 +1,256 @@
+#include <string.h>
+
+#include "table.h"
+#include "frame.h"
+#include "canon.h"
+#include "encode.h"
+#include "decode.h"
+#include "bitstream.h"
+#include "hist.h"
+
+/* The counts are scaled down below it, canon_lengths sums them on 32 bits */
+#define TABLE_MAX_TOTAL		((uint64_t) 1 << 30)
+
+/* FNV-1a hash of the code lengths */
+static uint32_t table_id(uint8_t lens[ASCII_SIZE])
+{
+	uint32_t h = 2166136261u;
+	int i;
+
+	for (i = 0; i < ASCII_SIZE; i++) {
+		h ^= lens[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/* Adds the chars of the rest of the input to freq */
+enum huf_result table_count(struct huf_input *in, uint64_t freq[ASCII_SIZE])
+{
+	uint32_t part[ASCII_SIZE];
+	enum huf_result r;
+	const uint8_t *data;
+	size_t got;
+	int i;
+
+	do {
+		r = io_next(in, NULL, IO_BUF_SIZE, &data, &got);
+		if (r != HUF_SUCCESS)
+			return r;
+
+		hist_count(data, got, part);
+		for (i = 0; i < ASCII_SIZE; i++)
+			freq[i] += part[i];
+	} while (got > 0);
+
+	return HUF_SUCCESS;
+}
+
+/* Builds the table of the counts, no code longer than max_len */
+enum huf_result table_build(struct huf_table *t, uint64_t freq[ASCII_SIZE],
+		int max_len)
+{
+	uint32_t scaled[ASCII_SIZE];
+	uint64_t total;
+	enum huf_result r;
+	int shift, i;
+
+	total = 0;
+	for (i = 0; i < ASCII_SIZE; i++)
+		total += freq[i];
+	for (shift = 0; (total >> shift) > TABLE_MAX_TOTAL; shift++)
+		;
+
+	/* Every char gets a code, even if the samples don't have it */
+	for (i = 0; i < ASCII_SIZE; i++)
+		scaled[i] = (freq[i] >> shift) + 1;
+
+	r = canon_lengths(scaled, max_len, t->lens);
+	if (r != HUF_SUCCESS)
+		return r;
+	canon_codes(t->lens, t->codes);
+	t->id = table_id(t->lens);
+
+	return HUF_SUCCESS;
+}
+
+/* Writes the table file */
+enum huf_result table_write(struct huf_table *t, struct huf_output *out)
+{
+	uint8_t buf[CANON_TABLE_MAX];
+	enum huf_result r;
+	size_t n;
+
+	n = canon_write(t->lens, buf);
+	r = io_write(out, HUF_TABLE_MAGIC, HUF_TABLE_MAGIC_SIZE);
+	if (r == HUF_SUCCESS)
+		r = io_write(out, buf, n);
+
+	return r;
+}
+
+/* Reads a table file */
+enum huf_result table_read(struct huf_table *t, struct huf_input *in)
+{
+	uint8_t buf[HUF_TABLE_MAGIC_SIZE + CANON_TABLE_MAX];
+	enum huf_result r;
+	const uint8_t *data;
+	size_t got, used;
+	int i;
+
+	r = io_next(in, buf, sizeof(buf), &data, &got);
+	if (r != HUF_SUCCESS)
+		return r;
+	if (got < HUF_TABLE_MAGIC_SIZE ||
+			memcmp(data, HUF_TABLE_MAGIC, HUF_TABLE_MAGIC_SIZE) != 0)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	r = canon_read(t->lens, &data[HUF_TABLE_MAGIC_SIZE],
+			got - HUF_TABLE_MAGIC_SIZE, &used);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	/* Messages may hold any char */
+	for (i = 0; i < ASCII_SIZE; i++)
+		if (t->lens[i] == 0 || t->lens[i] > MAX_CODE_LEN)
+			return HUF_ERROR_INVALID_RESOURCE;
+	canon_codes(t->lens, t->codes);
+	t->id = table_id(t->lens);
+
+	return HUF_SUCCESS;
+}
+
+/* Compresses the whole input into a single message */
+enum huf_result table_compress(struct huf_input *in, struct huf_output *out,
+		struct huf_table *t, struct huf_stats *stats)
+{
+	uint8_t head[TABLE_CHECK_SIZE + TABLE_SIZE_MAX];
+	struct stats_clock clock;
+	struct bit_writer bw;
+	enum huf_result r;
+	const uint8_t *text;
+	uint8_t *buf;
+	uint64_t size, v;
+	size_t n;
+
+	/* The size goes first, so streams are read whole */
+	r = io_read_all(in, &text, &size, &buf);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	put_le16(head, t->id);
+	n = TABLE_CHECK_SIZE;
+	for (v = size; v >= 0x80; v >>= 7)
+		head[n++] = (v & 0x7f) | 0x80;
+	head[n++] = v;
+	r = io_write(out, head, n);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+
+	r = bw_init_output(&bw, out);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+	stats_start(stats, &clock);
+	huf_encode(&bw, t->codes, text, size);
+	r = bw_finish(&bw);
+	stats_stop(stats, STATS_ENCODE, &clock);
+	bw_close(&bw);
+
+out_free:
+	free(buf);
+
+	return r;
+}
+
+/* Decompresses a message compressed with the same table */
+enum huf_result table_decompress(struct huf_input *in, struct huf_output *out,
+		struct huf_table *t, struct huf_stats *stats)
+{
+	struct huf_node huftree[2 * ASCII_SIZE - 1];
+	struct huf_decoder *dec;
+	struct stats_clock clock;
+	struct bit_reader br;
+	enum huf_result r;
+	uint8_t head[TABLE_CHECK_SIZE];
+	uint8_t *outbuf = NULL, *dst, c;
+	uint16_t huftree_size;
+	uint64_t size, done;
+	size_t n;
+	int shift;
+
+	r = io_read(in, head, TABLE_CHECK_SIZE);
+	if (r != HUF_SUCCESS)
+		return r;
+	if (get_le16(head) != (uint16_t) t->id)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	size = 0;
+	shift = 0;
+	do {
+		r = io_read(in, &c, 1);
+		if (r != HUF_SUCCESS)
+			return r;
+		if (shift > 63)
+			return HUF_ERROR_INVALID_RESOURCE;
+		size |= (uint64_t) (c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	/* No code is shorter than a bit */
+	if (io_in_size(in) > 0 && size / 8 > io_in_size(in) - io_tell(in))
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	dec = (struct huf_decoder *) huf_malloc(sizeof(struct huf_decoder));
+	if (dec == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+
+	stats_start(stats, &clock);
+	r = canon_tree(t->lens, huftree, &huftree_size);
+	if (r == HUF_SUCCESS)
+		r = huf_decoder_init(dec, huftree, huftree_size);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+	stats_stop(stats, STATS_TABLE, &clock);
+
+	br_init_input(&br, in);
+
+	/* A regular output file is decoded in place */
+	r = io_reserve(out, size);
+	if (r != HUF_SUCCESS)
+		goto out_free;
+	dst = io_reserved(out, size);
+	if (dst != NULL) {
+		stats_start(stats, &clock);
+		r = huf_decode(dec, &br, dst, size);
+		stats_stop(stats, STATS_DECODE, &clock);
+		goto out_free;
+	}
+
+	n = size < IO_BUF_SIZE ? size : IO_BUF_SIZE;
+	outbuf = (uint8_t *) huf_malloc(n * sizeof(uint8_t));
+	if (outbuf == NULL && n > 0) {
+		r = HUF_ERROR_MEMORY_ALLOC;
+		goto out_free;
+	}
+
+	for (done = 0; done < size; done += n) {
+		n = size - done < IO_BUF_SIZE ? size - done : IO_BUF_SIZE;
+
+		stats_start(stats, &clock);
+		r = huf_decode(dec, &br, outbuf, n);
+		stats_stop(stats, STATS_DECODE, &clock);
+		if (r != HUF_SUCCESS)
+			break;
+
+		r = io_write(out, outbuf, n);
+		if (r != HUF_SUCCESS)
+			break;
+	}
+
+out_free:
+	free(outbuf);
+	free(dec);
+
+	return r;
+}
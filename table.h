@@ -0,0 +1,60 @@
+/*
+ * Shared code tables, trained once on sample messages and handed to both
+ * sides, so a message carries no counts and no code lengths. Every char gets
+ * a code, those missing from the samples too, so any message can be coded.
+ *
+ * A table file holds
+ *
+ *	magic		HUF_TABLE_MAGIC
+ *	code lengths	as written by canon_write
+ *
+ * and a message compressed with it
+ *
+ *	check		the low 16 bits of the table id
+ *	size		chars in the message, 7 bits a byte, low ones first
+ *	codes		padded to a whole byte
+ *
+ * The id is a hash of the code lengths, so a message is refused by any other
+ * table. Messages have no magic, they are only read with a table.
+ */
+
+#ifndef TABLE_H
+#define TABLE_H
+
+#include "common.h"
+#include "io.h"
+#include "stats.h"
+
+#define HUF_TABLE_MAGIC		"\x89HUFTBL\n"
+#define HUF_TABLE_MAGIC_SIZE	(8)
+#define TABLE_CHECK_SIZE	(2)
+#define TABLE_SIZE_MAX		(10)	/* bytes of a 64-bit size */
+
+struct huf_table {
+	uint8_t lens[ASCII_SIZE];
+	struct huf_code codes[ASCII_SIZE];
+	uint32_t id;
+};
+
+/* Adds the chars of the rest of the input to freq */
+enum huf_result table_count(struct huf_input *in, uint64_t freq[ASCII_SIZE]);
+
+/* Builds the table of the counts, no code longer than max_len */
+enum huf_result table_build(struct huf_table *t, uint64_t freq[ASCII_SIZE],
+		int max_len);
+
+/* Writes the table file */
+enum huf_result table_write(struct huf_table *t, struct huf_output *out);
+
+/* Reads a table file */
+enum huf_result table_read(struct huf_table *t, struct huf_input *in);
+
+/* Compresses the whole input into a single message */
+enum huf_result table_compress(struct huf_input *in, struct huf_output *out,
+		struct huf_table *t, struct huf_stats *stats);
+
+/* Decompresses a message compressed with the same table */
+enum huf_result table_decompress(struct huf_input *in, struct huf_output *out,
+		struct huf_table *t, struct huf_stats *stats);
+
+#endif	/* #ifndef TABLE_H */
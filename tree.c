@@ -0,0 +1,189 @@
+#include "tree.h"
+#include "pqueue.h"
+
+/*
+ * Creates the temporary Huffman tree array holding the root at position 0
+ * followed by a leaf for every char in freq, size is set to their number.
+ * The array already has room for the interior nodes, its length is set in
+ * mem.
+ */
+enum huf_result gen_leaves(uint32_t freq[ASCII_SIZE],
+		struct tmp_huf_node **th, uint16_t *size, uint32_t *mem)
+{
+	int i, j;
+
+	*size = 1;
+	for (j = 0; j < ASCII_SIZE; j++)
+		if (freq[j] > 0)
+			(*size)++;
+
+	/* n leaves have n - 1 parents, the last one goes at position 0 */
+	*mem = 2 * (*size - 1);
+	if (*mem < *size)
+		*mem = *size;
+	*th = (struct tmp_huf_node *) huf_malloc(
+			(*mem) * sizeof(struct tmp_huf_node));
+	if (*th == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+
+	/*
+	 * Creating the Huffman array by adding all the read chars starting
+	 * at index 1, after the root
+	 */
+	(*th)[0].freq = 0;
+	(*th)[0].val = 0;
+	(*th)[0].left = NO_CHILD;
+	(*th)[0].right = NO_CHILD;
+
+	i = 1;
+	for (j = 0; j < ASCII_SIZE; j++)
+		if (freq[j] > 0) {
+			(*th)[i].freq = freq[j];
+			(*th)[i].val = j;
+			(*th)[i].left = NO_CHILD;
+			(*th)[i].right = NO_CHILD;
+			i++;
+		}
+
+	return HUF_SUCCESS;
+}
+
+/* Builds the Huffman tree for the chars stored in tmp_huftree */
+enum huf_result build_huftree(struct tmp_huf_node **tmp_huftree,
+		uint16_t *huftree_size, uint32_t *tmp_huftree_mem,
+		struct huf_node **huftree)
+{
+	struct pqueue *pq;
+	enum huf_result r;
+	int i;
+
+	/* The priority queue size is equal to all the distinct read chars */
+	r = pqueue_init(&pq, *huftree_size - 1);
+	if (r != HUF_SUCCESS) {
+		pqueue_destroy(&pq);
+		return r;
+	}
+
+	/* Linking the original array of chars to the priority queue */
+	for (i = 1; i < *huftree_size; i++) {
+		r = pq->insert(pq, &(*tmp_huftree)[i], i);
+		if (r != HUF_SUCCESS)
+			break;
+	}
+
+	if (r == HUF_SUCCESS)
+		r = pq->gen_tmp_huf(pq, tmp_huftree, huftree_size,
+				tmp_huftree_mem);
+	pqueue_destroy(&pq);
+	if (r != HUF_SUCCESS)
+		return r;
+
+	/* Generating the Huffman tree to be written to disk */
+	*huftree = (struct huf_node *) huf_malloc(
+			*huftree_size * sizeof(struct huf_node));
+	if (*huftree == NULL)
+		return HUF_ERROR_MEMORY_ALLOC;
+
+	return gen_huf(*huftree, *tmp_huftree, *huftree_size);
+}
+
+/* Generates the Huffman tree to be written to file */
+enum huf_result gen_huf(struct huf_node *huftree, 
+		struct tmp_huf_node *tmp_huftree, 
+		uint16_t huftree_size)
+{
+	int i;
+
+	if (huftree_size == 0)
+		return HUF_ERROR_INVALID_RESOURCE;
+
+	for (i = 0; i < huftree_size; i++) {
+		huftree[i].val = tmp_huftree[i].val;
+		huftree[i].left = tmp_huftree[i].left;
+		huftree[i].right = tmp_huftree[i].right;
+	}
+
+	return HUF_SUCCESS;
+}
+
+/* Using Depth-first search on the tmp_huftree to generate the codes */
+enum huf_result gen_char_codes(struct huf_node *huftree, 
+		uint16_t huftree_size, 
+		struct huf_code char_codes[ASCII_SIZE])
+{
+	uint64_t code;
+	unsigned char current_character;
+	int dfs_stack[huftree_size];
+	int seen_nodes[huftree_size];
+	int stack_index, tree_index, codes_index;
+	int i;
+
+	for (i = 0; i < huftree_size; i++)
+		seen_nodes[i] = NOT_VISITED;
+
+	/* Visiting the root */
+	tree_index = 0;
+	stack_index = 0;
+	dfs_stack[stack_index] = tree_index;
+	seen_nodes[tree_index] = IS_VISITED;
+
+	code = 0;
+	codes_index = 0;
+	while (stack_index >= 0) {
+		if ((huftree[tree_index].left == -1 ||
+			seen_nodes[huftree[tree_index].left] == IS_VISITED) &&
+			(huftree[tree_index].right == -1 || 
+			seen_nodes[huftree[tree_index].right] == IS_VISITED)) {
+				/* 
+				 * If we are at a leaf, we generate the
+				 * character code
+				 */
+				if (huftree[tree_index].left == -1 &&
+						huftree[tree_index].right == -1) {
+					if (codes_index > MAX_TREE_CODE_LEN)
+						return HUF_ERROR_INVALID_RESOURCE;
+
+					current_character = huftree[tree_index].val;
+					char_codes[current_character].code = code;
+					char_codes[current_character].len = codes_index;
+				}
+				codes_index--;
+				code >>= 1;
+
+				if (--stack_index >= 0)
+					tree_index = dfs_stack[stack_index];
+		} else {
+			/* Going left */
+			if (huftree[tree_index].left != -1 &&
+			seen_nodes[huftree[tree_index].left] == NOT_VISITED) {
+				tree_index = huftree[tree_index].left;
+				code = code << 1;
+			/* Going right */
+			} else {
+				tree_index = huftree[tree_index].right;
+				code = (code << 1) | 1;
+			}
+			codes_index++;
+			dfs_stack[++stack_index] = tree_index;
+			seen_nodes[tree_index] = IS_VISITED;
+		}
+	}
+
+	return HUF_SUCCESS;
+}
+
+void print_char_codes(struct huf_code char_codes[ASCII_SIZE])
+{
+	int i, j;
+
+	for (i = 0; i < ASCII_SIZE; i++) {
+		if (char_codes[i].len == 0)
+			continue;
+
+		printf("%c - ", i);
+		for (j = char_codes[i].len - 1; j >= 0; j--)
+			putchar((char_codes[i].code >> j) & 1 ? '1' : '0');
+		printf("\n");
+	}
+	printf("\n");
+}
@@ -0,0 +1,36 @@
+/*
+ * Building the Huffman tree from the number of apparitions of every char
+ */
+
+#ifndef TREE_H
+#define TREE_H
+
+#include "common.h"
+
+/*
+ * Creates the temporary Huffman tree array holding the root at position 0
+ * followed by a leaf for every char in freq, size is set to their number.
+ * The array already has room for the interior nodes, its length is set in
+ * mem.
+ */
+enum huf_result gen_leaves(uint32_t freq[ASCII_SIZE],
+		struct tmp_huf_node **th, uint16_t *size, uint32_t *mem);
+
+/* Builds the Huffman tree for the chars stored in tmp_huftree */
+enum huf_result build_huftree(struct tmp_huf_node **tmp_huftree,
+		uint16_t *huftree_size, uint32_t *tmp_huftree_mem,
+		struct huf_node **huftree);
+
+/* Generates the Huffman tree to be written to file */
+enum huf_result gen_huf(struct huf_node *huftree, 
+		struct tmp_huf_node *tmp_huftree, 
+		uint16_t huftree_size);
+
+/* Generates the codes for the caracters */
+enum huf_result gen_char_codes(struct huf_node *huftree, 
+		uint16_t huftree_size, 
+		struct huf_code char_codes[ASCII_SIZE]);
+
+void print_char_codes(struct huf_code char_codes[ASCII_SIZE]);
+
+#endif	/* #ifndef TREE_H */